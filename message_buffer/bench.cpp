@@ -0,0 +1,743 @@
+#include "message_buffer.hpp"
+#include "chunked_buffer.hpp"
+#include "buffer_pool.hpp"
+#include "io_loop.hpp"
+#include "frame_codec.hpp"
+#include "buffer_slice.hpp"
+#include "delimiter_scan.hpp"
+#include "checksum.hpp"
+#include "forwarder.hpp"
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <memory>
+#include <thread>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+#include <cstdio>
+
+using bench_clock = std::chrono::steady_clock;
+
+static void report(const std::string& name, std::size_t bytes, bench_clock::duration elapsed) {
+    double sec = std::chrono::duration<double>(elapsed).count();
+    std::cout << std::left << std::setw(40) << name
+        << std::right << std::setw(10) << std::fixed << std::setprecision(2)
+        << (bytes / sec / 1e9) << " GB/s" << std::endl;
+}
+
+// 大响应: 按网络包大小不断追加，解析器每次只消费一小部分，缓冲区里长期堆着大量数据
+template <typename Buffer>
+static void bench_large_response(const std::string& name, std::size_t total, std::size_t rounds) {
+    std::vector<uint8_t> packet(1448, 'x');
+    auto begin = bench_clock::now();
+    for (std::size_t r = 0; r < rounds; ++r) {
+        Buffer buf;
+        std::size_t written = 0;
+        while (written < total) {
+            buf.write(packet.data(), packet.size());
+            written += packet.size();
+            buf.read_completed(64);  // 只解析出一个小头部，数据还留在缓冲区里
+        }
+        buf.read_completed(buf.get_active_size());
+    }
+    report(name, total * rounds, bench_clock::now() - begin);
+}
+
+// 稳态流: 写入一段，读走大部分，剩下的残片留到下一轮
+template <typename Buffer>
+static void bench_streaming(const std::string& name, std::size_t total) {
+    std::vector<uint8_t> packet(16384, 'y');
+    Buffer buf;
+    std::size_t written = 0;
+    auto begin = bench_clock::now();
+    while (written < total) {
+        buf.write(packet.data(), packet.size());
+        written += packet.size();
+        buf.read_completed(buf.get_active_size() - 100);
+    }
+    report(name, total, bench_clock::now() - begin);
+}
+
+static void report_rate(const std::string& name, std::size_t ops, bench_clock::duration elapsed) {
+    double sec = std::chrono::duration<double>(elapsed).count();
+    std::cout << std::left << std::setw(40) << name
+        << std::right << std::setw(10) << std::fixed << std::setprecision(2)
+        << (ops / sec / 1e6) << " M/s" << std::endl;
+}
+
+// 对照组: 改用内存池之前的存储方式，每个连接一个清零的vector
+class VectorBuffer
+{
+public:
+    VectorBuffer() : buffer_(4096), wpos_(0) {}
+
+    void write(const uint8_t* data, std::size_t size) {
+        if (wpos_ + size > buffer_.size()) buffer_.resize(std::max(wpos_ + size, buffer_.size() * 3 / 2));
+        std::memcpy(buffer_.data() + wpos_, data, size);
+        wpos_ += size;
+    }
+
+private:
+    std::vector<uint8_t> buffer_;
+    std::size_t wpos_;
+};
+
+// 连接建立/断开: 每个线程反复建立一批连接（各自收一个请求），再全部断开
+template <typename Buffer>
+static void bench_connection_churn(const std::string& name, int threads, std::size_t live, std::size_t rounds) {
+    std::vector<std::thread> workers;
+    auto begin = bench_clock::now();
+    for (int t = 0; t < threads; ++t) {
+        workers.emplace_back([live, rounds]() {
+            uint8_t request[200] = { 0 };
+            std::vector<std::unique_ptr<Buffer>> conns(live);
+            for (std::size_t r = 0; r < rounds; ++r) {
+                for (auto& c : conns) {
+                    c.reset(new Buffer());
+                    c->write(request, sizeof(request));
+                }
+                for (auto& c : conns) c.reset();
+            }
+            });
+    }
+    for (auto& w : workers) w.join();
+    report_rate(name + " " + std::to_string(threads) + "T", live * rounds * threads, bench_clock::now() - begin);
+}
+
+static void bench_connections() {
+    std::cout << "== connection setup/teardown ==" << std::endl;
+    for (int n : { 1, 4 }) {
+        bench_connection_churn<VectorBuffer>("vector (zero-filled)", n, 10000, 50);
+        bench_connection_churn<MessageBuffer>("MessageBuffer (pooled)", n, 10000, 50);
+    }
+    std::cout << std::endl;
+}
+
+static void bench_growth() {
+    std::cout << "== large response accumulation ==" << std::endl;
+    for (std::size_t mb : { 1, 8, 32 }) {
+        const std::size_t total = mb << 20;
+        const std::size_t rounds = std::max<std::size_t>(1, 64 / mb);
+        bench_large_response<MessageBuffer>("MessageBuffer " + std::to_string(mb) + "MB", total, rounds);
+        bench_large_response<ChunkedBuffer>("ChunkedBuffer " + std::to_string(mb) + "MB", total, rounds);
+    }
+    std::cout << std::endl;
+
+    std::cout << "== steady-state streaming ==" << std::endl;
+    bench_streaming<MessageBuffer>("MessageBuffer", 1 << 30);
+    bench_streaming<ChunkedBuffer>("ChunkedBuffer", 1 << 30);
+    std::cout << std::endl;
+}
+
+// 对照组: 改动之前的recv，第二个iovec是64KB的栈缓冲区，溢出的部分再write()一次
+static int legacy_recv(MessageBuffer& buf, int fd, uint64_t& copied) {
+    char extra[65535];
+    struct iovec iov[2];
+    iov[0].iov_base = buf.get_write_pointer();
+    iov[0].iov_len = buf.get_free_size();
+    iov[1].iov_base = extra;
+    iov[1].iov_len = sizeof(extra);
+    ssize_t n = readv(fd, iov, 2);
+    if (n <= 0) return static_cast<int>(n);
+    if (static_cast<std::size_t>(n) <= buf.get_free_size()) {
+        buf.write_completed(n);
+    }
+    else {
+        std::size_t extra_size = n - buf.get_free_size();
+        buf.write_completed(buf.get_free_size());
+        buf.write(reinterpret_cast<uint8_t*>(extra), extra_size);
+        copied += extra_size;
+    }
+    return static_cast<int>(n);
+}
+
+// 对端持续发送大块数据，接收端每次解析完整的帧，末尾留下一个不完整的帧等下次拼接
+static void bench_recv_path(const std::string& name, int mode, std::size_t total) {
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) return;
+    std::thread sender([fd = fds[1], total]() {
+        std::vector<uint8_t> chunk(256 * 1024, 'z');
+        std::size_t sent = 0;
+        while (sent < total) {
+            ssize_t n = write(fd, chunk.data(), std::min(chunk.size(), total - sent));
+            if (n <= 0) break;
+            sent += n;
+        }
+        });
+    MessageBuffer buf;
+    buf.set_use_fionread(mode == 2);
+    uint64_t legacy_copied = 0;
+    uint64_t legacy_calls = 0;
+    std::size_t received = 0;
+    int err = 0;
+    auto begin = bench_clock::now();
+    while (received < total) {
+        int n = mode == 0 ? (++legacy_calls, legacy_recv(buf, fds[0], legacy_copied)) : buf.recv(fds[0], &err);
+        if (n <= 0) break;
+        received += n;
+        buf.read_completed(buf.get_active_size() - std::min<std::size_t>(buf.get_active_size(), 100));
+    }
+    auto elapsed = bench_clock::now() - begin;
+    sender.join();
+    close(fds[0]);
+    close(fds[1]);
+    const uint64_t calls = mode == 0 ? legacy_calls : buf.get_counters().syscalls;
+    const uint64_t copied = buf.get_counters().bytes_copied + legacy_copied;
+    report(name, received, elapsed);
+    std::cout << "    syscalls " << calls << ", extra bytes copied " << copied
+        << " (" << std::setprecision(2) << (100.0 * copied / received) << "% of received)" << std::endl;
+}
+
+static void bench_recv() {
+    std::cout << "== recv path ==" << std::endl;
+    const std::size_t TOTAL = 256 << 20;
+    bench_recv_path("legacy readv + 64KB bounce", 0, TOTAL);
+    bench_recv_path("adaptive hint", 1, TOTAL);
+    bench_recv_path("FIONREAD", 2, TOTAL);
+    std::cout << std::endl;
+}
+
+// 每轮事件循环回复batch条小消息: 逐条write对比合并后一次flush
+static void bench_send_path(const std::string& name, bool coalesce, std::size_t messages, std::size_t batch) {
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) return;
+    const std::size_t total = messages * 64;
+    std::thread reader([fd = fds[1], total]() {
+        std::vector<uint8_t> sink(1 << 16);
+        std::size_t got = 0;
+        while (got < total) {
+            ssize_t n = read(fd, sink.data(), sink.size());
+            if (n <= 0) break;
+            got += n;
+        }
+        });
+    uint8_t reply[64] = { 0 };
+    MessageBuffer out;
+    out.set_coalescing(coalesce);
+    int err = 0;
+    auto begin = bench_clock::now();
+    for (std::size_t i = 0; i < messages; i += batch) {
+        for (std::size_t j = 0; j < batch; ++j) {
+            out.write(reply, sizeof(reply));
+            out.send(fds[0], &err);
+        }
+        if (out.has_pending_send()) out.flush(fds[0], &err);
+    }
+    auto elapsed = bench_clock::now() - begin;
+    reader.join();
+    close(fds[0]);
+    close(fds[1]);
+    report_rate(name, messages, elapsed);
+    std::cout << "    syscalls " << out.get_counters().syscalls << std::endl;
+}
+
+static void bench_send() {
+    std::cout << "== send path (64B replies, 16 per loop iteration) ==" << std::endl;
+    bench_send_path("send per message", false, 1 << 20, 16);
+    bench_send_path("coalesced flush", true, 1 << 20, 16);
+    std::cout << std::endl;
+}
+
+// 回显服务: 客户端线程在conns个连接上轮流写入64字节的消息，IoLoop收到多少就原样回多少，另一个线程收回显
+static void bench_io_loop_echo(const std::string& name, bool prefer_uring, unsigned buffers, int conns, std::size_t messages) {
+    IoLoop loop(prefer_uring, 256, buffers);
+    if (!loop.valid() || (prefer_uring && loop.backend() != IoLoop::URING)) {
+        std::cout << std::left << std::setw(40) << name << "unavailable" << std::endl;
+        return;
+    }
+    std::vector<int> server(conns), client(conns);
+    std::vector<MessageBuffer> in(conns), out(conns);
+    for (int i = 0; i < conns; ++i) {
+        int fds[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) return;
+        server[i] = fds[0];
+        client[i] = fds[1];
+        fcntl(server[i], F_SETFL, fcntl(server[i], F_GETFL) | O_NONBLOCK);
+        loop.add(server[i], &in[i]);
+    }
+    const std::size_t total = messages * 64;
+    std::thread writer([&client, conns, messages]() {
+        uint8_t msg[64 * 8] = { 0 };
+        for (std::size_t i = 0; i < messages; i += 8) {
+            if (write(client[(i / 8) % conns], msg, sizeof(msg)) <= 0) break;
+        }
+        });
+    std::thread drainer([&client, conns, total]() {
+        std::vector<pollfd> pfds(conns);
+        for (int i = 0; i < conns; ++i) pfds[i] = { client[i], POLLIN, 0 };
+        std::vector<uint8_t> sink(1 << 16);
+        std::size_t got = 0;
+        while (got < total && ::poll(pfds.data(), pfds.size(), 1000) > 0) {
+            for (auto& p : pfds) {
+                if (!(p.revents & POLLIN)) continue;
+                ssize_t n = read(p.fd, sink.data(), sink.size());
+                if (n > 0) got += n;
+            }
+        }
+        });
+    std::vector<int> index(conns * 4 + 1024, -1);
+    for (int i = 0; i < conns; ++i) index[server[i]] = i;
+    std::size_t echoed = 0;
+    auto begin = bench_clock::now();
+    while (echoed < total) {
+        loop.poll(1000, [&](int fd, int res) {
+            if (res <= 0) return;
+            const int i = index[fd];
+            out[i].write(in[i].get_read_pointer(), in[i].get_active_size());
+            in[i].read_completed(in[i].get_active_size());
+            loop.send(fd, out[i]);
+            echoed += res;
+            });
+    }
+    while (loop.poll(0, [](int, int) {}) > 0) {} // 把最后一批发送提交掉
+    auto elapsed = bench_clock::now() - begin;
+    writer.join();
+    drainer.join();
+    for (int i = 0; i < conns; ++i) {
+        loop.remove(server[i]);
+        close(server[i]);
+        close(client[i]);
+    }
+    report_rate(name, messages, elapsed);
+    std::cout << "    syscalls per message " << std::setprecision(3)
+        << (double)loop.get_counters().syscalls / messages << std::endl;
+}
+
+static void bench_io_loop() {
+    std::cout << "== IoLoop echo (64B messages, 64 connections) ==" << std::endl;
+    const std::size_t MESSAGES = 1 << 21;
+    bench_io_loop_echo("io_uring multishot + provided buffers", true, 256, 64, MESSAGES);
+    bench_io_loop_echo("io_uring recv into MessageBuffer", true, 0, 64, MESSAGES);
+    bench_io_loop_echo("epoll + recv/write", false, 0, 64, MESSAGES);
+    std::cout << std::endl;
+}
+
+// 对照组: 每个协议处理器里手写的分帧，查头部、把负载拷出来、再read_completed
+static std::size_t naive_frames(MessageBuffer& buf, std::vector<uint8_t>& payload, std::size_t& sum) {
+    std::size_t frames = 0;
+    while (buf.get_active_size() >= 4) {
+        const uint8_t* p = buf.get_read_pointer();
+        const std::size_t len = (std::size_t(p[0]) << 24) | (std::size_t(p[1]) << 16) | (std::size_t(p[2]) << 8) | p[3];
+        if (buf.get_active_size() < 4 + len) break;
+        payload.assign(p + 4, p + 4 + len);
+        sum += payload.back();
+        buf.read_completed(4 + len);
+        ++frames;
+    }
+    buf.normalize();
+    return frames;
+}
+
+static volatile std::size_t sink;
+
+// 每次"收到"16KB，里面是若干个完整的小帧加一个跨越边界的残帧
+static void bench_frame_decode(const std::string& name, bool codec_path, std::size_t frame_size, std::size_t total) {
+    FrameCodec codec(4);
+    MessageBuffer wire;
+    std::vector<uint8_t> body(frame_size, 'f');
+    while (wire.get_active_size() < (1 << 20)) codec.encode(wire, body.data(), body.size());
+    const uint8_t* stream = wire.get_read_pointer();
+    const std::size_t stream_size = wire.get_active_size() / (frame_size + 4) * (frame_size + 4);
+    MessageBuffer buf;
+    std::vector<uint8_t> payload;
+    std::size_t frames = 0, sum = 0, off = 0, fed = 0;
+    auto begin = bench_clock::now();
+    while (fed < total) {
+        const std::size_t n = std::min<std::size_t>(16384, stream_size - off);
+        buf.write(stream + off, n);
+        off = (off + n) % stream_size;
+        fed += n;
+        if (codec_path) {
+            frames += codec.for_each(buf, [&sum](const uint8_t* data, std::size_t size) { sum += data[size - 1]; });
+        }
+        else {
+            frames += naive_frames(buf, payload, sum);
+        }
+    }
+    auto elapsed = bench_clock::now() - begin;
+    report(name, fed, elapsed);
+    sink = sum;
+    std::cout << "    frames " << frames << ", bytes memmoved " << buf.get_counters().bytes_copied << std::endl;
+}
+
+static void bench_frames() {
+    std::cout << "== length-prefixed frame decode (16KB reads) ==" << std::endl;
+    for (std::size_t size : { 60, 100, 1000 }) {
+        bench_frame_decode("copy out + normalize, " + std::to_string(size) + "B", false, size, 1 << 30);
+        bench_frame_decode("FrameCodec views, " + std::to_string(size) + "B", true, size, 1 << 30);
+    }
+    std::cout << std::endl;
+}
+
+// 每帧分发给fanout个订阅者的队列，订阅者每8次读取处理一次队列: 拷贝成vector对比引用计数切片
+template <bool UseSlices>
+static void bench_fanout_path(const std::string& name, std::size_t frame_size, int fanout, std::size_t total) {
+    FrameCodec codec(4);
+    MessageBuffer wire;
+    std::vector<uint8_t> body(frame_size, 'q');
+    while (wire.get_active_size() < (1 << 20)) codec.encode(wire, body.data(), body.size());
+    const std::size_t stream_size = wire.get_active_size() / (frame_size + 4) * (frame_size + 4);
+    std::vector<std::vector<std::vector<uint8_t>>> copies(fanout);
+    std::vector<std::vector<BufferSlice>> slices(fanout);
+    MessageBuffer buf;
+    std::size_t off = 0, fed = 0, frames = 0, reads = 0;
+    auto begin = bench_clock::now();
+    while (fed < total) {
+        const std::size_t n = std::min<std::size_t>(16384, stream_size - off);
+        buf.write(wire.get_read_pointer() + off, n);
+        ++reads;
+        off = (off + n) % stream_size;
+        fed += n;
+        frames += codec.for_each(buf, [&](const uint8_t* data, std::size_t size) {
+            if (UseSlices) {
+                BufferSlice s = buf.slice(data, size);
+                for (auto& q : slices) q.push_back(s);
+            }
+            else {
+                for (auto& q : copies) q.emplace_back(data, data + size);
+            }
+            });
+        if (reads % 8 == 0) {
+            for (auto& q : copies) q.clear();
+            for (auto& q : slices) q.clear();
+        }
+    }
+    report(name, fed * fanout, bench_clock::now() - begin);
+    std::cout << "    frames " << frames << ", bytes copied by buffer " << buf.get_counters().bytes_copied << std::endl;
+}
+
+static void bench_fanout() {
+    std::cout << "== decoded frame fan-out to 4 consumers ==" << std::endl;
+    for (std::size_t size : { 100, 4000 }) {
+        bench_fanout_path<false>("memcpy per consumer, " + std::to_string(size) + "B", size, 4, 1 << 28);
+        bench_fanout_path<true>("BufferSlice, " + std::to_string(size) + "B", size, 4, 1 << 28);
+    }
+    std::cout << std::endl;
+}
+
+// 对照组: 协议解析器里原来的逐字节查找\r\n
+static std::size_t bytewise_find_crlf(const uint8_t* p, std::size_t n) {
+    for (std::size_t i = 0; i + 1 < n; ++i) {
+        if (p[i] == '\r' && p[i + 1] == '\n') return i;
+    }
+    return DelimiterScan::NPOS;
+}
+
+// 1MB的文本，每行line_size字节（含\r\n），逐行找分隔符
+static void bench_line_split(const std::string& name, int impl, std::size_t line_size) {
+    std::vector<uint8_t> text;
+    while (text.size() < (1 << 20)) {
+        for (std::size_t i = 0; i + 2 < line_size; ++i) text.push_back(static_cast<uint8_t>('a' + i % 26));
+        text.push_back('\r');
+        text.push_back('\n');
+    }
+    const std::size_t rounds = std::max<std::size_t>(1, (256 << 20) / text.size());
+    std::size_t lines = 0;
+    auto begin = bench_clock::now();
+    for (std::size_t r = 0; r < rounds; ++r) {
+        const uint8_t* p = text.data();
+        std::size_t left = text.size();
+        for (;;) {
+            std::size_t at;
+            if (impl == 0) {
+                at = bytewise_find_crlf(p, left);
+            }
+            else if (impl == 1) {
+                // memchr找\r再确认下一个字节
+                at = DelimiterScan::NPOS;
+                for (const uint8_t* q = p; (q = static_cast<const uint8_t*>(memchr(q, '\r', left - (q - p)))) != nullptr; ++q) {
+                    if (static_cast<std::size_t>(q - p) + 1 < left && q[1] == '\n') { at = q - p; break; }
+                }
+            }
+            else {
+                at = DelimiterScan::find_pair(p, left, '\r', '\n');
+            }
+            if (at == DelimiterScan::NPOS) break;
+            ++lines;
+            p += at + 2;
+            left -= at + 2;
+        }
+    }
+    sink = lines;
+    report(name + ", " + std::to_string(line_size) + "B lines", text.size() * rounds, bench_clock::now() - begin);
+}
+
+// 64KB的长行按1448字节的包到达: 每次从读位置重新扫描，对比DelimiterScanner只扫新到的部分
+static void bench_partial_lines(const std::string& name, bool resumable) {
+    const std::size_t LINE = 64 * 1024, PACKET = 1448;
+    std::vector<uint8_t> line(LINE, 'x');
+    line[LINE - 2] = '\r';
+    line[LINE - 1] = '\n';
+    MessageBuffer buf;
+    DelimiterScanner scanner;
+    const std::size_t lines = 2000;
+    std::size_t scanned = 0;
+    auto begin = bench_clock::now();
+    for (std::size_t l = 0; l < lines; ++l) {
+        for (std::size_t off = 0; off < LINE; off += PACKET) {
+            const std::size_t n = std::min(PACKET, LINE - off);
+            buf.write(line.data() + off, n);
+            const std::size_t at = resumable ? scanner.next(buf)
+                : DelimiterScan::find_pair(buf.get_read_pointer(), buf.get_active_size(), '\r', '\n');
+            scanned += resumable ? n : buf.get_active_size();
+            if (at != DelimiterScan::NPOS) buf.read_completed(at + 2);
+        }
+    }
+    report(name, LINE * lines, bench_clock::now() - begin);
+    std::cout << "    bytes examined per received byte " << std::setprecision(2) << (double)scanned / (LINE * lines) << std::endl;
+}
+
+static void bench_delimiters() {
+    std::cout << "== CRLF line split ==" << std::endl;
+    const DelimiterScan::Isa best = DelimiterScan::isa();
+    for (std::size_t size : { 8, 32, 128, 1024, 8192 }) {
+        bench_line_split("byte at a time", 0, size);
+        bench_line_split("memchr + check", 1, size);
+        for (DelimiterScan::Isa isa : { DelimiterScan::SCALAR, DelimiterScan::SSE2, DelimiterScan::AVX2 }) {
+            if (!DelimiterScan::use_isa(isa)) continue;
+            bench_line_split(isa == DelimiterScan::AVX2 ? "find_pair AVX2" : isa == DelimiterScan::SSE2 ? "find_pair SSE2" : "find_pair scalar", 2, size);
+        }
+        DelimiterScan::use_isa(best);
+    }
+    std::cout << std::endl;
+
+    std::cout << "== 64KB lines arriving in 1448B packets ==" << std::endl;
+    bench_partial_lines("rescan from read position", false);
+    bench_partial_lines("DelimiterScanner (resumable)", true);
+    std::cout << std::endl;
+}
+
+// 对照组: 现在用的逐字节查表CRC32C
+static uint32_t bytewise_crc32c(const uint8_t* p, std::size_t n) {
+    static uint32_t table[256];
+    if (!table[1]) {
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k) c = c & 1 ? (c >> 1) ^ 0x82f63b78 : c >> 1;
+            table[i] = c;
+        }
+    }
+    uint32_t crc = ~0u;
+    while (n--) crc = (crc >> 8) ^ table[(crc ^ *p++) & 0xff];
+    return ~crc;
+}
+
+static void bench_checksum_path(const std::string& name, int impl, std::size_t size) {
+    std::vector<uint8_t> data(size, 0x5a);
+    const std::size_t total = std::size_t(512) << 20;
+    const std::size_t rounds = total / size;
+    uint32_t acc = 0;
+    auto begin = bench_clock::now();
+    for (std::size_t r = 0; r < rounds; ++r) {
+        data[r % size] = static_cast<uint8_t>(r);
+        acc += impl == 0 ? bytewise_crc32c(data.data(), size)
+            : impl == 1 ? Crc32c::compute(data.data(), size)
+            : InternetChecksum::compute(data.data(), size);
+    }
+    sink = acc;
+    report(name + ", " + std::to_string(size) + "B", rounds * size, bench_clock::now() - begin);
+}
+
+static void bench_checksums() {
+    std::cout << "== checksums ==" << std::endl;
+    for (std::size_t size : { 64, 1024, 16384, 262144 }) {
+        bench_checksum_path("CRC32C bytewise table", 0, size);
+        Crc32c::use_hardware(false);
+        bench_checksum_path("CRC32C slicing-by-8", 1, size);
+        if (Crc32c::use_hardware(true)) bench_checksum_path("CRC32C sse4.2 3-way", 1, size);
+        bench_checksum_path("Internet checksum", 2, size);
+    }
+    std::cout << std::endl;
+}
+
+// 当前进程的常驻内存
+static std::size_t resident_bytes() {
+    FILE* f = fopen("/proc/self/statm", "r");
+    if (nullptr == f) return 0;
+    unsigned long size = 0, resident = 0;
+    if (fscanf(f, "%lu %lu", &size, &resident) != 2) resident = 0;
+    fclose(f);
+    return resident * static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+}
+
+// conns个连接各来一次burst字节的突发然后空闲，事件循环继续对每个连接tick；看空闲之后留下的内存和tick的开销
+// 每种策略在单独的子进程里跑，前一种策略还给内存池的块不会影响后一种的常驻内存
+static void bench_idle_path(const std::string& name, const ReclaimPolicy& policy, std::size_t conns, std::size_t burst) {
+    const pid_t pid = fork();
+    if (pid != 0) {
+        if (pid > 0) waitpid(pid, nullptr, 0);
+        return;
+    }
+    std::vector<uint8_t> data(burst, 'x');
+    const std::size_t rss_before = resident_bytes();
+    const std::size_t retained_before = MessageBuffer::retained_bytes();
+    {
+        std::vector<MessageBuffer> buffers(conns);
+        for (auto& buf : buffers) {
+            buf.set_reclaim_policy(policy);
+            buf.write(data.data(), data.size());
+            buf.read_completed(data.size());
+        }
+        const std::size_t cycles = 100;
+        auto begin = bench_clock::now();
+        for (std::size_t c = 0; c < cycles; ++c) {
+            for (auto& buf : buffers) buf.tick();
+        }
+        auto elapsed = bench_clock::now() - begin;
+        const double ns = std::chrono::duration<double, std::nano>(elapsed).count() / (cycles * conns);
+        std::cout << std::left << std::setw(40) << name
+            << std::right << std::setw(8) << (MessageBuffer::retained_bytes() - retained_before) / (1 << 20) << " MB retained"
+            << std::setw(8) << (resident_bytes() - std::min(rss_before, resident_bytes())) / (1 << 20) << " MB RSS"
+            << std::setw(8) << std::fixed << std::setprecision(1) << ns << " ns/tick" << std::endl;
+    }
+    _exit(0);
+}
+
+static void bench_idle() {
+    std::cout << "== 512 idle connections after a 256KB burst ==" << std::endl;
+    ReclaimPolicy none;
+    ReclaimPolicy shrink;
+    shrink.shrink_threshold = 64 * 1024;
+    shrink.idle_cycles = 10;
+    ReclaimPolicy advise = shrink;
+    advise.advise_threshold = 64 * 1024;
+    bench_idle_path("no reclaim", none, 512, 256 * 1024);
+    bench_idle_path("shrink to initial size", shrink, 512, 256 * 1024);
+    bench_idle_path("shrink + madvise", advise, 512, 256 * 1024);
+    std::cout << std::endl;
+}
+
+// 匿名内存（常驻减去文件映射的页），溢出文件的页缓存内核可以写回和回收，不算在里面
+static std::size_t anonymous_bytes() {
+    FILE* f = fopen("/proc/self/statm", "r");
+    if (nullptr == f) return 0;
+    unsigned long size = 0, resident = 0, shared = 0;
+    if (fscanf(f, "%lu %lu %lu", &size, &resident, &shared) != 3) resident = shared = 0;
+    fclose(f);
+    return (resident - shared) * static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+}
+
+// total字节的上传按64KB一次写进缓冲区，全部到齐之后再处理；子进程里跑，单独看内存
+static void bench_upload_path(const std::string& name, std::size_t spill_threshold, std::size_t total) {
+    const pid_t pid = fork();
+    if (pid != 0) {
+        if (pid > 0) waitpid(pid, nullptr, 0);
+        return;
+    }
+    std::vector<uint8_t> chunk(64 * 1024, 'u');
+    const std::size_t anon_before = anonymous_bytes();
+    {
+        MessageBuffer buf;
+        SpillPolicy policy;
+        policy.threshold = spill_threshold;
+        buf.set_spill_policy(policy);
+        auto begin = bench_clock::now();
+        for (std::size_t n = 0; n < total; n += chunk.size()) buf.write(chunk.data(), chunk.size());
+        auto elapsed = bench_clock::now() - begin;
+        const std::size_t anon = anonymous_bytes() - std::min(anon_before, anonymous_bytes());
+        std::cout << std::left << std::setw(28) << name
+            << std::right << std::fixed << std::setprecision(2)
+            << std::setw(7) << total / std::chrono::duration<double>(elapsed).count() / 1e9 << " GB/s"
+            << std::setw(6) << buf.get_counters().bytes_copied / (1 << 20) << " MB copied"
+            << std::setw(6) << anon / (1 << 20) << " MB anonymous" << std::endl;
+    }
+    _exit(0);
+}
+
+static void bench_upload() {
+    std::cout << "== 256MB upload buffered in one MessageBuffer ==" << std::endl;
+    bench_upload_path("grow in memory", 0, 256 << 20);
+    bench_upload_path("spill above 1MB", 1 << 20, 256 << 20);
+    std::cout << std::endl;
+}
+
+// 代理的一个方向: 客户端写total字节到src，src上收到的转发给dst，另一端读完为止
+// splice为false时是原来的做法，recv进MessageBuffer再flush出去
+static void bench_forward_path(const std::string& name, bool splice, std::size_t total) {
+    int a[2], b[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, a) != 0 || socketpair(AF_UNIX, SOCK_STREAM, 0, b) != 0) return;
+    const int src = a[1], dst = b[0];
+    fcntl(src, F_SETFL, fcntl(src, F_GETFL) | O_NONBLOCK);
+    fcntl(dst, F_SETFL, fcntl(dst, F_GETFL) | O_NONBLOCK);
+    std::thread writer([fd = a[0], total]() {
+        std::vector<uint8_t> chunk(1 << 16, 'f');
+        for (std::size_t sent = 0; sent < total; ) {
+            const ssize_t n = write(fd, chunk.data(), std::min(chunk.size(), total - sent));
+            if (n <= 0) break;
+            sent += n;
+        }
+        shutdown(fd, SHUT_WR);
+        });
+    std::thread drainer([fd = b[1]]() {
+        std::vector<uint8_t> sink(1 << 16);
+        while (read(fd, sink.data(), sink.size()) > 0) {}
+        });
+    Forwarder fw(src, dst);
+    MessageBuffer buf;
+    uint64_t copied = 0;
+    auto begin = bench_clock::now();
+    for (;;) {
+        int err = 0;
+        int n;
+        bool backlog;
+        if (splice) {
+            n = fw.forward(&err);
+            backlog = fw.pending() > 0;
+        }
+        else {
+            n = buf.get_active_size() > 0 ? 1 : buf.recv(src, &err); // 上次没写完时先不读
+            if (buf.get_active_size() > 0) {
+                const int sent = buf.flush(dst, &err);
+                if (sent > 0) copied += sent;
+            }
+            backlog = buf.get_active_size() > 0;
+        }
+        if (n == 0 && !backlog) break;
+        if (n < 0 && err != EAGAIN) break;
+        if (err == EAGAIN) {
+            pollfd p = { backlog ? dst : src, static_cast<short>(backlog ? POLLOUT : POLLIN), 0 };
+            ::poll(&p, 1, 1000);
+        }
+    }
+    auto elapsed = bench_clock::now() - begin;
+    shutdown(dst, SHUT_WR);
+    writer.join();
+    drainer.join();
+    close(a[0]); close(a[1]); close(b[0]); close(b[1]);
+    report(name, total, elapsed);
+    const ForwardCounters& c = fw.get_counters();
+    std::cout << "    forwarded without user-space copy " << (c.bytes_spliced + c.bytes_zerocopy) / (1 << 20)
+        << " MB, copied " << (copied + c.bytes_copied) / (1 << 20) << " MB" << std::endl;
+}
+
+static void bench_forward() {
+    std::cout << "== proxy forwarding 1GB ==" << std::endl;
+    bench_forward_path("recv + flush via MessageBuffer", false, std::size_t(1) << 30);
+    bench_forward_path("Forwarder splice", true, std::size_t(1) << 30);
+    std::cout << std::endl;
+}
+
+int main() {
+    bench_growth();
+    bench_connections();
+    bench_recv();
+    bench_send();
+    bench_io_loop();
+    bench_frames();
+    bench_fanout();
+    bench_delimiters();
+    bench_checksums();
+    bench_idle();
+    bench_upload();
+    bench_forward();
+    return 0;
+}
@@ -0,0 +1,147 @@
+#ifndef __BUFFER_POOL_HPP__
+#define __BUFFER_POOL_HPP__
+
+#include <cstdint>
+#include <cstddef>
+#include <new>
+#include <mutex>
+#include <vector>
+
+/*
+ * MessageBuffer存储块的内存池
+ * 块大小按2的幂分级（256B ~ 1MB），更大的请求直接走operator new
+ * 每个线程有自己的空闲链表，分配和释放不加锁；本地链表满了把一半挪到全局溢出池，
+ * 本地为空时从全局池一次批量取回，线程退出时本地缓存全部归还全局池
+ * 块从来不清零，调用者必须自己维护哪些字节是有效的
+ */
+class BufferPool
+{
+public:
+	static constexpr unsigned MIN_SHIFT = 8;
+	static constexpr unsigned MAX_SHIFT = 20;
+	static constexpr std::size_t CLASSES = MAX_SHIFT - MIN_SHIFT + 1;
+	static constexpr std::size_t LOCAL_LIMIT = 64; /*每个线程每个级别最多缓存的块数*/
+	static constexpr std::size_t BATCH = LOCAL_LIMIT / 2;
+
+	/*分配至少size字节，capacity返回块的实际大小，释放时原样传回*/
+	static uint8_t* allocate(std::size_t size, std::size_t& capacity) {
+		const std::size_t cls = size_class(size);
+		if (cls >= CLASSES) {
+			capacity = size;
+			return static_cast<uint8_t*>(::operator new(size));
+		}
+		capacity = std::size_t(1) << (cls + MIN_SHIFT);
+		std::vector<uint8_t*>& local = local_cache().lists[cls];
+		if (local.empty()) {
+			global().refill(cls, local);
+		}
+		if (local.empty()) {
+			return static_cast<uint8_t*>(::operator new(capacity));
+		}
+		uint8_t* block = local.back();
+		local.pop_back();
+		return block;
+	}
+
+	static void deallocate(uint8_t* block, std::size_t capacity) {
+		if (nullptr == block) return;
+		const std::size_t cls = size_class(capacity);
+		if (cls >= CLASSES || capacity != std::size_t(1) << (cls + MIN_SHIFT)) {
+			::operator delete(block);
+			return;
+		}
+		std::vector<uint8_t*>& local = local_cache().lists[cls];
+		if (local.size() >= LOCAL_LIMIT) {
+			global().spill(cls, local, BATCH);
+		}
+		local.push_back(block);
+	}
+
+	/*全局溢出池里的块数，用于测试和观察*/
+	static std::size_t global_blocks() {
+		return global().blocks();
+	}
+
+	/*当前线程缓存的块数*/
+	static std::size_t local_blocks() {
+		std::size_t n = 0;
+		for (auto& list : local_cache().lists) n += list.size();
+		return n;
+	}
+
+private:
+	static std::size_t size_class(std::size_t size) {
+		std::size_t cls = 0;
+		while ((std::size_t(1) << (cls + MIN_SHIFT)) < size && cls < CLASSES) {
+			++cls;
+		}
+		return cls;
+	}
+
+	class Global
+	{
+	public:
+		~Global() {
+			for (auto& list : lists_) {
+				for (uint8_t* block : list) ::operator delete(block);
+			}
+		}
+
+		/*一次最多取BATCH个块放到本地链表*/
+		void refill(std::size_t cls, std::vector<uint8_t*>& local) {
+			std::lock_guard<std::mutex> lock(mutex_);
+			std::vector<uint8_t*>& list = lists_[cls];
+			const std::size_t n = list.size() < BATCH ? list.size() : BATCH;
+			local.insert(local.end(), list.end() - n, list.end());
+			list.resize(list.size() - n);
+		}
+
+		/*把本地链表末尾的n个块挪到全局池*/
+		void spill(std::size_t cls, std::vector<uint8_t*>& local, std::size_t n) {
+			std::lock_guard<std::mutex> lock(mutex_);
+			lists_[cls].insert(lists_[cls].end(), local.end() - n, local.end());
+			local.resize(local.size() - n);
+		}
+
+		std::size_t blocks() {
+			std::lock_guard<std::mutex> lock(mutex_);
+			std::size_t n = 0;
+			for (auto& list : lists_) n += list.size();
+			return n;
+		}
+
+	private:
+		std::mutex mutex_;
+		std::vector<uint8_t*> lists_[CLASSES];
+	};
+
+	struct LocalCache
+	{
+		LocalCache() {
+			global(); /*保证全局池先于本线程缓存构造，析构时它还活着*/
+			for (auto& list : lists) list.reserve(LOCAL_LIMIT);
+		}
+
+		~LocalCache() {
+			for (std::size_t cls = 0; cls < CLASSES; ++cls) {
+				if (!lists[cls].empty()) {
+					global().spill(cls, lists[cls], lists[cls].size());
+				}
+			}
+		}
+
+		std::vector<uint8_t*> lists[CLASSES];
+	};
+
+	static Global& global() {
+		static Global pool;
+		return pool;
+	}
+
+	static LocalCache& local_cache() {
+		static thread_local LocalCache cache;
+		return cache;
+	}
+};
+
+#endif
@@ -0,0 +1,129 @@
+#ifndef __BUFFER_SLICE_HPP__
+#define __BUFFER_SLICE_HPP__
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <utility>
+#include <sys/mman.h>
+#include "buffer_pool.hpp"
+
+/*
+ * 带引用计数的存储块，MessageBuffer第一次切片时才创建
+ * MessageBuffer自己持有一个引用，每个BufferSlice各持有一个；最后一个引用释放时块归还BufferPool
+ * 引用计数是原子的，切片可以交给别的线程，在哪个线程释放都可以
+ * 溢出到文件的MessageBuffer用create_mapping，块是整段映射，最后一个引用释放时munmap
+ */
+class SharedBlock
+{
+public:
+	static SharedBlock* create(uint8_t* data, std::size_t capacity) {
+		return new SharedBlock(data, capacity, false);
+	}
+
+	static SharedBlock* create_mapping(uint8_t* addr, std::size_t length) {
+		return new SharedBlock(addr, length, true);
+	}
+
+	void retain() {
+		refs_.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	void release() {
+		if (refs_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+			if (mapped_) {
+				munmap(data_, capacity_);
+			}
+			else {
+				BufferPool::deallocate(data_, capacity_);
+			}
+			delete this;
+		}
+	}
+
+	/*为1时只剩MessageBuffer自己，可以原地复用*/
+	uint32_t use_count() const {
+		return refs_.load(std::memory_order_acquire);
+	}
+
+private:
+	SharedBlock(uint8_t* data, std::size_t capacity, bool mapped) : refs_(1), data_(data), capacity_(capacity), mapped_(mapped) {}
+
+	std::atomic<uint32_t> refs_;
+	uint8_t* data_;
+	std::size_t capacity_;
+	bool mapped_;
+};
+
+/*
+ * MessageBuffer中一段数据的只读引用，复制只增加引用计数，不拷贝数据
+ * 切片存在期间MessageBuffer不会覆盖这段数据: 它需要把读写位置退回块开头时，如果块还被引用，就换一个新块（写时复制）
+ */
+class BufferSlice
+{
+public:
+	BufferSlice() : block_(nullptr), data_(nullptr), size_(0) {}
+
+	BufferSlice(SharedBlock* block, const uint8_t* data, std::size_t size) : block_(block), data_(data), size_(size) {
+		if (block_) block_->retain();
+	}
+
+	~BufferSlice() {
+		if (block_) block_->release();
+	}
+
+	BufferSlice(const BufferSlice& other) : BufferSlice(other.block_, other.data_, other.size_) {}
+
+	BufferSlice& operator=(const BufferSlice& other) {
+		if (this != &other) {
+			BufferSlice copy(other);
+			swap(copy);
+		}
+		return *this;
+	}
+
+	BufferSlice(BufferSlice&& other) noexcept : block_(other.block_), data_(other.data_), size_(other.size_) {
+		other.block_ = nullptr;
+		other.data_ = nullptr;
+		other.size_ = 0;
+	}
+
+	BufferSlice& operator=(BufferSlice&& other) noexcept {
+		if (this != &other) {
+			BufferSlice moved(std::move(other));
+			swap(moved);
+		}
+		return *this;
+	}
+
+	void swap(BufferSlice& other) noexcept {
+		std::swap(block_, other.block_);
+		std::swap(data_, other.data_);
+		std::swap(size_, other.size_);
+	}
+
+	const uint8_t* data() const {
+		return data_;
+	}
+
+	std::size_t size() const {
+		return size_;
+	}
+
+	bool empty() const {
+		return size_ == 0;
+	}
+
+	/*同一个块上的子区间，越界时返回空切片*/
+	BufferSlice sub(std::size_t offset, std::size_t size) const {
+		if (offset > size_ || size > size_ - offset) return BufferSlice();
+		return BufferSlice(block_, data_ + offset, size);
+	}
+
+private:
+	SharedBlock* block_;
+	const uint8_t* data_;
+	std::size_t size_;
+};
+
+#endif
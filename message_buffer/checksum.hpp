@@ -0,0 +1,375 @@
+#ifndef __CHECKSUM_HPP__
+#define __CHECKSUM_HPP__
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <sys/uio.h>
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#define CHECKSUM_X86_64 1
+#endif
+
+/*
+ * 增量校验的公共部分: 记住读指针之后已经算过多少字节，
+ * 每次recv/write_completed之后调用update(buf, end)只累加新到的部分，不重复计算
+ * 位置相对读指针保存，normalize和扩容不影响；调用者消费掉已校验的数据时要调用consumed
+ */
+template <typename Derived>
+class BufferChecksum
+{
+public:
+	static constexpr std::size_t NPOS = ~std::size_t(0);
+
+	/*把读指针之后[covered(), end)里新到的字节累加进来，end通常是当前帧的结束位置；返回已经覆盖到的位置*/
+	template<typename Buffer>
+	std::size_t update(Buffer& buf, std::size_t end = NPOS) {
+		const std::size_t active = buf.get_active_size();
+		const std::size_t limit = end < active ? end : active;
+		if (limit > covered_) {
+			static_cast<Derived*>(this)->update(buf.get_read_pointer() + covered_, limit - covered_);
+			covered_ = limit;
+		}
+		return covered_;
+	}
+
+	/*调用者read_completed(n)之后同步调整位置，n不能超过covered()*/
+	void consumed(std::size_t n) {
+		covered_ = n < covered_ ? covered_ - n : 0;
+	}
+
+	std::size_t covered() const {
+		return covered_;
+	}
+
+protected:
+	std::size_t covered_ = 0;
+};
+
+/*
+ * CRC32C（Castagnoli多项式，iSCSI/ext4/RocksDB等使用的那个）
+ * x86_64上CPU支持SSE4.2时用crc32指令，长数据分成三段交错计算，隐藏指令3个周期的延迟，最后用查表的移位算子合并；
+ * 否则用slicing-by-8查表，每次处理8个字节
+ * 分散的区域（ChunkedBuffer的块链、环形缓冲区回绕的两段）用iovec版本依次累加，不需要拷贝到一起
+ */
+class Crc32c : public BufferChecksum<Crc32c>
+{
+public:
+	static constexpr uint32_t POLY = 0x82f63b78; /*反射形式*/
+
+	Crc32c() : crc_(0) {}
+
+	/*一次算完*/
+	static uint32_t compute(const uint8_t* p, std::size_t n) {
+		return extend(0, p, n);
+	}
+
+	/*crc是前面数据的结果，返回把[p, p + n)接在后面的结果*/
+	static uint32_t extend(uint32_t crc, const uint8_t* p, std::size_t n) {
+		return ~impl()(~crc, p, n);
+	}
+
+	static uint32_t extend(uint32_t crc, const struct iovec* iov, int count) {
+		for (int i = 0; i < count; ++i) {
+			crc = extend(crc, static_cast<const uint8_t*>(iov[i].iov_base), iov[i].iov_len);
+		}
+		return crc;
+	}
+
+	/*当前是否在用crc32指令*/
+	static bool hardware() {
+		return impl() != &software;
+	}
+
+	/*切换实现，CPU不支持时返回false；只用于测试和基准，不要和计算并发调用*/
+	static bool use_hardware(bool enable) {
+		if (enable && !hardware_supported()) return false;
+		impl() = enable ? hardware_impl() : &software;
+		return true;
+	}
+
+	using BufferChecksum<Crc32c>::update;
+
+	void update(const uint8_t* p, std::size_t n) {
+		crc_ = extend(crc_, p, n);
+	}
+
+	uint32_t value() const {
+		return crc_;
+	}
+
+	void reset() {
+		crc_ = 0;
+		covered_ = 0;
+	}
+
+private:
+	typedef uint32_t(*Kernel)(uint32_t, const uint8_t*, std::size_t);
+
+	static constexpr std::size_t LONG_BLOCK = 8192; /*三路交错时每一路的长度*/
+	static constexpr std::size_t SHORT_BLOCK = 256;
+
+	struct Tables
+	{
+		uint32_t slice[8][256];      /*slicing-by-8*/
+		uint32_t long_shift[4][256]; /*把crc向后移过LONG_BLOCK个0字节*/
+		uint32_t short_shift[4][256];
+
+		Tables() {
+			for (uint32_t n = 0; n < 256; ++n) {
+				uint32_t crc = n;
+				for (int k = 0; k < 8; ++k) crc = crc & 1 ? (crc >> 1) ^ POLY : crc >> 1;
+				slice[0][n] = crc;
+			}
+			for (uint32_t n = 0; n < 256; ++n) {
+				for (int k = 1; k < 8; ++k) {
+					slice[k][n] = (slice[k - 1][n] >> 8) ^ slice[0][slice[k - 1][n] & 0xff];
+				}
+			}
+			zeros(long_shift, LONG_BLOCK);
+			zeros(short_shift, SHORT_BLOCK);
+		}
+
+		/*GF(2)上的32x32矩阵乘向量*/
+		static uint32_t times(const uint32_t* mat, uint32_t vec) {
+			uint32_t sum = 0;
+			for (; vec; vec >>= 1, ++mat) {
+				if (vec & 1) sum ^= *mat;
+			}
+			return sum;
+		}
+
+		static void square(uint32_t* out, const uint32_t* mat) {
+			for (int n = 0; n < 32; ++n) out[n] = times(mat, mat[n]);
+		}
+
+		/*在crc后面追加len个0字节的线性算子，拆成4张按字节查的表*/
+		static void zeros(uint32_t table[4][256], std::size_t len) {
+			uint32_t odd[32], even[32];
+			odd[0] = POLY; /*一个0比特的算子*/
+			for (int n = 1; n < 32; ++n) odd[n] = uint32_t(1) << (n - 1);
+			square(even, odd); /*2个0比特*/
+			square(odd, even); /*4个0比特*/
+			const uint32_t* op = odd;
+			do {
+				square(even, odd); /*第一次是1个0字节，之后每次翻倍*/
+				op = even;
+				len >>= 1;
+				if (len == 0) break;
+				square(odd, even);
+				op = odd;
+				len >>= 1;
+			} while (len);
+			for (uint32_t n = 0; n < 256; ++n) {
+				table[0][n] = times(op, n);
+				table[1][n] = times(op, n << 8);
+				table[2][n] = times(op, n << 16);
+				table[3][n] = times(op, n << 24);
+			}
+		}
+	};
+
+	static const Tables& tables() {
+		static const Tables t;
+		return t;
+	}
+
+	static uint32_t shift(const uint32_t table[4][256], uint32_t crc) {
+		return table[0][crc & 0xff] ^ table[1][(crc >> 8) & 0xff] ^ table[2][(crc >> 16) & 0xff] ^ table[3][crc >> 24];
+	}
+
+	static uint32_t software(uint32_t crc, const uint8_t* p, std::size_t n) {
+		const Tables& t = tables();
+		while (n && (reinterpret_cast<uintptr_t>(p) & 7)) {
+			crc = (crc >> 8) ^ t.slice[0][(crc ^ *p++) & 0xff];
+			--n;
+		}
+		while (n >= 8) {
+			uint32_t lo, hi;
+			std::memcpy(&lo, p, 4);
+			std::memcpy(&hi, p + 4, 4);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+			lo = __builtin_bswap32(lo);
+			hi = __builtin_bswap32(hi);
+#endif
+			lo ^= crc;
+			crc = t.slice[7][lo & 0xff] ^ t.slice[6][(lo >> 8) & 0xff] ^ t.slice[5][(lo >> 16) & 0xff] ^ t.slice[4][lo >> 24]
+				^ t.slice[3][hi & 0xff] ^ t.slice[2][(hi >> 8) & 0xff] ^ t.slice[1][(hi >> 16) & 0xff] ^ t.slice[0][hi >> 24];
+			p += 8;
+			n -= 8;
+		}
+		while (n--) {
+			crc = (crc >> 8) ^ t.slice[0][(crc ^ *p++) & 0xff];
+		}
+		return crc;
+	}
+
+	static bool hardware_supported() {
+#ifdef CHECKSUM_X86_64
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("sse4.2");
+#else
+		return false;
+#endif
+	}
+
+	static Kernel hardware_impl() {
+#ifdef CHECKSUM_X86_64
+		return &hardware;
+#else
+		return &software;
+#endif
+	}
+
+	static Kernel& impl() {
+		static Kernel current = hardware_supported() ? hardware_impl() : &software;
+		return current;
+	}
+
+#ifdef CHECKSUM_X86_64
+	/*
+	 * 三段各block字节同时算，crc32指令延迟3个周期、吞吐1个周期，三条依赖链刚好把流水线填满；
+	 * 第一段的结果移过block个0字节后和第二段异或，再移一次和第三段异或，就是三段连起来的crc
+	 */
+	__attribute__((target("sse4.2")))
+	static uint64_t interleave(uint64_t crc0, const uint8_t*& p, std::size_t& n, std::size_t block, const uint32_t table[4][256]) {
+		while (n >= 3 * block) {
+			uint64_t crc1 = 0, crc2 = 0;
+			const uint8_t* const end = p + block;
+			do {
+				uint64_t a, b, c;
+				std::memcpy(&a, p, 8);
+				std::memcpy(&b, p + block, 8);
+				std::memcpy(&c, p + 2 * block, 8);
+				crc0 = _mm_crc32_u64(crc0, a);
+				crc1 = _mm_crc32_u64(crc1, b);
+				crc2 = _mm_crc32_u64(crc2, c);
+				p += 8;
+			} while (p < end);
+			crc0 = shift(table, static_cast<uint32_t>(crc0)) ^ crc1;
+			crc0 = shift(table, static_cast<uint32_t>(crc0)) ^ crc2;
+			p += 2 * block;
+			n -= 3 * block;
+		}
+		return crc0;
+	}
+
+	__attribute__((target("sse4.2")))
+	static uint32_t hardware(uint32_t crc, const uint8_t* p, std::size_t n) {
+		while (n && (reinterpret_cast<uintptr_t>(p) & 7)) {
+			crc = _mm_crc32_u8(crc, *p++);
+			--n;
+		}
+		uint64_t crc64 = crc;
+		if (n >= 3 * SHORT_BLOCK) {
+			const Tables& t = tables();
+			crc64 = interleave(crc64, p, n, LONG_BLOCK, t.long_shift);
+			crc64 = interleave(crc64, p, n, SHORT_BLOCK, t.short_shift);
+		}
+		while (n >= 8) {
+			uint64_t v;
+			std::memcpy(&v, p, 8);
+			crc64 = _mm_crc32_u64(crc64, v);
+			p += 8;
+			n -= 8;
+		}
+		crc = static_cast<uint32_t>(crc64);
+		while (n--) {
+			crc = _mm_crc32_u8(crc, *p++);
+		}
+		return crc;
+	}
+#endif
+
+	uint32_t crc_;
+};
+
+/*
+ * RFC 1071的Internet校验和（IP/TCP/UDP头部用的16位反码和）
+ * 按本机字节序一次累加8个字节，最后折叠成16位再换成网络字节序（反码和与字节序无关，只差一次交换）；
+ * 增量累加时记住前面是否是奇数个字节，奇数偏移开始的区域结果要交换一次高低字节
+ */
+class InternetChecksum : public BufferChecksum<InternetChecksum>
+{
+public:
+	InternetChecksum() : sum_(0), odd_(false) {}
+
+	/*一次算完，返回的值按网络字节序解释（高字节在前）*/
+	static uint16_t compute(const uint8_t* p, std::size_t n) {
+		InternetChecksum c;
+		c.update(p, n);
+		return c.value();
+	}
+
+	using BufferChecksum<InternetChecksum>::update;
+
+	void update(const uint8_t* p, std::size_t n) {
+		uint32_t part = fold(sum(p, n));
+		if (odd_) part = swap16(part);
+		sum_ += part;
+		odd_ = odd_ != ((n & 1) != 0);
+	}
+
+	void update(const struct iovec* iov, int count) {
+		for (int i = 0; i < count; ++i) update(static_cast<const uint8_t*>(iov[i].iov_base), iov[i].iov_len);
+	}
+
+	/*取反之后的校验和，数据连同正确的校验和一起计算时结果为0*/
+	uint16_t value() const {
+		return static_cast<uint16_t>(~fold(sum_) & 0xffff);
+	}
+
+	void reset() {
+		sum_ = 0;
+		odd_ = false;
+		covered_ = 0;
+	}
+
+private:
+	static uint32_t swap16(uint32_t v) {
+		return ((v >> 8) | (v << 8)) & 0xffff;
+	}
+
+	static uint32_t fold(uint64_t s) {
+		s = (s & 0xffffffff) + (s >> 32);
+		s = (s & 0xffffffff) + (s >> 32);
+		s = (s & 0xffff) + (s >> 16);
+		s = (s & 0xffff) + (s >> 16);
+		return static_cast<uint32_t>(s);
+	}
+
+	/*[p, p + n)当作从偶数偏移开始的16位字序列求和，结果已经是网络字节序*/
+	static uint64_t sum(const uint8_t* p, std::size_t n) {
+		uint64_t acc = 0;
+		while (n >= 8) {
+			uint64_t v;
+			std::memcpy(&v, p, 8);
+			acc += (v & 0xffffffff) + (v >> 32);
+			p += 8;
+			n -= 8;
+		}
+		while (n >= 2) {
+			uint16_t v;
+			std::memcpy(&v, p, 2);
+			acc += v;
+			p += 2;
+			n -= 2;
+		}
+		if (n) {
+			uint16_t v = 0;
+			std::memcpy(&v, p, 1); /*最后一个字节是网络序字的高字节*/
+			acc += v;
+		}
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+		return acc;
+#else
+		return swap16(fold(acc));
+#endif
+	}
+
+	uint64_t sum_;
+	bool odd_;
+};
+
+#endif
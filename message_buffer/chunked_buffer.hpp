@@ -0,0 +1,368 @@
+#ifndef __CHUNKED_BUFFER_HPP__
+#define __CHUNKED_BUFFER_HPP__
+
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <algorithm>
+#include <climits>
+#include <sys/uio.h>
+#include <sys/socket.h>
+#include <errno.h>
+
+/*
+ * 分块链表形式的字节缓冲区
+ * 数据保存在一串固定大小的块里，写满了就在尾部挂一个新块，读完的头部块放回空闲链表复用，
+ * 已经写入的数据永远不会被memmove或者随扩容整体拷贝，新分配的块也不会被清零
+ * 接口与MessageBuffer兼容，区别是可读数据不一定连续:
+ *   get_read_pointer()开始的get_read_size()个字节是连续的（头部块里的部分），get_active_size()是全部的可读字节数
+ *   get_write_pointer()开始的get_free_size()个字节是连续的（尾部块里的部分）
+ * recv/send直接用readv/writev对块链表做分散/聚集IO
+ */
+class ChunkedBuffer
+{
+public:
+	ChunkedBuffer() : ChunkedBuffer(4096) {}
+
+	explicit ChunkedBuffer(std::size_t chunk_size, std::size_t max_free_chunks = 4)
+		: head_(nullptr), tail_(nullptr), free_(nullptr),
+		chunk_size_(chunk_size ? chunk_size : 4096), free_count_(0), max_free_chunks_(max_free_chunks),
+		active_(0), capacity_(0)
+	{
+		append(chunk_size_);
+	}
+
+	~ChunkedBuffer() {
+		release_all();
+	}
+
+	ChunkedBuffer(const ChunkedBuffer&) = delete;
+	ChunkedBuffer& operator=(const ChunkedBuffer&) = delete;
+
+	ChunkedBuffer(ChunkedBuffer&& other) noexcept
+		: head_(other.head_), tail_(other.tail_), free_(other.free_),
+		chunk_size_(other.chunk_size_), free_count_(other.free_count_), max_free_chunks_(other.max_free_chunks_),
+		active_(other.active_), capacity_(other.capacity_)
+	{
+		other.reset();
+	}
+
+	ChunkedBuffer& operator=(ChunkedBuffer&& other) noexcept
+	{
+		if (this != &other) {
+			release_all();
+			head_ = other.head_;
+			tail_ = other.tail_;
+			free_ = other.free_;
+			chunk_size_ = other.chunk_size_;
+			free_count_ = other.free_count_;
+			max_free_chunks_ = other.max_free_chunks_;
+			active_ = other.active_;
+			capacity_ = other.capacity_;
+			other.reset();
+		}
+		return *this;
+	}
+
+	/*头部块的起始地址，只是为了和MessageBuffer兼容*/
+	uint8_t* get_base_pointer() {
+		return head_ ? head_->data() : nullptr;
+	}
+
+	/*从这里开始的get_read_size()个字节是连续的*/
+	uint8_t* get_read_pointer() {
+		return head_ ? head_->data() + head_->rpos : nullptr;
+	}
+
+	/*从这里开始的get_free_size()个字节是连续的*/
+	uint8_t* get_write_pointer() {
+		return tail_ ? tail_->data() + tail_->wpos : nullptr;
+	}
+
+	/*头部块里连续可读的字节数*/
+	std::size_t get_read_size() const {
+		return head_ ? head_->wpos - head_->rpos : 0;
+	}
+
+	/*读完的块立即回收，跨块也可以一次完成*/
+	void read_completed(std::size_t size) {
+		if (size > active_) return;
+		active_ -= size;
+		while (size) {
+			const std::size_t n = std::min(size, head_->wpos - head_->rpos);
+			head_->rpos += n;
+			size -= n;
+			if (head_->rpos == head_->wpos) {
+				pop_head();
+			}
+		}
+	}
+
+	void write_completed(std::size_t size) {
+		if (nullptr == tail_ || size > get_free_size()) return;
+		tail_->wpos += size;
+		active_ += size;
+	}
+
+	std::size_t get_active_size() const {
+		return active_;
+	}
+
+	std::size_t get_free_size() const {
+		return tail_ ? tail_->cap - tail_->wpos : 0;
+	}
+
+	/*链表中所有块的容量之和*/
+	std::size_t get_buffer_size() const {
+		return capacity_;
+	}
+
+	std::size_t get_chunk_count() const {
+		std::size_t n = 0;
+		for (const Chunk* c = head_; c; c = c->next) ++n;
+		return n;
+	}
+
+	/*只是为了和MessageBuffer兼容，数据从不搬移*/
+	void normalize() {}
+
+	/*保证get_write_pointer()之后有size个连续的空闲字节，不够时挂一个新块，已有数据原地不动*/
+	void ensure_free_space(std::size_t size) {
+		if (size == 0 || get_free_size() >= size) {
+			return;
+		}
+		if (tail_ && tail_->rpos == tail_->wpos) {
+			if (tail_->cap >= size) {
+				tail_->rpos = tail_->wpos = 0; /*尾部块已经读空，直接从头开始用*/
+				return;
+			}
+			if (head_ == tail_) {
+				/*唯一的块是空的但太小，换成大块，避免链表头部留下空块*/
+				Chunk* c = head_;
+				head_ = tail_ = nullptr;
+				capacity_ = 0;
+				recycle(c);
+			}
+		}
+		append(std::max(chunk_size_, size));
+	}
+
+	/*写入数据，尾部块写满后接着写到新块里，不要求整段连续*/
+	void write(const uint8_t* data, std::size_t size) {
+		if (NULL == data || 0 == size) return;
+		while (size) {
+			if (get_free_size() == 0) {
+				append(chunk_size_);
+			}
+			const std::size_t n = std::min(size, get_free_size());
+			std::memcpy(get_write_pointer(), data, n);
+			write_completed(n);
+			data += n;
+			size -= n;
+		}
+	}
+
+	/*把最多size个可读字节拷贝到dst，不消费，返回实际拷贝的字节数；用于解析跨块的头部*/
+	std::size_t peek(uint8_t* dst, std::size_t size) const {
+		std::size_t copied = 0;
+		for (const Chunk* c = head_; c && copied < size; c = c->next) {
+			const std::size_t n = std::min(size - copied, c->wpos - c->rpos);
+			std::memcpy(dst + copied, c->data() + c->rpos, n);
+			copied += n;
+		}
+		return copied;
+	}
+
+	/*把可读数据按块填进iov，最多max个，返回填入的个数；可以直接交给writev*/
+	int get_read_iov(struct iovec* iov, int max) {
+		int n = 0;
+		for (Chunk* c = head_; c && n < max; c = c->next) {
+			if (c->wpos == c->rpos) continue;
+			iov[n].iov_base = c->data() + c->rpos;
+			iov[n].iov_len = c->wpos - c->rpos;
+			++n;
+		}
+		return n;
+	}
+
+	/*
+	 * 尾部块的剩余空间和一个备用块一起交给readv，数据直接落在块里，不需要栈上的额外缓冲区再拷贝一次
+	 * 备用块没有用到时留在空闲链表里
+	 */
+	int recv(int fd, int* err) {
+		if (nullptr == err) return -1;
+		*err = 0;
+		Chunk* spare = take_chunk(chunk_size_);
+		struct iovec iov[2];
+		int cnt = 0;
+		if (get_free_size() > 0) {
+			iov[cnt].iov_base = get_write_pointer();
+			iov[cnt].iov_len = get_free_size();
+			++cnt;
+		}
+		iov[cnt].iov_base = spare->data();
+		iov[cnt].iov_len = spare->cap;
+		++cnt;
+		ssize_t n = readv(fd, iov, cnt);
+		if (n < 0) {
+			*err = errno;
+			recycle(spare);
+			return -1;
+		}
+		std::size_t rest = static_cast<std::size_t>(n);
+		const std::size_t first = std::min(rest, get_free_size());
+		write_completed(first);
+		rest -= first;
+		if (rest > 0) {
+			link(spare);
+			write_completed(rest);
+		}
+		else {
+			recycle(spare);
+		}
+		return n;
+	}
+
+	/*
+	 * 用sendmsg(MSG_NOSIGNAL)把块链表发出去，每次最多IOV_MAX个块，已发送的部分自动消费；不是socket时退回writev
+	 * 返回写出的字节数；fd写满时*err为EAGAIN，剩余数据留在缓冲区里；对端关闭时*err为EPIPE，不会收到SIGPIPE；其他错误返回-1
+	 */
+	int send(int fd, int* err) {
+		if (nullptr == err) return -1;
+		*err = 0;
+		struct iovec iov[IOV_MAX];
+		std::size_t sent = 0;
+		bool is_socket = true;
+		while (active_ > 0) {
+			const int cnt = get_read_iov(iov, IOV_MAX);
+			ssize_t n;
+			if (is_socket) {
+				struct msghdr msg;
+				std::memset(&msg, 0, sizeof(msg));
+				msg.msg_iov = iov;
+				msg.msg_iovlen = cnt;
+				n = sendmsg(fd, &msg, MSG_NOSIGNAL);
+			}
+			else {
+				n = writev(fd, iov, cnt);
+			}
+			if (n < 0) {
+				if (errno == EINTR) continue;
+				if (errno == ENOTSOCK && is_socket) {
+					is_socket = false;
+					continue;
+				}
+				*err = errno;
+				if (errno != EAGAIN && errno != EWOULDBLOCK) return -1;
+				break;
+			}
+			read_completed(n);
+			sent += n;
+		}
+		return static_cast<int>(sent);
+	}
+
+private:
+	/*块头和数据一次分配，数据紧跟在块头后面*/
+	struct Chunk
+	{
+		Chunk* next;
+		std::size_t cap;
+		std::size_t rpos;
+		std::size_t wpos;
+
+		uint8_t* data() {
+			return reinterpret_cast<uint8_t*>(this + 1);
+		}
+
+		const uint8_t* data() const {
+			return reinterpret_cast<const uint8_t*>(this + 1);
+		}
+	};
+
+	/*优先从空闲链表取标准大小的块，operator new不会清零*/
+	Chunk* take_chunk(std::size_t cap) {
+		Chunk* c;
+		if (cap == chunk_size_ && free_) {
+			c = free_;
+			free_ = c->next;
+			--free_count_;
+		}
+		else {
+			c = static_cast<Chunk*>(::operator new(sizeof(Chunk) + cap));
+			c->cap = cap;
+		}
+		c->next = nullptr;
+		c->rpos = c->wpos = 0;
+		return c;
+	}
+
+	/*标准大小的块留在空闲链表里复用，超过上限或者大小不标准的直接释放*/
+	void recycle(Chunk* c) {
+		if (c->cap == chunk_size_ && free_count_ < max_free_chunks_) {
+			c->next = free_;
+			free_ = c;
+			++free_count_;
+		}
+		else {
+			::operator delete(c);
+		}
+	}
+
+	void link(Chunk* c) {
+		if (tail_) {
+			tail_->next = c;
+		}
+		else {
+			head_ = c;
+		}
+		tail_ = c;
+		capacity_ += c->cap;
+	}
+
+	void append(std::size_t cap) {
+		link(take_chunk(cap));
+	}
+
+	/*头部块读完: 还有后续块就摘下来回收（连同没写过的空块），最后一个块保留下来从头开始写*/
+	void pop_head() {
+		while (head_ != tail_ && head_->rpos == head_->wpos) {
+			Chunk* c = head_;
+			head_ = c->next;
+			capacity_ -= c->cap;
+			recycle(c);
+		}
+		if (head_ == tail_ && head_->rpos == head_->wpos) {
+			head_->rpos = head_->wpos = 0;
+		}
+	}
+
+	void release_all() {
+		for (Chunk* list : { head_, free_ }) {
+			while (list) {
+				Chunk* next = list->next;
+				::operator delete(list);
+				list = next;
+			}
+		}
+		reset();
+	}
+
+	void reset() {
+		head_ = tail_ = free_ = nullptr;
+		free_count_ = 0;
+		active_ = 0;
+		capacity_ = 0;
+	}
+
+	Chunk* head_;
+	Chunk* tail_;
+	Chunk* free_;       /*回收的标准大小块*/
+	std::size_t chunk_size_;
+	std::size_t free_count_;
+	std::size_t max_free_chunks_;
+	std::size_t active_; /*所有块里可读字节的总数*/
+	std::size_t capacity_;
+};
+
+#endif
@@ -0,0 +1,289 @@
+#ifndef __DELIMITER_SCAN_HPP__
+#define __DELIMITER_SCAN_HPP__
+
+#include <cstdint>
+#include <cstddef>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define DELIMITER_SCAN_X86 1
+#endif
+
+/*
+ * 在连续内存里查找分隔符: 单个字节、两字节的分隔符（比如\r\n）、一小组字节中的任意一个
+ * x86上按cpuid在运行时选择AVX2或SSE2实现，AVX2函数用target属性单独编译，不需要全局打开-mavx2；其他平台用标量实现
+ * 返回第一个匹配的偏移，找不到返回NPOS
+ */
+class DelimiterScan
+{
+public:
+	enum Isa { SCALAR, SSE2, AVX2 };
+
+	static constexpr std::size_t NPOS = ~std::size_t(0);
+	static constexpr std::size_t MAX_SET = 16; /*find_any的字节集合最多这么多个*/
+
+	static std::size_t find_byte(const uint8_t* p, std::size_t n, uint8_t c) {
+		return impl().find_byte(p, n, c);
+	}
+
+	/*p[i] == c0 && p[i + 1] == c1的第一个i*/
+	static std::size_t find_pair(const uint8_t* p, std::size_t n, uint8_t c0, uint8_t c1) {
+		return impl().find_pair(p, n, c0, c1);
+	}
+
+	/*p[i]属于set[0, count)的第一个i，count超过MAX_SET时只用前MAX_SET个*/
+	static std::size_t find_any(const uint8_t* p, std::size_t n, const uint8_t* set, std::size_t count) {
+		return impl().find_any(p, n, set, count < MAX_SET ? count : std::size_t(MAX_SET));
+	}
+
+	static Isa isa() {
+		return impl().isa;
+	}
+
+	/*切换实现，CPU不支持时返回false；只用于测试和基准，不要和查找并发调用*/
+	static bool use_isa(Isa isa) {
+		if (!supported(isa)) return false;
+		impl() = make(isa);
+		return true;
+	}
+
+	static bool supported(Isa isa) {
+#ifdef DELIMITER_SCAN_X86
+		__builtin_cpu_init(); /*可能在静态初始化阶段第一次调用*/
+		if (isa == AVX2) return __builtin_cpu_supports("avx2");
+		if (isa == SSE2) return __builtin_cpu_supports("sse2");
+		return true;
+#else
+		return isa == SCALAR;
+#endif
+	}
+
+private:
+	struct Impl
+	{
+		Isa isa;
+		std::size_t(*find_byte)(const uint8_t*, std::size_t, uint8_t);
+		std::size_t(*find_pair)(const uint8_t*, std::size_t, uint8_t, uint8_t);
+		std::size_t(*find_any)(const uint8_t*, std::size_t, const uint8_t*, std::size_t);
+	};
+
+	static Impl& impl() {
+		static Impl current = make(supported(AVX2) ? AVX2 : supported(SSE2) ? SSE2 : SCALAR);
+		return current;
+	}
+
+	static Impl make(Isa isa) {
+#ifdef DELIMITER_SCAN_X86
+		if (isa == AVX2) return Impl{ AVX2, avx2_find_byte, avx2_find_pair, avx2_find_any };
+		if (isa == SSE2) return Impl{ SSE2, sse2_find_byte, sse2_find_pair, sse2_find_any };
+#endif
+		(void)isa;
+		return Impl{ SCALAR, scalar_find_byte, scalar_find_pair, scalar_find_any };
+	}
+
+	static std::size_t scalar_find_byte(const uint8_t* p, std::size_t n, uint8_t c) {
+		for (std::size_t i = 0; i < n; ++i) {
+			if (p[i] == c) return i;
+		}
+		return NPOS;
+	}
+
+	static std::size_t scalar_find_pair(const uint8_t* p, std::size_t n, uint8_t c0, uint8_t c1) {
+		for (std::size_t i = 0; i + 1 < n; ++i) {
+			if (p[i] == c0 && p[i + 1] == c1) return i;
+		}
+		return NPOS;
+	}
+
+	static std::size_t scalar_find_any(const uint8_t* p, std::size_t n, const uint8_t* set, std::size_t count) {
+		bool table[256] = { false };
+		for (std::size_t k = 0; k < count; ++k) table[set[k]] = true;
+		for (std::size_t i = 0; i < n; ++i) {
+			if (table[p[i]]) return i;
+		}
+		return NPOS;
+	}
+
+#ifdef DELIMITER_SCAN_X86
+	/*标量处理不足一个向量的尾部，结果加上起始偏移*/
+	static std::size_t tail(std::size_t base, std::size_t found) {
+		return found == NPOS ? NPOS : base + found;
+	}
+
+	__attribute__((target("sse2")))
+	static std::size_t sse2_find_byte(const uint8_t* p, std::size_t n, uint8_t c) {
+		const __m128i needle = _mm_set1_epi8(static_cast<char>(c));
+		std::size_t i = 0;
+		for (; i + 16 <= n; i += 16) {
+			const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+			const unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, needle)));
+			if (mask) return i + __builtin_ctz(mask);
+		}
+		return tail(i, scalar_find_byte(p + i, n - i, c));
+	}
+
+	/*
+	 * 向量只找第一个字节，候选位置再逐个确认下一个字节；
+	 * 文本协议里\r几乎总是跟着\n，所以和memchr差不多快，也不需要错开一个字节再加载一次
+	 */
+	__attribute__((target("sse2")))
+	static std::size_t sse2_find_pair(const uint8_t* p, std::size_t n, uint8_t c0, uint8_t c1) {
+		const __m128i first = _mm_set1_epi8(static_cast<char>(c0));
+		std::size_t i = 0;
+		for (; i + 33 <= n; i += 32) {
+			const __m128i lo = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i)), first);
+			const __m128i hi = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i + 16)), first);
+			unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(lo)) | (static_cast<unsigned>(_mm_movemask_epi8(hi)) << 16);
+			while (mask) {
+				const std::size_t at = i + __builtin_ctz(mask);
+				if (p[at + 1] == c1) return at; /*at + 1 <= i + 32 < n*/
+				mask &= mask - 1;
+			}
+		}
+		return tail(i, scalar_find_pair(p + i, n - i, c0, c1));
+	}
+
+	__attribute__((target("sse2")))
+	static std::size_t sse2_find_any(const uint8_t* p, std::size_t n, const uint8_t* set, std::size_t count) {
+		__m128i needles[MAX_SET];
+		for (std::size_t k = 0; k < count; ++k) needles[k] = _mm_set1_epi8(static_cast<char>(set[k]));
+		std::size_t i = 0;
+		for (; i + 16 <= n; i += 16) {
+			const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+			__m128i hit = _mm_setzero_si128();
+			for (std::size_t k = 0; k < count; ++k) hit = _mm_or_si128(hit, _mm_cmpeq_epi8(v, needles[k]));
+			const unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(hit));
+			if (mask) return i + __builtin_ctz(mask);
+		}
+		return tail(i, scalar_find_any(p + i, n - i, set, count));
+	}
+
+	__attribute__((target("avx2")))
+	static std::size_t avx2_find_byte(const uint8_t* p, std::size_t n, uint8_t c) {
+		const __m256i needle = _mm256_set1_epi8(static_cast<char>(c));
+		std::size_t i = 0;
+		for (; i + 32 <= n; i += 32) {
+			const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i));
+			const unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, needle)));
+			if (mask) return i + __builtin_ctz(mask);
+		}
+		return tail(i, sse2_find_byte(p + i, n - i, c));
+	}
+
+	/*和SSE2版本一样先找第一个字节，每64字节只判断一次分支*/
+	__attribute__((target("avx2")))
+	static std::size_t avx2_find_pair(const uint8_t* p, std::size_t n, uint8_t c0, uint8_t c1) {
+		const __m256i first = _mm256_set1_epi8(static_cast<char>(c0));
+		std::size_t i = 0;
+		for (; i + 65 <= n; i += 64) {
+			const __m256i lo = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i)), first);
+			const __m256i hi = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i + 32)), first);
+			const __m256i any = _mm256_or_si256(lo, hi);
+			if (_mm256_testz_si256(any, any)) continue;
+			uint64_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(lo))
+				| (static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(hi))) << 32);
+			while (mask) {
+				const std::size_t at = i + __builtin_ctzll(mask);
+				if (p[at + 1] == c1) return at; /*at + 1 <= i + 64 < n*/
+				mask &= mask - 1;
+			}
+		}
+		return tail(i, sse2_find_pair(p + i, n - i, c0, c1));
+	}
+
+	__attribute__((target("avx2")))
+	static std::size_t avx2_find_any(const uint8_t* p, std::size_t n, const uint8_t* set, std::size_t count) {
+		__m256i needles[MAX_SET];
+		for (std::size_t k = 0; k < count; ++k) needles[k] = _mm256_set1_epi8(static_cast<char>(set[k]));
+		std::size_t i = 0;
+		for (; i + 32 <= n; i += 32) {
+			const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i));
+			__m256i hit = _mm256_setzero_si256();
+			for (std::size_t k = 0; k < count; ++k) hit = _mm256_or_si256(hit, _mm256_cmpeq_epi8(v, needles[k]));
+			const unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(hit));
+			if (mask) return i + __builtin_ctz(mask);
+		}
+		return tail(i, sse2_find_any(p + i, n - i, set, count));
+	}
+#endif
+};
+
+/*
+ * 在缓冲区的可读数据里逐条查找分隔符，记住已经扫描过的位置
+ * 一行只到了一半时，下次数据到达只扫描新增的部分，不从读位置重新开始；
+ * 位置相对读指针保存，normalize和扩容不影响；找到之后回到0，调用者消费这一行（连同分隔符）再找下一行
+ * 没找到分隔符就消费了数据（比如RESP的bulk负载）时要调用reset
+ */
+class DelimiterScanner
+{
+public:
+	/*两字节分隔符，默认\r\n*/
+	explicit DelimiterScanner(uint8_t c0 = '\r', uint8_t c1 = '\n') : kind_(PAIR), count_(2), scanned_(0) {
+		set_[0] = c0;
+		set_[1] = c1;
+	}
+
+	/*单个字节*/
+	static DelimiterScanner byte(uint8_t c) {
+		DelimiterScanner s;
+		s.kind_ = BYTE;
+		s.count_ = 1;
+		s.set_[0] = c;
+		return s;
+	}
+
+	/*字节集合中的任意一个*/
+	static DelimiterScanner any(const uint8_t* set, std::size_t count) {
+		DelimiterScanner s;
+		s.kind_ = ANY;
+		s.count_ = count < DelimiterScan::MAX_SET ? count : std::size_t(DelimiterScan::MAX_SET);
+		for (std::size_t k = 0; k < s.count_; ++k) s.set_[k] = set[k];
+		return s;
+	}
+
+	/*返回分隔符相对读指针的偏移，没找到返回NPOS*/
+	template<typename Buffer>
+	std::size_t next(Buffer& buf) {
+		const uint8_t* p = buf.get_read_pointer();
+		const std::size_t n = buf.get_active_size();
+		if (scanned_ >= n) return DelimiterScan::NPOS;
+		std::size_t found;
+		switch (kind_) {
+		case BYTE: found = DelimiterScan::find_byte(p + scanned_, n - scanned_, set_[0]); break;
+		case PAIR: found = DelimiterScan::find_pair(p + scanned_, n - scanned_, set_[0], set_[1]); break;
+		default: found = DelimiterScan::find_any(p + scanned_, n - scanned_, set_, count_); break;
+		}
+		if (found == DelimiterScan::NPOS) {
+			/*两字节分隔符的前一半可能在末尾，留着下次和新数据一起比较*/
+			scanned_ = kind_ == PAIR ? n - 1 : n;
+			return DelimiterScan::NPOS;
+		}
+		found += scanned_;
+		scanned_ = 0;
+		return found;
+	}
+
+	/*分隔符的字节数，消费一行时加上*/
+	std::size_t delimiter_size() const {
+		return kind_ == PAIR ? 2 : 1;
+	}
+
+	void reset() {
+		scanned_ = 0;
+	}
+
+	/*已经确认没有分隔符的字节数*/
+	std::size_t scanned() const {
+		return scanned_;
+	}
+
+private:
+	enum Kind { BYTE, PAIR, ANY };
+
+	Kind kind_;
+	std::size_t count_;
+	uint8_t set_[DelimiterScan::MAX_SET];
+	std::size_t scanned_;
+};
+
+#endif
@@ -0,0 +1,444 @@
+#ifndef __FORWARDER_HPP__
+#define __FORWARDER_HPP__
+
+#include <cstdint>
+#include <cstring>
+#include <climits>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <vector>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <netinet/in.h>
+#include "message_buffer.hpp"
+#include "buffer_slice.hpp"
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/errqueue.h>)
+#include <linux/errqueue.h>
+#if defined(MSG_ZEROCOPY) && defined(SO_ZEROCOPY) && defined(SO_EE_ORIGIN_ZEROCOPY) && defined(SO_EE_CODE_ZEROCOPY_COPIED)
+#define FORWARDER_HAVE_ZEROCOPY 1
+#endif
+#endif
+#endif
+
+/*Forwarder的计数器，bytes_spliced + bytes_zerocopy是没有经过用户态拷贝转发的字节*/
+struct ForwardCounters
+{
+	uint64_t syscalls = 0;              /*splice/recv/send/recvmsg(MSG_ERRQUEUE)等所有系统调用*/
+	uint64_t bytes_spliced = 0;         /*经过pipe splice到dst、没有进用户态的字节*/
+	uint64_t bytes_zerocopy = 0;        /*MSG_ZEROCOPY发送、内核确认没有拷贝的字节*/
+	uint64_t bytes_zerocopy_copied = 0; /*MSG_ZEROCOPY发送、但内核退回了拷贝的字节（比如回环）*/
+	uint64_t bytes_copied = 0;          /*走普通recv/send拷贝路径发出的字节*/
+};
+
+struct ForwardOptions
+{
+	std::size_t pipe_size = 0;                 /*用F_SETPIPE_SZ调整中转pipe的大小，0表示用默认的64KB*/
+	bool zerocopy = true;                      /*在dst上尝试打开SO_ZEROCOPY*/
+	std::size_t zerocopy_threshold = 16 << 10; /*可读数据不少于这么多才用MSG_ZEROCOPY，小包的通知开销比拷贝大*/
+	int drain_timeout_ms = 100;                /*析构时最多等待零拷贝完成通知的时间*/
+	int orphan_timeout_ms = 120000;            /*析构之后还没确认的发送最多再保留这么久*/
+};
+
+/*
+ * 把src上收到的字节转发到dst，一个方向一个Forwarder，fd由调用者管理
+ * forward: 不需要看内容时，src -> pipe -> dst两次splice，数据只在内核里挪页；
+ *   fd不支持splice（EINVAL）时自动退回到内部MessageBuffer的recv/flush拷贝路径
+ * send: 需要先收进MessageBuffer检查或修改的数据，数据量大时用MSG_ZEROCOPY发送，
+ *   发出的部分做成BufferSlice留到内核确认完成；期间调用者照常使用MessageBuffer，要覆盖这段数据时它会换新块
+ *   完成通知在dst的错误队列里（epoll报告EPOLLERR），调用reap释放；send每次也会先reap一次
+ *   内核报告退回了拷贝（回环、网卡不支持等）之后不再用MSG_ZEROCOPY，省掉通知的开销
+ * 析构时pipe里还没写到dst的数据丢弃；还有未确认的零拷贝发送时最多等drain_timeout_ms，
+ *   剩下的连同dup出来的dst交给进程级的孤儿列表，读到通知时释放（见reap_orphans），超过orphan_timeout_ms直接释放；
+ *   dup让连接在调用者close之后还保持到那时为止；dst在析构之前已经被关闭时读不到通知，只能等超时
+ * 只能在一个线程里使用
+ */
+class Forwarder
+{
+public:
+	static constexpr std::size_t DEFAULT_QUOTA = 1 << 20; /*forward一次最多转发的字节数，避免一个连接占住事件循环*/
+
+	Forwarder(int src, int dst, const ForwardOptions& options = ForwardOptions())
+		: src_(src), dst_(dst), pipe_bytes_(0), pipe_capacity_(0), splice_(false), zerocopy_(false), next_seq_(0), options_(options)
+	{
+		pipe_[0] = pipe_[1] = -1;
+		if (pipe2(pipe_, O_NONBLOCK | O_CLOEXEC) == 0) {
+			if (options_.pipe_size) {
+				fcntl(pipe_[1], F_SETPIPE_SZ, static_cast<int>(std::min<std::size_t>(options_.pipe_size, INT_MAX)));
+			}
+			const int size = fcntl(pipe_[1], F_GETPIPE_SZ);
+			pipe_capacity_ = size > 0 ? static_cast<std::size_t>(size) : 65536;
+			splice_ = true;
+		}
+		struct stat st;
+		if (fstat(dst_, &st) == 0) {
+			dst_dev_ = st.st_dev;
+			dst_ino_ = st.st_ino;
+		}
+		reap_orphans();
+#ifdef FORWARDER_HAVE_ZEROCOPY
+		if (options_.zerocopy) {
+			const int one = 1;
+			zerocopy_ = setsockopt(dst_, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one)) == 0;
+		}
+#endif
+	}
+
+	~Forwarder() {
+		if (!drain(options_.drain_timeout_ms)) {
+			orphan();
+		}
+		reap_orphans();
+		if (pipe_[0] >= 0) close(pipe_[0]);
+		if (pipe_[1] >= 0) close(pipe_[1]);
+	}
+
+	Forwarder(const Forwarder&) = delete;
+	Forwarder& operator=(const Forwarder&) = delete;
+
+	/*
+	 * 从src转发最多max字节到dst，先把上次没写出去的数据写完
+	 * 返回写到dst的字节数；src读完（对端关闭）且没有积压时返回0；什么都没转发时返回-1，*err给出原因，
+	 * EAGAIN表示src没有数据或者dst写满，pending() > 0时等dst可写，否则等src可读
+	 * 转发了一部分之后遇到的EAGAIN或错误同样放在*err里，返回值是已经转发的字节数
+	 */
+	int forward(int* err, std::size_t max = DEFAULT_QUOTA) {
+		if (nullptr == err) return -1;
+		*err = 0;
+		max = std::min<std::size_t>(max, INT_MAX);
+		if (!splice_) return copy_forward(err, max);
+		std::size_t moved = 0;
+		for (;;) {
+			if (pipe_bytes_ > 0) {
+				++counters_.syscalls;
+				const ssize_t n = splice(pipe_[0], nullptr, dst_, nullptr, pipe_bytes_, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+				if (n < 0) {
+					if (errno == EINTR) continue;
+					if (errno == EINVAL) {
+						disable_splice();
+						return moved > 0 ? static_cast<int>(moved) : copy_forward(err, max);
+					}
+					*err = errno;
+					return moved > 0 ? static_cast<int>(moved) : -1;
+				}
+				pipe_bytes_ -= n;
+				moved += n;
+				counters_.bytes_spliced += n;
+				continue;
+			}
+			if (moved >= max) return static_cast<int>(moved);
+			++counters_.syscalls;
+			const ssize_t n = splice(src_, nullptr, pipe_[1], nullptr, std::min(max - moved, pipe_capacity_), SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+			if (n == 0) return static_cast<int>(moved);
+			if (n < 0) {
+				if (errno == EINTR) continue;
+				if (errno == EINVAL) {
+					disable_splice();
+					return moved > 0 ? static_cast<int>(moved) : copy_forward(err, max);
+				}
+				*err = errno;
+				return moved > 0 ? static_cast<int>(moved) : -1;
+			}
+			pipe_bytes_ += n;
+		}
+	}
+
+	/*
+	 * 把buf里的可读数据发到dst，返回值与MessageBuffer::flush相同
+	 * 数据不少于zerocopy_threshold且dst支持时用MSG_ZEROCOPY，否则就是buf.flush
+	 */
+	int send(MessageBuffer& buf, int* err) {
+		if (nullptr == err) return -1;
+		*err = 0;
+		if (!pending_.empty()) reap();
+		reap_orphans();
+#ifdef FORWARDER_HAVE_ZEROCOPY
+		if (zerocopy_ && buf.get_active_size() >= options_.zerocopy_threshold) {
+			std::size_t sent = 0;
+			while (buf.get_active_size() > 0) {
+				++counters_.syscalls;
+				const ssize_t n = ::send(dst_, buf.get_read_pointer(), buf.get_active_size(), MSG_ZEROCOPY);
+				if (n < 0) {
+					if (errno == EINTR) continue;
+					if (errno == ENOBUFS) break; /*超过了optmem_max能挂的通知，剩下的走普通发送*/
+					*err = errno;
+					if (errno != EAGAIN && errno != EWOULDBLOCK) return -1;
+					return static_cast<int>(sent);
+				}
+				Pending p;
+				p.seq = next_seq_++;
+				p.data = buf.take(static_cast<std::size_t>(n));
+				p.done = false;
+				pending_.push_back(std::move(p));
+				sent += n;
+			}
+			if (buf.get_active_size() == 0) return static_cast<int>(sent);
+			const int n = copy_send(buf, err);
+			return n < 0 ? -1 : static_cast<int>(sent) + n;
+		}
+#endif
+		return copy_send(buf, err);
+	}
+
+	/*读dst的错误队列，释放内核已经发完的零拷贝数据，返回确认完成的发送次数*/
+	int reap() {
+		bool copied = false;
+		const int completed = reap_queue(dst_, pending_, counters_, copied);
+		if (copied) zerocopy_ = false;
+		return completed;
+	}
+
+	/*
+	 * 最多等timeout_ms（-1表示一直等）让所有零拷贝发送确认完成，对端不读、窗口满时通知不会来
+	 * 返回zerocopy_pending()是否已经为0；超时或者dst已经被关闭时返回false
+	 */
+	bool drain(int timeout_ms) {
+		if (!pending_.empty()) reap();
+#ifdef FORWARDER_HAVE_ZEROCOPY
+		if (pending_.empty() || !same_dst()) return pending_.empty();
+		const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms < 0 ? 0 : timeout_ms);
+		while (!pending_.empty()) {
+			int wait = -1;
+			if (timeout_ms >= 0) {
+				const auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+				if (left <= 0) return false;
+				wait = static_cast<int>(left);
+			}
+			struct pollfd pfd;
+			pfd.fd = dst_;
+			pfd.events = 0; /*错误队列非空时报告POLLERR*/
+			pfd.revents = 0;
+			++counters_.syscalls;
+			const int r = ::poll(&pfd, 1, wait);
+			if (r < 0 && errno == EINTR) continue;
+			if (r < 0 || (pfd.revents & POLLNVAL)) return false;
+			if (r > 0 && reap() == 0) {
+				/*POLLERR/POLLHUP也可能是连接本身的错误，通知还没到，别空转*/
+				::poll(nullptr, 0, 1);
+			}
+		}
+#else
+		(void)timeout_ms;
+#endif
+		return pending_.empty();
+	}
+
+	/*
+	 * 处理析构时交出来的未确认发送: 读各自dst的错误队列，确认完或者超时的释放，返回还在等待的发送次数
+	 * Forwarder构造、析构和send时会顺便调用；不再创建Forwarder时事件循环可以定期调用
+	 * 超时之后认为连接已经没救，即使内核还引用着这些页也把块还回去
+	 */
+	static std::size_t reap_orphans() {
+		OrphanList& orphans = orphan_list();
+		if (orphans.sends.load(std::memory_order_relaxed) == 0) return 0;
+		std::lock_guard<std::mutex> guard(orphans.lock);
+		const auto now = std::chrono::steady_clock::now();
+		std::size_t sends = 0;
+		for (std::size_t i = 0; i < orphans.list.size();) {
+			Orphan& o = orphans.list[i];
+			if (o.fd >= 0) {
+				ForwardCounters counters;
+				bool copied = false;
+				reap_queue(o.fd, o.pending, counters, copied);
+			}
+			if (o.pending.empty() || now >= o.deadline) {
+				if (o.fd >= 0) close(o.fd);
+				if (i + 1 != orphans.list.size()) o = std::move(orphans.list.back());
+				orphans.list.pop_back();
+				continue;
+			}
+			sends += o.pending.size();
+			++i;
+		}
+		orphans.sends.store(sends, std::memory_order_relaxed);
+		return sends;
+	}
+
+	/*pipe或者中转缓冲区里还没写到dst的字节数*/
+	std::size_t pending() const {
+		return pipe_bytes_ + copy_.get_active_size();
+	}
+
+	/*还没确认完成的零拷贝发送次数，为0之后析构不用等待，也可以放心关闭dst*/
+	std::size_t zerocopy_pending() const {
+		return pending_.size();
+	}
+
+	/*forward是否还在用splice*/
+	bool splicing() const {
+		return splice_;
+	}
+
+	/*send是否还会用MSG_ZEROCOPY*/
+	bool zerocopy() const {
+		return zerocopy_;
+	}
+
+	const ForwardCounters& get_counters() const {
+		return counters_;
+	}
+
+private:
+	/*一次MSG_ZEROCOPY发送，seq是内核按发送次数分配的通知编号*/
+	struct Pending
+	{
+		uint32_t seq;
+		BufferSlice data;
+		bool done;
+	};
+
+	/*析构时还没确认的发送，fd是dup出来的dst，-1表示dst已经被调用者关闭*/
+	struct Orphan
+	{
+		int fd;
+		std::deque<Pending> pending;
+		std::chrono::steady_clock::time_point deadline;
+	};
+
+	struct OrphanList
+	{
+		std::mutex lock;
+		std::vector<Orphan> list;
+		std::atomic<std::size_t> sends{ 0 }; /*列表里的发送次数，为0时不用加锁*/
+	};
+
+	/*进程级的孤儿列表，故意不析构，避免退出时和BufferPool的析构顺序纠缠*/
+	static OrphanList& orphan_list() {
+		static OrphanList* orphans = new OrphanList();
+		return *orphans;
+	}
+
+	/*dst还是构造时的那个socket；调用者提前关闭之后fd号可能已经给了别的文件*/
+	bool same_dst() const {
+		struct stat st;
+		return dst_ino_ != 0 && fstat(dst_, &st) == 0 && st.st_dev == dst_dev_ && st.st_ino == dst_ino_;
+	}
+
+	void orphan() {
+		Orphan o;
+		o.fd = same_dst() ? fcntl(dst_, F_DUPFD_CLOEXEC, 0) : -1;
+		o.pending.swap(pending_);
+		o.deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(options_.orphan_timeout_ms);
+		OrphanList& orphans = orphan_list();
+		std::lock_guard<std::mutex> guard(orphans.lock);
+		orphans.sends.fetch_add(o.pending.size(), std::memory_order_relaxed);
+		orphans.list.push_back(std::move(o));
+	}
+
+	/*读fd的错误队列，把通知覆盖的发送标记完成，从队头释放；内核退回了拷贝时copied置为true*/
+	static int reap_queue(int fd, std::deque<Pending>& pending, ForwardCounters& counters, bool& copied) {
+		int completed = 0;
+#ifdef FORWARDER_HAVE_ZEROCOPY
+		while (!pending.empty()) {
+			char control[CMSG_SPACE(sizeof(struct sock_extended_err) + sizeof(struct sockaddr_in6))];
+			struct msghdr msg;
+			std::memset(&msg, 0, sizeof(msg));
+			msg.msg_control = control;
+			msg.msg_controllen = sizeof(control);
+			++counters.syscalls;
+			if (recvmsg(fd, &msg, MSG_ERRQUEUE) < 0) {
+				if (errno == EINTR) continue;
+				break;
+			}
+			for (struct cmsghdr* cm = CMSG_FIRSTHDR(&msg); cm != nullptr; cm = CMSG_NXTHDR(&msg, cm)) {
+				if (!(cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR)
+					&& !(cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR)) {
+					continue;
+				}
+				struct sock_extended_err serr;
+				std::memcpy(&serr, CMSG_DATA(cm), sizeof(serr));
+				if (serr.ee_errno != 0 || serr.ee_origin != SO_EE_ORIGIN_ZEROCOPY) continue;
+				const bool kernel_copied = (serr.ee_code & SO_EE_CODE_ZEROCOPY_COPIED) != 0;
+				completed += complete(pending, counters, serr.ee_info, serr.ee_data, kernel_copied);
+				copied = copied || kernel_copied;
+			}
+		}
+#else
+		(void)fd; (void)pending; (void)counters; (void)copied;
+#endif
+		return completed;
+	}
+
+	int copy_send(MessageBuffer& buf, int* err) {
+		const uint64_t syscalls = buf.get_counters().syscalls;
+		const int n = buf.flush(dst_, err);
+		counters_.syscalls += buf.get_counters().syscalls - syscalls;
+		if (n > 0) counters_.bytes_copied += n;
+		return n;
+	}
+
+	/*不能splice时的拷贝路径: 先把积压的数据写完，再recv一次flush一次，直到写满、读空或者达到max*/
+	int copy_forward(int* err, std::size_t max) {
+		const uint64_t syscalls = copy_.get_counters().syscalls;
+		std::size_t moved = 0;
+		for (;;) {
+			if (copy_.get_active_size() > 0) {
+				const int n = copy_.flush(dst_, err);
+				if (n > 0) {
+					moved += n;
+					counters_.bytes_copied += n;
+				}
+				if (n < 0 || copy_.get_active_size() > 0) break;
+			}
+			if (moved >= max) break;
+			if (copy_.recv(src_, err) <= 0) break;
+		}
+		counters_.syscalls += copy_.get_counters().syscalls - syscalls;
+		if (moved > 0) return static_cast<int>(moved);
+		return *err ? -1 : 0;
+	}
+
+	/*fd不支持splice，pipe里已经有的数据搬进中转缓冲区，之后走拷贝路径*/
+	void disable_splice() {
+		splice_ = false;
+		while (pipe_bytes_ > 0) {
+			copy_.ensure_free_space(pipe_bytes_);
+			++counters_.syscalls;
+			const ssize_t n = ::read(pipe_[0], copy_.get_write_pointer(), pipe_bytes_);
+			if (n <= 0) break;
+			copy_.write_completed(n);
+			pipe_bytes_ -= n;
+		}
+	}
+
+	/*通知编号[lo, hi]的发送完成了；通知可能合并也可能乱序，从队头开始释放已经完成的*/
+	static int complete(std::deque<Pending>& pending, ForwardCounters& counters, uint32_t lo, uint32_t hi, bool copied) {
+		int completed = 0;
+		for (Pending& p : pending) {
+			if (!p.done && p.seq - lo <= hi - lo) {
+				p.done = true;
+				(copied ? counters.bytes_zerocopy_copied : counters.bytes_zerocopy) += p.data.size();
+				++completed;
+			}
+		}
+		while (!pending.empty() && pending.front().done) {
+			pending.pop_front();
+		}
+		return completed;
+	}
+
+	int src_;
+	int dst_;
+	dev_t dst_dev_ = 0;
+	ino_t dst_ino_ = 0;         /*构造时dst的身份，用来发现fd被关闭后复用*/
+	int pipe_[2];
+	std::size_t pipe_bytes_;    /*已经splice进pipe、还没写到dst的字节数*/
+	std::size_t pipe_capacity_;
+	bool splice_;
+	bool zerocopy_;
+	uint32_t next_seq_;
+	ForwardOptions options_;
+	MessageBuffer copy_;        /*拷贝路径的中转缓冲区*/
+	std::deque<Pending> pending_;
+	ForwardCounters counters_;
+};
+
+#endif
@@ -0,0 +1,222 @@
+#ifndef __FRAME_CODEC_HPP__
+#define __FRAME_CODEC_HPP__
+
+#include <cstdint>
+#include <cstddef>
+#include <stdexcept>
+
+/*解出的一帧: 指向缓冲区内部的负载，不持有内存*/
+struct FrameView
+{
+	const uint8_t* data;
+	std::size_t size;
+};
+
+/*
+ * 长度前缀分帧的编解码
+ * 前缀是定长（1/2/4/8字节，大端或小端）或者varint（LEB128，最多10字节）的负载长度，不包括前缀本身
+ * decode一次扫描缓冲区里所有完整的帧，返回指向缓冲区内部的FrameView并消费掉，不分配、不拷贝；
+ * FrameView在下一次写入缓冲区（write/recv/ensure_free_space/normalize）之前有效
+ * 末尾不完整的帧留在缓冲区里，处理完这一批帧之后调用reserve: 只有尾部剩余空间装不下这一帧时才搬移（或扩容），
+ * 平时不做任何memmove
+ * 适用于可读数据连续的缓冲区（MessageBuffer、MirrorBuffer）
+ */
+class FrameCodec
+{
+public:
+	enum Error { OK = 0, TOO_LARGE, BAD_VARINT };
+
+	static constexpr unsigned VARINT = 0;
+	static constexpr std::size_t MAX_VARINT_BYTES = 10;
+
+	/*
+	 * width为1/2/4/8表示定长前缀，为VARINT表示varint前缀，其他值抛std::invalid_argument，
+	 * 不能悄悄当成varint按错误的格式解析；负载超过max_frame_size时报错
+	 */
+	explicit FrameCodec(unsigned width = 4, bool big_endian = true, std::size_t max_frame_size = 16 << 20)
+		: width_(width), big_endian_(big_endian), max_frame_size_(max_frame_size), missing_(0), error_(OK)
+	{
+		if (width_ != VARINT && width_ != 1 && width_ != 2 && width_ != 4 && width_ != 8) {
+			throw std::invalid_argument("FrameCodec: prefix width must be 1, 2, 4, 8 or VARINT");
+		}
+	}
+
+	/*
+	 * 从缓冲区里解出最多max个完整的帧放进frames，返回帧数；出错时返回-1，error()给出原因，
+	 * 出错之前解出的帧已经消费、不再返回，连接应该关闭
+	 */
+	template<typename Buffer>
+	int decode(Buffer& buf, FrameView* frames, int max) {
+		/*前缀格式在这里分派一次，逐帧循环里的解析全是编译期常量*/
+		switch (width_) {
+		case 1: return decode_with<Fixed<1, true>>(buf, frames, max);
+		case 2: return big_endian_ ? decode_with<Fixed<2, true>>(buf, frames, max) : decode_with<Fixed<2, false>>(buf, frames, max);
+		case 4: return big_endian_ ? decode_with<Fixed<4, true>>(buf, frames, max) : decode_with<Fixed<4, false>>(buf, frames, max);
+		case 8: return big_endian_ ? decode_with<Fixed<8, true>>(buf, frames, max) : decode_with<Fixed<8, false>>(buf, frames, max);
+		default: return decode_with<Varint>(buf, frames, max);
+		}
+	}
+
+	/*
+	 * 逐帧回调on_frame(const uint8_t* data, std::size_t size)，处理完所有完整的帧之后自动reserve
+	 * 返回处理的帧数，出错返回-1
+	 */
+	template<typename Buffer, typename F>
+	int for_each(Buffer& buf, F&& on_frame) {
+		FrameView frames[64];
+		int total = 0;
+		for (;;) {
+			const int n = decode(buf, frames, 64);
+			if (n < 0) return -1;
+			for (int i = 0; i < n; ++i) on_frame(frames[i].data, frames[i].size);
+			total += n;
+			if (n < 64) break;
+		}
+		reserve(buf);
+		return total;
+	}
+
+	/*
+	 * 在下一次recv之前调用，此后之前返回的FrameView失效
+	 * 缓冲区读空时只是回到开头；不完整的帧在尾部装不下时才搬移（或扩容）到能放下整帧
+	 */
+	template<typename Buffer>
+	void reserve(Buffer& buf) {
+		if (buf.get_active_size() == 0) {
+			buf.normalize();
+			return;
+		}
+		if (missing_ > buf.get_free_size()) {
+			buf.ensure_free_space(missing_);
+		}
+	}
+
+	/*最近一次decode之后，末尾不完整的帧还差多少字节（前缀不完整时是下限）*/
+	std::size_t missing() const {
+		return missing_;
+	}
+
+	Error error() const {
+		return error_;
+	}
+
+	/*写入一帧: 前缀和负载追加到缓冲区，负载超过上限或者定长前缀放不下时返回false*/
+	template<typename Buffer>
+	bool encode(Buffer& buf, const uint8_t* data, std::size_t size) const {
+		if (size > max_frame_size_) return false;
+		if (width_ != VARINT && width_ < 8 && (static_cast<uint64_t>(size) >> (8 * width_)) != 0) return false;
+		uint8_t header[MAX_VARINT_BYTES];
+		buf.write(header, write_header(header, size));
+		buf.write(data, size);
+		return true;
+	}
+
+	/*把长度前缀写到out，返回前缀的字节数；out至少要有MAX_VARINT_BYTES个字节*/
+	std::size_t write_header(uint8_t* out, uint64_t len) const {
+		if (width_ == VARINT) {
+			std::size_t i = 0;
+			while (len >= 0x80) {
+				out[i++] = static_cast<uint8_t>(len | 0x80);
+				len >>= 7;
+			}
+			out[i++] = static_cast<uint8_t>(len);
+			return i;
+		}
+		for (unsigned i = 0; i < width_; ++i) {
+			const unsigned shift = 8 * (big_endian_ ? width_ - 1 - i : i);
+			out[i] = static_cast<uint8_t>(len >> shift);
+		}
+		return width_;
+	}
+
+private:
+	/*
+	 * 前缀解析器: parse返回前缀的字节数，数据不够返回0；
+	 * 格式错误时返回0并设置err，shortfall是前缀不完整时至少还差的字节数
+	 */
+	template<unsigned Width, bool BigEndian>
+	struct Fixed
+	{
+		static std::size_t parse(const uint8_t* p, std::size_t left, uint64_t& len, Error&) {
+			if (left < Width) return 0;
+			len = 0;
+			for (unsigned i = 0; i < Width; ++i) {
+				len = BigEndian ? (len << 8) | p[i] : len | (static_cast<uint64_t>(p[i]) << (8 * i));
+			}
+			return Width;
+		}
+
+		static std::size_t shortfall(std::size_t left) {
+			return Width - left;
+		}
+	};
+
+	struct Varint
+	{
+		static std::size_t parse(const uint8_t* p, std::size_t left, uint64_t& len, Error& err) {
+			len = 0;
+			unsigned shift = 0;
+			for (std::size_t i = 0; i < left; ++i) {
+				if (i == MAX_VARINT_BYTES - 1 && p[i] > 1) {
+					err = BAD_VARINT; /*第10个字节只能提供最高的1位*/
+					return 0;
+				}
+				len |= static_cast<uint64_t>(p[i] & 0x7f) << shift;
+				if (!(p[i] & 0x80)) return i + 1;
+				shift += 7;
+			}
+			return 0;
+		}
+
+		static std::size_t shortfall(std::size_t) {
+			return 1;
+		}
+	};
+
+	template<typename Parser, typename Buffer>
+	int decode_with(Buffer& buf, FrameView* frames, int max) {
+		const uint8_t* p = buf.get_read_pointer();
+		std::size_t left = buf.get_active_size();
+		const uint8_t* const begin = p;
+		int n = 0;
+		missing_ = 0;
+		while (n < max) {
+			uint64_t len;
+			const std::size_t header = Parser::parse(p, left, len, error_);
+			if (header == 0) {
+				if (error_ != OK) {
+					buf.read_completed(p - begin);
+					return -1;
+				}
+				if (left > 0) {
+					missing_ = Parser::shortfall(left); /*前缀都不完整，至少还差这么多*/
+				}
+				break;
+			}
+			if (len > max_frame_size_) {
+				error_ = TOO_LARGE;
+				buf.read_completed(p - begin);
+				return -1;
+			}
+			if (left - header < len) {
+				missing_ = header + static_cast<std::size_t>(len) - left;
+				break;
+			}
+			frames[n].data = p + header;
+			frames[n].size = static_cast<std::size_t>(len);
+			++n;
+			p += header + len;
+			left -= header + len;
+		}
+		buf.read_completed(p - begin);
+		return n;
+	}
+
+	unsigned width_;
+	bool big_endian_;
+	std::size_t max_frame_size_;
+	std::size_t missing_;
+	Error error_;
+};
+
+#endif
@@ -0,0 +1,692 @@
+#ifndef __IO_LOOP_HPP__
+#define __IO_LOOP_HPP__
+
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include "message_buffer.hpp"
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#if defined(IORING_RECV_MULTISHOT) && defined(__NR_io_uring_setup) /*multishot recv和provided buffer ring同期加入*/
+#define IO_LOOP_HAVE_URING 1
+#endif
+#endif
+#endif
+
+/*IoLoop的计数器*/
+struct IoLoopCounters
+{
+	uint64_t syscalls = 0;    /*io_uring_enter / epoll_wait / read / write等所有系统调用*/
+	uint64_t completions = 0; /*收到的完成事件（io_uring的CQE或者epoll事件）*/
+};
+
+/*
+ * 驱动一组连接的MessageBuffer收发的IO循环
+ * io_uring后端: 每个连接一个multishot recv，数据落在内核从provided buffer ring里挑选的缓冲区，
+ *   完成时拷进连接的MessageBuffer并立即归还；send只生成SQE，和等待一起在下一次poll里一次io_uring_enter提交
+ *   初始化时用一次真实的recv探测provided buffer是否可用（有的内核或沙箱注册成功但选择缓冲区总是-ENOBUFS），
+ *   不可用时退成单次recv，直接收进MessageBuffer的空闲空间，每次完成后重新提交；
+ *   构造时buffers传0也是这种模式，省掉一次拷贝，代价是每收一次要重新提交一个SQE；
+ *   这种模式下内核随时可能写入in的空闲空间，调用者在remove之前只能读取和read_completed，不能往in里写，也不能对in调用tick/reclaim
+ * epoll后端: io_uring不可用（内核太旧、被seccomp禁止或者头文件没有）时使用，
+ *   就是原来的做法: epoll_wait之后每个可读连接调用一次MessageBuffer::recv，send直接flush
+ * 两种后端的接口和回调语义相同，调用者只看backend()决定要不要打日志
+ * 只能在一个线程里使用
+ */
+class IoLoop
+{
+public:
+	enum Backend { URING, EPOLL };
+
+	explicit IoLoop(bool prefer_uring = true, unsigned entries = 256, unsigned buffers = 256, std::size_t buffer_size = 4096)
+		: backend_(EPOLL), epoll_fd_(-1)
+	{
+#ifdef IO_LOOP_HAVE_URING
+		if (prefer_uring && uring_.init(entries, buffers, buffer_size)) {
+			backend_ = URING;
+			return;
+		}
+#else
+		(void)prefer_uring; (void)entries; (void)buffers; (void)buffer_size;
+#endif
+		epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+	}
+
+	~IoLoop() {
+#ifdef IO_LOOP_HAVE_URING
+		if (backend_ == URING) {
+			cancel_all();
+		}
+#endif
+		if (epoll_fd_ >= 0) close(epoll_fd_);
+	}
+
+	IoLoop(const IoLoop&) = delete;
+	IoLoop& operator=(const IoLoop&) = delete;
+
+	Backend backend() const {
+		return backend_;
+	}
+
+	bool valid() const {
+		return backend_ == URING || epoll_fd_ >= 0;
+	}
+
+	/*开始把fd上收到的数据追加到in，in在remove之前必须一直有效*/
+	bool add(int fd, MessageBuffer* in) {
+		Conn& c = conns_[fd];
+		c.in = in;
+		c.queued.reset();
+		c.sending = false;
+		c.receiving = false;
+		++c.gen;
+#ifdef IO_LOOP_HAVE_URING
+		if (backend_ == URING) {
+			return arm_recv(fd, c);
+		}
+#endif
+		struct epoll_event ev;
+		ev.events = EPOLLIN;
+		ev.data.fd = fd;
+		++counters_.syscalls;
+		return epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev) == 0;
+	}
+
+	/*
+	 * 停止收发，之后不会再为fd回调；还在内核里的发送数据由IoLoop保留到完成为止
+	 * 直接收进in的模式下，取消不一定能立即生效（请求已经在io-wq里执行时返回-EALREADY），
+	 * 所以要一直等到这个recv的完成事件出来才返回，期间别的连接的完成事件留到下一次poll处理；
+	 * 返回之后内核不会再写入in。极端情况下要等到对端发来数据或者关闭
+	 */
+	void remove(int fd) {
+		auto it = conns_.find(fd);
+		if (it == conns_.end()) return;
+#ifdef IO_LOOP_HAVE_URING
+		if (backend_ == URING) {
+			const uint64_t recv_tag = tag(fd, it->second.gen, OP_RECV);
+			bool receiving = it->second.receiving;
+			cancel(recv_tag);
+			if (it->second.sending) {
+				orphans_[tag(fd, it->second.gen, OP_SEND)] = std::move(it->second.inflight);
+			}
+			conns_.erase(it);
+			/*recv的完成事件可能已经被上一次remove收下了*/
+			for (auto d = deferred_.begin(); receiving && d != deferred_.end(); ++d) {
+				if (d->user_data == recv_tag) {
+					deferred_.erase(d);
+					receiving = false;
+					break;
+				}
+			}
+			while (receiving) {
+				uring_.enter(-1, counters_);
+				uring_.reap([this, recv_tag, &receiving](const io_uring_cqe& cqe) {
+					retire(cqe);
+					if (cqe.user_data == recv_tag) {
+						receiving = false;
+					}
+					else {
+						deferred_.push_back(cqe);
+					}
+					});
+			}
+			return;
+		}
+#endif
+		++counters_.syscalls;
+		epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+		conns_.erase(it);
+	}
+
+	/*
+	 * 把out中的全部可读数据交给IoLoop发送，返回时out总是空的，调用者可以立即继续写入或者析构它
+	 * 没有正在进行的发送时out和IoLoop内部的空缓冲区交换，不拷贝数据；
+	 * 上一次发送还没完成时数据追加到IoLoop自己的排队缓冲区（队列为空时同样是交换），上一次完成后接着发送
+	 */
+	void send(int fd, MessageBuffer& out) {
+		auto it = conns_.find(fd);
+		if (it == conns_.end() || out.get_active_size() == 0) return;
+		Conn& c = it->second;
+		if (!c.sending) {
+			start_send(fd, c, out);
+			return;
+		}
+		if (!c.queued) {
+			c.queued.reset(new MessageBuffer());
+		}
+		if (c.queued->get_active_size() == 0) {
+			std::swap(*c.queued, out);
+		}
+		else {
+			c.queued->write(out.get_read_pointer(), out.get_active_size());
+			out.read_completed(out.get_active_size());
+		}
+	}
+
+	/*
+	 * 提交排队的请求并等待事件，timeout_ms为-1时一直等到有事件，为0时不等待
+	 * on_event(int fd, int res): res > 0表示有res个新字节追加到了该连接的MessageBuffer，
+	 * 0表示对端关闭，< 0是收发失败的-errno；返回处理的完成事件数
+	 */
+	template<typename F>
+	int poll(int timeout_ms, F&& on_event) {
+#ifdef IO_LOOP_HAVE_URING
+		if (backend_ == URING) {
+			/*remove等待期间收下的完成事件先处理，这时不再阻塞*/
+			uring_.enter(deferred_.empty() ? timeout_ms : 0, counters_);
+			int handled = 0;
+			std::vector<io_uring_cqe> deferred;
+			deferred.swap(deferred_);
+			for (const io_uring_cqe& cqe : deferred) {
+				++handled;
+				complete(cqe, on_event);
+			}
+			uring_.reap([this, &on_event, &handled](const io_uring_cqe& cqe) {
+				retire(cqe);
+				++handled;
+				complete(cqe, on_event);
+				});
+			counters_.completions += handled;
+			return handled;
+		}
+#endif
+		struct epoll_event events[64];
+		++counters_.syscalls;
+		const int n = epoll_wait(epoll_fd_, events, 64, timeout_ms);
+		for (int i = 0; i < n; ++i) {
+			const int fd = events[i].data.fd;
+			auto it = conns_.find(fd);
+			if (it == conns_.end()) continue;
+			Conn& c = it->second;
+			if (events[i].events & EPOLLOUT) {
+				continue_send(fd, c, on_event);
+			}
+			if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+				int err = 0;
+				const uint64_t before = c.in->get_counters().syscalls;
+				const int r = c.in->recv(fd, &err);
+				counters_.syscalls += c.in->get_counters().syscalls - before;
+				on_event(fd, r < 0 ? -err : r);
+			}
+		}
+		if (n > 0) counters_.completions += n;
+		return n > 0 ? n : 0;
+	}
+
+	const IoLoopCounters& get_counters() const {
+		return counters_;
+	}
+
+private:
+	enum Op { OP_RECV = 0, OP_SEND = 1, OP_CANCEL = 2 };
+
+	struct Conn
+	{
+		MessageBuffer* in = nullptr;
+		std::unique_ptr<MessageBuffer> queued;   /*上一次发送完成之前send进来的数据*/
+		std::unique_ptr<MessageBuffer> inflight; /*正在发送的数据，内核可能正在读取，不能被调用者修改*/
+		uint32_t gen = 0;                        /*fd被复用后区分旧连接的完成事件*/
+		bool sending = false;
+		bool receiving = false;                  /*直接收进in的recv还在内核里*/
+	};
+
+	static uint64_t tag(int fd, uint32_t gen, Op op) {
+		return (static_cast<uint64_t>(gen) << 32) | (static_cast<uint64_t>(static_cast<uint32_t>(fd)) << 2) | op;
+	}
+
+	/*把src（调用者的缓冲区或者queued）和空的inflight交换，不拷贝数据*/
+	void start_send(int fd, Conn& c, MessageBuffer& src) {
+		if (!c.inflight) {
+			c.inflight.reset(new MessageBuffer());
+		}
+		std::swap(*c.inflight, src);
+		c.sending = true;
+#ifdef IO_LOOP_HAVE_URING
+		if (backend_ == URING) {
+			submit_send(fd, c);
+			return;
+		}
+#endif
+		int err = 0;
+		const uint64_t before = c.inflight->get_counters().syscalls;
+		const int r = c.inflight->flush(fd, &err);
+		counters_.syscalls += c.inflight->get_counters().syscalls - before;
+		if (r < 0) {
+			/*连接已经坏了，丢弃数据，错误会在接收侧报告*/
+			discard_send(c);
+		}
+		else if (c.inflight->get_active_size() > 0) {
+			watch_writable(fd, true); /*fd写满了，等EPOLLOUT*/
+		}
+		else {
+			c.sending = false;
+		}
+	}
+
+	template<typename F>
+	void continue_send(int fd, Conn& c, F& on_event) {
+		if (!c.sending) return;
+		int err = 0;
+		const uint64_t before = c.inflight->get_counters().syscalls;
+		const int r = c.inflight->flush(fd, &err);
+		counters_.syscalls += c.inflight->get_counters().syscalls - before;
+		if (r < 0) {
+			discard_send(c);
+			watch_writable(fd, false);
+			on_event(fd, -err);
+			return;
+		}
+		if (c.inflight->get_active_size() > 0) return;
+		c.sending = false;
+		if (c.queued && c.queued->get_active_size() > 0) {
+			start_send(fd, c, *c.queued);
+		}
+		if (!c.sending) {
+			watch_writable(fd, false);
+		}
+	}
+
+	/*发送失败，正在发送和排队的数据都丢弃，下一次send不会把它们换回调用者的缓冲区*/
+	static void discard_send(Conn& c) {
+		c.inflight->read_completed(c.inflight->get_active_size());
+		if (c.queued) {
+			c.queued->read_completed(c.queued->get_active_size());
+		}
+		c.sending = false;
+	}
+
+	void watch_writable(int fd, bool enable) {
+		struct epoll_event ev;
+		ev.events = EPOLLIN;
+		if (enable) ev.events |= EPOLLOUT;
+		ev.data.fd = fd;
+		++counters_.syscalls;
+		epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, fd, &ev);
+	}
+
+#ifdef IO_LOOP_HAVE_URING
+	/*
+	 * 最小化的io_uring封装，不依赖liburing
+	 * SQ/CQ环和provided buffer ring都是与内核共享的内存，下标用acquire/release同步
+	 */
+	class Uring
+	{
+	public:
+		Uring() : fd_(-1), sq_ring_(nullptr), cq_ring_(nullptr), sqes_(nullptr), sq_ring_size_(0), cq_ring_size_(0),
+			sqes_size_(0), sq_tail_(0), br_(nullptr), br_size_(0), br_tail_(0), br_mask_(0),
+			pool_(nullptr), pool_size_(0), buffer_size_(0) {}
+
+		~Uring() {
+			if (fd_ >= 0) close(fd_);
+			if (sq_ring_) munmap(sq_ring_, sq_ring_size_);
+			if (cq_ring_ && cq_ring_ != sq_ring_) munmap(cq_ring_, cq_ring_size_);
+			if (sqes_) munmap(sqes_, sqes_size_);
+			if (br_) munmap(br_, br_size_);
+			if (pool_) munmap(pool_, pool_size_);
+		}
+
+		bool init(unsigned entries, unsigned buffers, std::size_t buffer_size) {
+			struct io_uring_params p;
+			std::memset(&p, 0, sizeof(p));
+			p.flags = IORING_SETUP_CQSIZE;
+			p.cq_entries = entries * 4; /*multishot recv一个请求会产生很多CQE*/
+			fd_ = static_cast<int>(syscall(__NR_io_uring_setup, entries, &p));
+			if (fd_ < 0) return false;
+			/*没有EXT_ARG（5.11之前）等待时不能带超时，poll的timeout_ms会被忽略，这样的内核用epoll*/
+			if (!(p.features & IORING_FEAT_EXT_ARG)) return false;
+
+			sq_ring_size_ = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+			cq_ring_size_ = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+			if (p.features & IORING_FEAT_SINGLE_MMAP) {
+				sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+			}
+			sq_ring_ = map(sq_ring_size_, IORING_OFF_SQ_RING);
+			if (!sq_ring_) return false;
+			if (p.features & IORING_FEAT_SINGLE_MMAP) {
+				cq_ring_ = sq_ring_;
+			}
+			else {
+				cq_ring_ = map(cq_ring_size_, IORING_OFF_CQ_RING);
+				if (!cq_ring_) return false;
+			}
+			sqes_size_ = p.sq_entries * sizeof(io_uring_sqe);
+			sqes_ = static_cast<io_uring_sqe*>(map(sqes_size_, IORING_OFF_SQES));
+			if (!sqes_) return false;
+
+			uint8_t* sq = static_cast<uint8_t*>(sq_ring_);
+			sq_khead_ = reinterpret_cast<unsigned*>(sq + p.sq_off.head);
+			sq_ktail_ = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+			sq_mask_ = *reinterpret_cast<unsigned*>(sq + p.sq_off.ring_mask);
+			sq_entries_ = *reinterpret_cast<unsigned*>(sq + p.sq_off.ring_entries);
+			sq_array_ = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+			sq_tail_ = *sq_ktail_;
+			uint8_t* cq = static_cast<uint8_t*>(cq_ring_);
+			cq_khead_ = reinterpret_cast<unsigned*>(cq + p.cq_off.head);
+			cq_ktail_ = reinterpret_cast<unsigned*>(cq + p.cq_off.tail);
+			cq_mask_ = *reinterpret_cast<unsigned*>(cq + p.cq_off.ring_mask);
+			cqes_ = reinterpret_cast<io_uring_cqe*>(cq + p.cq_off.cqes);
+
+			if (buffers == 0) return true;
+			if (!init_buffers(buffers, buffer_size)) return false;
+			provided_ = probe_buffers();
+			return true;
+		}
+
+		/*provided buffer是否真的可用，不可用时recv直接收进MessageBuffer*/
+		bool provided_buffers() const {
+			return provided_;
+		}
+
+		/*SQ满了先把已有的提交掉*/
+		io_uring_sqe* get_sqe(IoLoopCounters& counters) {
+			while (sq_tail_ - __atomic_load_n(sq_khead_, __ATOMIC_ACQUIRE) >= sq_entries_) {
+				enter(0, counters);
+			}
+			const unsigned idx = sq_tail_ & sq_mask_;
+			io_uring_sqe* sqe = &sqes_[idx];
+			std::memset(sqe, 0, sizeof(*sqe));
+			sq_array_[idx] = idx;
+			++sq_tail_;
+			return sqe;
+		}
+
+		/*一次系统调用完成提交和等待；没有要提交的请求且不需要等待时不进内核*/
+		void enter(int timeout_ms, IoLoopCounters& counters) {
+			__atomic_store_n(sq_ktail_, sq_tail_, __ATOMIC_RELEASE);
+			const unsigned to_submit = sq_tail_ - __atomic_load_n(sq_khead_, __ATOMIC_ACQUIRE);
+			const bool ready = __atomic_load_n(cq_ktail_, __ATOMIC_ACQUIRE) != *cq_khead_;
+			const bool wait = timeout_ms != 0 && !ready;
+			if (to_submit == 0 && !wait) return;
+			unsigned flags = wait ? IORING_ENTER_GETEVENTS : 0;
+			struct __kernel_timespec ts;
+			struct io_uring_getevents_arg arg;
+			void* argp = nullptr;
+			std::size_t argsz = 0;
+			if (wait && timeout_ms > 0) {
+				ts.tv_sec = timeout_ms / 1000;
+				ts.tv_nsec = (timeout_ms % 1000) * 1000000LL;
+				std::memset(&arg, 0, sizeof(arg));
+				arg.ts = reinterpret_cast<uint64_t>(&ts);
+				flags |= IORING_ENTER_EXT_ARG;
+				argp = &arg;
+				argsz = sizeof(arg);
+			}
+			++counters.syscalls;
+			syscall(__NR_io_uring_enter, fd_, to_submit, wait ? 1 : 0, flags, argp, argsz);
+		}
+
+		template<typename F>
+		void reap(F&& f) {
+			unsigned head = *cq_khead_;
+			const unsigned tail = __atomic_load_n(cq_ktail_, __ATOMIC_ACQUIRE);
+			while (head != tail) {
+				f(cqes_[head & cq_mask_]);
+				++head;
+			}
+			__atomic_store_n(cq_khead_, head, __ATOMIC_RELEASE);
+			publish_buffers(); /*批量归还本轮用过的缓冲区*/
+		}
+
+		const uint8_t* buffer(unsigned bid) const {
+			return pool_ + static_cast<std::size_t>(bid) * buffer_size_;
+		}
+
+		/*把缓冲区放回ring，reap结束时统一发布*/
+		void recycle(unsigned bid) {
+			/*
+			 * 不能用br_->bufs: 头文件里的__DECLARE_FLEX_ARRAY在C++中有一个占1字节的空结构体，
+			 * bufs会被挪到偏移8，和内核看到的布局错开；数组实际从ring的起始地址开始，tail与bufs[0].resv重叠
+			 */
+			io_uring_buf* b = reinterpret_cast<io_uring_buf*>(br_) + (br_tail_ & br_mask_);
+			b->addr = reinterpret_cast<uint64_t>(buffer(bid));
+			b->len = static_cast<uint32_t>(buffer_size_);
+			b->bid = static_cast<uint16_t>(bid);
+			++br_tail_;
+		}
+
+		void publish_buffers() {
+			if (!br_) return;
+			__atomic_store_n(&br_->tail, br_tail_, __ATOMIC_RELEASE);
+		}
+
+	private:
+		void* map(std::size_t size, uint64_t offset) {
+			void* addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, offset);
+			return addr == MAP_FAILED ? nullptr : addr;
+		}
+
+		/*注册provided buffer ring（5.19以上），失败时整个后端不可用*/
+		bool init_buffers(unsigned buffers, std::size_t buffer_size) {
+			unsigned n = 1;
+			while (n < buffers && n < 32768) n <<= 1;
+			br_size_ = n * sizeof(io_uring_buf);
+			void* ring = mmap(nullptr, br_size_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			if (ring == MAP_FAILED) return false;
+			br_ = static_cast<io_uring_buf_ring*>(ring);
+			pool_size_ = n * buffer_size;
+			void* pool = mmap(nullptr, pool_size_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			if (pool == MAP_FAILED) return false;
+			pool_ = static_cast<uint8_t*>(pool);
+			buffer_size_ = buffer_size;
+			br_mask_ = n - 1;
+
+			struct io_uring_buf_reg reg;
+			std::memset(&reg, 0, sizeof(reg));
+			reg.ring_addr = reinterpret_cast<uint64_t>(br_);
+			reg.ring_entries = n;
+			reg.bgid = 0;
+			if (syscall(__NR_io_uring_register, fd_, IORING_REGISTER_PBUF_RING, &reg, 1) != 0) {
+				return false;
+			}
+			for (unsigned i = 0; i < n; ++i) recycle(i);
+			publish_buffers();
+			return true;
+		}
+
+		/*在socketpair上用选择缓冲区的recv收一个字节，能拿到缓冲区才算可用；此时还没有别的请求*/
+		bool probe_buffers() {
+			int fds[2];
+			if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) != 0) return false;
+			bool ok = false;
+			IoLoopCounters counters;
+			if (::write(fds[1], "x", 1) == 1) {
+				io_uring_sqe* sqe = get_sqe(counters);
+				sqe->opcode = IORING_OP_RECV;
+				sqe->fd = fds[0];
+				sqe->flags = IOSQE_BUFFER_SELECT;
+				sqe->buf_group = 0;
+				enter(-1, counters);
+				reap([this, &ok](const io_uring_cqe& cqe) {
+					if (cqe.flags & IORING_CQE_F_BUFFER) {
+						recycle(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+					}
+					ok = cqe.res == 1;
+					});
+			}
+			close(fds[0]);
+			close(fds[1]);
+			return ok;
+		}
+
+		int fd_;
+		void* sq_ring_;
+		void* cq_ring_;
+		io_uring_sqe* sqes_;
+		std::size_t sq_ring_size_;
+		std::size_t cq_ring_size_;
+		std::size_t sqes_size_;
+		unsigned* sq_khead_ = nullptr;
+		unsigned* sq_ktail_ = nullptr;
+		unsigned* sq_array_ = nullptr;
+		unsigned sq_mask_ = 0;
+		unsigned sq_entries_ = 0;
+		unsigned sq_tail_; /*本地的尾部，enter时才发布给内核*/
+		unsigned* cq_khead_ = nullptr;
+		unsigned* cq_ktail_ = nullptr;
+		unsigned cq_mask_ = 0;
+		io_uring_cqe* cqes_ = nullptr;
+		bool provided_ = false;
+		io_uring_buf_ring* br_;
+		std::size_t br_size_;
+		uint16_t br_tail_;
+		unsigned br_mask_;
+		uint8_t* pool_;
+		std::size_t pool_size_;
+		std::size_t buffer_size_;
+	};
+
+	bool arm_recv(int fd, Conn& c) {
+		++outstanding_;
+		io_uring_sqe* sqe = uring_.get_sqe(counters_);
+		sqe->opcode = IORING_OP_RECV;
+		sqe->fd = fd;
+		sqe->user_data = tag(fd, c.gen, OP_RECV);
+		if (!uring_.provided_buffers()) {
+			c.in->ensure_free_space(c.in->get_recv_hint());
+			c.receiving = true;
+			sqe->addr = reinterpret_cast<uint64_t>(c.in->get_write_pointer());
+			sqe->len = static_cast<uint32_t>(c.in->get_free_size());
+			return true;
+		}
+		sqe->ioprio = IORING_RECV_MULTISHOT;
+		sqe->flags = IOSQE_BUFFER_SELECT;
+		sqe->buf_group = 0;
+		return true;
+	}
+
+	void submit_send(int fd, Conn& c) {
+		++outstanding_;
+		io_uring_sqe* sqe = uring_.get_sqe(counters_);
+		sqe->opcode = IORING_OP_SEND;
+		sqe->fd = fd;
+		sqe->addr = reinterpret_cast<uint64_t>(c.inflight->get_read_pointer());
+		sqe->len = static_cast<uint32_t>(c.inflight->get_active_size());
+		sqe->msg_flags = MSG_NOSIGNAL;
+		sqe->user_data = tag(fd, c.gen, OP_SEND);
+	}
+
+	/*recv和send的最后一个完成事件（multishot没有F_MORE）到了，内核不再引用它的缓冲区*/
+	void retire(const io_uring_cqe& cqe) {
+		if (static_cast<Op>(cqe.user_data & 3) != OP_CANCEL && !(cqe.flags & IORING_CQE_F_MORE)) {
+			--outstanding_;
+		}
+	}
+
+	void cancel(uint64_t target) {
+		io_uring_sqe* sqe = uring_.get_sqe(counters_);
+		sqe->opcode = IORING_OP_ASYNC_CANCEL;
+		sqe->fd = -1;
+		sqe->addr = target;
+		sqe->user_data = (target & ~static_cast<uint64_t>(3)) | OP_CANCEL;
+	}
+
+	/*
+	 * 关闭ring不会等还在内核里的请求，它们之后仍可能读inflight、写直接收的in；
+	 * 析构时先取消所有连接和orphans_的recv/send，等它们的最后一个完成事件都到了才释放
+	 */
+	void cancel_all() {
+		if (outstanding_ == 0) return;
+		for (auto& it : conns_) {
+			cancel(tag(it.first, it.second.gen, OP_RECV));
+			if (it.second.sending) cancel(tag(it.first, it.second.gen, OP_SEND));
+		}
+		for (auto& it : orphans_) {
+			cancel(it.first);
+		}
+		while (outstanding_ > 0) {
+			uring_.enter(-1, counters_);
+			uring_.reap([this](const io_uring_cqe& cqe) { retire(cqe); });
+		}
+	}
+
+	template<typename F>
+	void complete(const io_uring_cqe& cqe, F& on_event) {
+		const int fd = static_cast<int>(static_cast<uint32_t>(cqe.user_data) >> 2);
+		const uint32_t gen = static_cast<uint32_t>(cqe.user_data >> 32);
+		const Op op = static_cast<Op>(cqe.user_data & 3);
+		if (op == OP_CANCEL) return;
+		auto it = conns_.find(fd);
+		const bool live = it != conns_.end() && it->second.gen == gen;
+
+		if (op == OP_SEND) {
+			if (!live) {
+				orphans_.erase(cqe.user_data);
+				return;
+			}
+			Conn& c = it->second;
+			if (cqe.res < 0) {
+				discard_send(c);
+				on_event(fd, cqe.res);
+				return;
+			}
+			c.inflight->read_completed(cqe.res);
+			if (c.inflight->get_active_size() > 0) {
+				submit_send(fd, c); /*部分发送，接着发剩下的*/
+			}
+			else if (c.queued && c.queued->get_active_size() > 0) {
+				start_send(fd, c, *c.queued);
+			}
+			else {
+				c.sending = false;
+			}
+			return;
+		}
+
+		/*OP_RECV: 无论连接是否还在，内核挑中的缓冲区都要归还*/
+		if (cqe.flags & IORING_CQE_F_BUFFER) {
+			const unsigned bid = cqe.flags >> IORING_CQE_BUFFER_SHIFT;
+			if (live && cqe.res > 0) {
+				it->second.in->write(uring_.buffer(bid), cqe.res);
+			}
+			uring_.recycle(bid);
+		}
+		if (!live) return;
+		if (!uring_.provided_buffers()) {
+			/*数据已经直接落在in的空闲空间里*/
+			it->second.receiving = false;
+			if (cqe.res > 0) {
+				it->second.in->write_completed(cqe.res);
+				arm_recv(fd, it->second);
+			}
+			on_event(fd, cqe.res);
+			return;
+		}
+		if (cqe.res == -ENOBUFS) {
+			/*缓冲区暂时用完，multishot已经停止；本轮归还之后重新挂上*/
+			uring_.publish_buffers();
+			arm_recv(fd, it->second);
+			return;
+		}
+		if (cqe.res > 0 && !(cqe.flags & IORING_CQE_F_MORE)) {
+			arm_recv(fd, it->second);
+		}
+		on_event(fd, cqe.res);
+	}
+
+#endif
+
+	Backend backend_;
+	int epoll_fd_;
+	std::unordered_map<int, Conn> conns_;
+	IoLoopCounters counters_;
+#ifdef IO_LOOP_HAVE_URING
+	std::unordered_map<uint64_t, std::unique_ptr<MessageBuffer>> orphans_; /*已经remove但发送还没完成的数据*/
+	std::vector<io_uring_cqe> deferred_; /*remove等待recv期间收下的其他完成事件*/
+	unsigned outstanding_ = 0; /*已经提交、还没收到最后一个完成事件的recv和send*/
+	Uring uring_; /*析构函数里已经等完了所有请求，关闭ring时内核不再引用任何缓冲区*/
+#endif
+};
+
+#endif
@@ -2,57 +2,160 @@
 #define __MESSAGE_BUFFER_HPP__
 
 #include <cstdint>
-#include <vector>
+#include <cstdlib>
 #include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <new>
+#include <unistd.h>
+#include <fcntl.h>
 #include <sys/uio.h>
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
 #include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include "buffer_pool.hpp"
+#include "buffer_slice.hpp"
 
+/*MessageBuffer的IO计数器*/
+struct MessageBufferCounters
+{
+	uint64_t syscalls = 0;      /*recv/send发出的系统调用次数，包括FIONREAD*/
+	uint64_t bytes_read = 0;    /*从fd读到的字节数*/
+	uint64_t bytes_written = 0; /*写到fd的字节数*/
+	uint64_t bytes_copied = 0; /*缓冲区内部搬移的字节数（normalize和换块），不包括write()拷入的调用者数据*/
+};
+
+/*
+ * 空闲回收策略，各项为0表示不启用；全部为0（默认）时tick/reclaim不会换块也不会madvise
+ * 回收只在调用者显式调用tick或reclaim时发生，不会在read_completed里偷偷换块，已经拿到的指针（比如FrameView）不受影响
+ */
+struct ReclaimPolicy
+{
+	std::size_t shrink_threshold = 0; /*缓冲区读空时存储块大于这个值，就换回构造时大小的块*/
+	std::size_t advise_threshold = 0; /*读空时留着的存储块不小于这个值，就把其中的整页madvise还给内核*/
+	bool lazy_free = false;           /*用MADV_FREE代替MADV_DONTNEED（内核有内存压力时才真正回收，重新写入更便宜）*/
+	std::size_t retain_limit = 0;     /*空闲时最多保留的容量，剩余数据能放进更小的块时即使没读空也换块*/
+	unsigned idle_cycles = 0;         /*tick连续看到多少次空缓冲区之后才回收，0表示第一次看到就回收*/
+};
+
+/*
+ * 溢出到文件的策略，threshold为0（默认）时不启用
+ * 缓冲区要扩到threshold以上时，数据搬进一个匿名临时文件（目录里的O_TMPFILE，不支持时用memfd），之后通过mmap读写，
+ * 扩容只是延长文件和映射，不再重新分配和拷贝；文件在磁盘上时内存里只有页缓存，内核可以写回和回收
+ */
+struct SpillPolicy
+{
+	std::size_t threshold = 0;                /*缓冲区超过这个大小时溢出到文件*/
+	std::size_t limit = std::size_t(1) << 34; /*溢出文件最大的大小，溢出时按这个大小保留地址空间；超过时抛std::bad_alloc*/
+	const char* directory = nullptr;          /*临时文件所在的目录，为空时用TMPDIR或者/tmp；字符串要一直有效*/
+};
+
+/*
+ * 存储块从BufferPool按2的幂大小分配，不清零；块的实际容量可能大于get_buffer_size()，
+ * 扩容时只要块里放得下就不需要重新分配
+ * recv先估计这次能读到多少，扩容之后直接读进缓冲区，不经过栈上的中转缓冲区
+ * 作为发送缓冲区时，send/flush把可读数据写到fd并推进读位置
+ * slice/take把一段数据做成带引用计数的BufferSlice，转发或排队都不拷贝；
+ * 之后normalize等需要覆盖这段数据时，如果切片还在，就换新块写时复制，旧块留给切片
+ * 一次突发流量把块撑大之后默认一直保留；设置ReclaimPolicy并在事件循环里调用tick，空闲连接会把大块还回去，
+ * retained_bytes统计所有MessageBuffer当前持有的存储块字节数（不含已经madvise掉的页）
+ * 几百MB的上传设置SpillPolicy溢出到文件，内存不随负载增长；溢出后flush用sendfile直接从文件发送，
+ * 读空时（normalize/reclaim）回到内存块
+ */
 class MessageBuffer
 {
 public:
-	MessageBuffer() : rpos_(0), wpos_(0)
-	{
-		buffer_.resize(4096);
-	}
+	static constexpr std::size_t MIN_RECV_HINT = 4096;
+	static constexpr std::size_t MAX_RECV_HINT = 1 << 20;
+	static constexpr std::size_t SPILL_CHUNK = 1 << 20; /*溢出文件按这个粒度延长，读过的部分也按这个粒度打洞释放*/
 
-	explicit MessageBuffer(std::size_t size) : rpos_(0), wpos_(0)
+	MessageBuffer() : MessageBuffer(4096) {}
+
+	explicit MessageBuffer(std::size_t size)
+		: buffer_(nullptr), shared_(nullptr), size_(0), capacity_(0), rpos_(0), wpos_(0),
+		recv_hint_(MIN_RECV_HINT), use_fionread_(false), coalescing_(false), send_pending_(false),
+		initial_size_(0), advised_(0), idle_(0), spill_fd_(-1), spill_reserved_(0), spill_punched_(0)
 	{
 		if (size == 0) size = 4096;
-		buffer_.resize(size);
+		buffer_ = BufferPool::allocate(size, capacity_);
+		size_ = size;
+		initial_size_ = size;
+		retained().fetch_add(static_cast<int64_t>(capacity_), std::memory_order_relaxed);
+	}
+
+	~MessageBuffer() {
+		release_block();
 	}
 
 	MessageBuffer(const MessageBuffer&) = delete;
 	MessageBuffer& operator=(const MessageBuffer&) = delete;
 
 	MessageBuffer(MessageBuffer&& other) noexcept
-		: buffer_(std::move(other.buffer_)), rpos_(other.rpos_), wpos_(other.wpos_)
+		: buffer_(other.buffer_), shared_(other.shared_), size_(other.size_), capacity_(other.capacity_), rpos_(other.rpos_), wpos_(other.wpos_),
+		recv_hint_(other.recv_hint_), use_fionread_(other.use_fionread_),
+		coalescing_(other.coalescing_), send_pending_(other.send_pending_), counters_(other.counters_),
+		initial_size_(other.initial_size_), advised_(other.advised_), idle_(other.idle_), policy_(other.policy_),
+		spill_policy_(other.spill_policy_), spill_fd_(other.spill_fd_), spill_reserved_(other.spill_reserved_), spill_punched_(other.spill_punched_)
 	{
+		other.buffer_ = nullptr;
+		other.shared_ = nullptr;
+		other.size_ = 0;
+		other.capacity_ = 0;
 		other.rpos_ = 0;
 		other.wpos_ = 0;
+		other.advised_ = 0;
+		other.spill_fd_ = -1;
 	}
 
 	MessageBuffer& operator=(MessageBuffer&& other) noexcept
 	{
 		if (this != &other) {
-			buffer_ = std::move(other.buffer_);
+			release_block();
+			buffer_ = other.buffer_;
+			shared_ = other.shared_;
+			size_ = other.size_;
+			capacity_ = other.capacity_;
 			rpos_ = other.rpos_;
 			wpos_ = other.wpos_;
+			recv_hint_ = other.recv_hint_;
+			use_fionread_ = other.use_fionread_;
+			coalescing_ = other.coalescing_;
+			send_pending_ = other.send_pending_;
+			counters_ = other.counters_;
+			initial_size_ = other.initial_size_;
+			advised_ = other.advised_;
+			idle_ = other.idle_;
+			policy_ = other.policy_;
+			spill_policy_ = other.spill_policy_;
+			spill_fd_ = other.spill_fd_;
+			spill_reserved_ = other.spill_reserved_;
+			spill_punched_ = other.spill_punched_;
+			other.buffer_ = nullptr;
+			other.shared_ = nullptr;
+			other.size_ = 0;
+			other.capacity_ = 0;
 			other.rpos_ = 0;
 			other.wpos_ = 0;
+			other.advised_ = 0;
+			other.spill_fd_ = -1;
 		}
 		return *this;
 	}
 
 	uint8_t* get_base_pointer() {
-		return buffer_.data();
+		return buffer_;
 	}
 
 	uint8_t* get_read_pointer() {
-		return buffer_.data() + rpos_;
+		return buffer_ + rpos_;
 	}
 
 	uint8_t* get_write_pointer() {
-		return buffer_.data() + wpos_;
+		return buffer_ + wpos_;
 	}
 
 	void read_completed(std::size_t size) {
@@ -61,7 +164,8 @@ public:
 	}
 
 	void write_completed(std::size_t size) {
-		if (wpos_ + size > buffer_.size()) return;
+		if (wpos_ + size > size_) return;
+		if (advised_) untrack_advised();
 		wpos_ += size;
 	}
 
@@ -70,15 +174,27 @@ public:
 	}
 
 	std::size_t get_free_size() const {
-		return buffer_.size() - wpos_;
+		return size_ - wpos_;
 	}
 
 	std::size_t get_buffer_size() const {
-		return buffer_.size();
+		return size_;
 	}
 
 	void normalize() {
-		if (rpos_ == 0 || get_active_size() == 0) {
+		if (rpos_ == 0) {
+			return;
+		}
+		if (spill_fd_ >= 0) {
+			normalize_spill();
+			return;
+		}
+		if (block_shared()) {
+			reallocate(size_); /*前面的数据还被切片引用，不能覆盖*/
+			return;
+		}
+		if (get_active_size() == 0) {
+			rpos_ = wpos_ = 0; /*没有数据时直接回到开头，不需要搬移*/
 			return;
 		}
 		if (rpos_ > wpos_) {
@@ -86,7 +202,8 @@ public:
 			return;
 		}
 		if (rpos_ > 0) {
-			std::memmove(buffer_.data(), buffer_.data() + rpos_, get_active_size());
+			std::memmove(buffer_, buffer_ + rpos_, get_active_size());
+			counters_.bytes_copied += get_active_size();
 			wpos_ -= rpos_;
 			rpos_ = 0;
 		}
@@ -94,14 +211,18 @@ public:
 
 	void ensure_free_space(std::size_t size) {
 		if (size == 0) return;
+		if (advised_) untrack_advised();
 		if (get_free_size() >= size) {
 			return;
 		}
 		normalize();
 
 		if (get_free_size() < size) {
-			std::size_t new_size = std::max(buffer_.size() + size, buffer_.size() * 3 / 2);
-			buffer_.resize(new_size);
+			std::size_t new_size = std::max(size_ + size, size_ * 3 / 2);
+			if (new_size > capacity_ && !grow_spill(new_size)) {
+				reallocate(new_size);
+			}
+			size_ = new_size;
 		}
 
 	}
@@ -123,16 +244,26 @@ public:
 		return wpos_;
 	}
 
+	/*
+	 * 先确定这次要读多少: 打开FIONREAD时向内核查询已到达的字节数（多一次系统调用），
+	 * 否则用最近几次读取大小的估计值；按这个大小扩容后一次read直接读到写位置，数据只拷贝一次
+	 * 一次没读完的数据留在内核里，边沿触发的调用者像以前一样循环到EAGAIN即可
+	 */
 	int recv(int fd, int* err) {
 		if (nullptr == err) return -1;
 		*err = 0;
-		char extra[65535];
-		struct iovec iov[2];
-		iov[0].iov_base = get_write_pointer();
-		iov[0].iov_len = get_free_size();
-		iov[1].iov_base = extra;
-		iov[1].iov_len = sizeof(extra);
-		ssize_t n = readv(fd, iov, 2);
+		std::size_t want = recv_hint_;
+		if (use_fionread_) {
+			int pending = 0;
+			++counters_.syscalls;
+			if (ioctl(fd, FIONREAD, &pending) == 0 && pending > 0) {
+				want = static_cast<std::size_t>(pending);
+			}
+		}
+		ensure_free_space(want);
+		const std::size_t free = get_free_size();
+		++counters_.syscalls;
+		ssize_t n = ::read(fd, get_write_pointer(), free);
 		if (n < 0) {
 			*err = errno;
 			return -1;
@@ -140,24 +271,456 @@ public:
 		if (n == 0) {
 			*err = 0;
 			return 0;
+		}
+		write_completed(n);
+		counters_.bytes_read += n;
+		update_recv_hint(static_cast<std::size_t>(n), free);
+		return n;
+	}
+
+	/*用FIONREAD查询可读字节数来决定读取大小，默认关闭，用自适应估计*/
+	void set_use_fionread(bool enable) {
+		use_fionread_ = enable;
+	}
+
+	/*下一次recv预留的空间*/
+	std::size_t get_recv_hint() const {
+		return recv_hint_;
+	}
+
+	/*
+	 * 发送可读数据: 合并模式下只记下有数据待发送，由事件循环在本轮结束时调用flush，
+	 * 否则立即flush；返回值与flush相同
+	 */
+	int send(int fd, int* err) {
+		if (nullptr == err) return -1;
+		*err = 0;
+		if (coalescing_) {
+			send_pending_ = get_active_size() > 0;
+			return 0;
+		}
+		return flush(fd, err);
+	}
+
+	/*
+	 * 把可读数据全部写到fd，处理部分写入，已写出的部分推进读位置
+	 * 返回本次写出的字节数；fd写满时*err为EAGAIN，剩余数据留在缓冲区里等待EPOLLOUT后再flush；其他错误返回-1
+	 * socket用send(MSG_NOSIGNAL)，对端关闭时返回EPIPE而不是收到SIGPIPE；不是socket（ENOTSOCK）时退回write
+	 */
+	int flush(int fd, int* err) {
+		if (nullptr == err) return -1;
+		*err = 0;
+		std::size_t sent = 0;
+		bool is_socket = true;
+		while (get_active_size() > 0) {
+			++counters_.syscalls;
+			ssize_t n;
+			if (spill_fd_ >= 0) {
+				n = send_spilled(fd);
+			}
+			else if (is_socket) {
+				n = ::send(fd, get_read_pointer(), get_active_size(), MSG_NOSIGNAL);
+			}
+			else {
+				n = ::write(fd, get_read_pointer(), get_active_size());
+			}
+			if (n < 0) {
+				if (errno == EINTR) continue;
+				if (errno == ENOTSOCK && is_socket && spill_fd_ < 0) {
+					is_socket = false;
+					continue;
+				}
+				*err = errno;
+				if (errno != EAGAIN && errno != EWOULDBLOCK) return -1;
+				break;
+			}
+			read_completed(n);
+			sent += n;
+			counters_.bytes_written += n;
+		}
+		send_pending_ = get_active_size() > 0;
+		return static_cast<int>(sent);
+	}
+
+	/*合并模式: 一轮事件循环里多次write + send只在flush时发出一次系统调用*/
+	void set_coalescing(bool enable) {
+		coalescing_ = enable;
+	}
+
+	/*send被推迟或者上次flush没有写完*/
+	bool has_pending_send() const {
+		return send_pending_;
+	}
+
+	const MessageBufferCounters& get_counters() const {
+		return counters_;
+	}
+
+	/*
+	 * [data, data + size)做成切片，不消费；这段数据必须已经写入缓冲区（可以在读位置之前，比如FrameCodec解出的帧）
+	 * 范围不在缓冲区里时返回空切片
+	 */
+	BufferSlice slice(const uint8_t* data, std::size_t size) {
+		if (data < buffer_ || data > buffer_ + wpos_ || size > static_cast<std::size_t>(buffer_ + wpos_ - data)) {
+			return BufferSlice();
+		}
+		if (nullptr == shared_) {
+			shared_ = spill_fd_ >= 0 ? SharedBlock::create_mapping(buffer_, spill_reserved_) : SharedBlock::create(buffer_, capacity_);
+		}
+		return BufferSlice(shared_, data, size);
+	}
+
+	/*把接下来的size个可读字节做成切片并消费掉*/
+	BufferSlice take(std::size_t size) {
+		if (size > get_active_size()) return BufferSlice();
+		BufferSlice s = slice(get_read_pointer(), size);
+		read_completed(size);
+		return s;
+	}
+
+	/*存储块的实际大小，不小于get_buffer_size()*/
+	std::size_t get_capacity() const {
+		return capacity_;
+	}
+
+	void set_reclaim_policy(const ReclaimPolicy& policy) {
+		policy_ = policy;
+		idle_ = 0;
+	}
+
+	const ReclaimPolicy& get_reclaim_policy() const {
+		return policy_;
+	}
+
+	/*
+	 * 每个事件循环周期调用一次: 缓冲区为空（也没有推迟的发送）时累计空闲次数，超过idle_cycles就reclaim
+	 * 返回这次少占用的字节数；IoLoop直接recv模式下注册着的缓冲区不能调用（内核可能正在写空闲空间）
+	 */
+	std::size_t tick() {
+		if (get_active_size() != 0 || send_pending_) {
+			idle_ = 0;
+			return 0;
+		}
+		if (++idle_ <= policy_.idle_cycles) return 0;
+		idle_ = 0;
+		return reclaim();
+	}
+
+	/*
+	 * 按策略立即回收，返回少占用的字节数；重复调用没有额外开销
+	 * 读空时: 块太大或者溢出到了文件就换回初始大小（旧块归还前先madvise），否则把留下的大块的整页madvise掉；
+	 * 没读空时只按retain_limit把剩余数据搬进更小的块；溢出到文件时不搬回内存，只给读过的整块打洞
+	 */
+	std::size_t reclaim() {
+		const std::size_t before = resident();
+		const std::size_t active = get_active_size();
+		if (active == 0) {
+			if (spill_fd_ >= 0 || (policy_.shrink_threshold && capacity_ > policy_.shrink_threshold && initial_size_ <= capacity_ / 2)) {
+				if (!block_shared() && spill_fd_ < 0) advise(buffer_, capacity_);
+				rpos_ = wpos_ = 0;
+				reallocate(initial_size_);
+				size_ = initial_size_;
+			}
+			else if (!block_shared()) {
+				rpos_ = wpos_ = 0;
+			}
+		}
+		if (spill_fd_ >= 0) {
+			punch_consumed();
+		}
+		else if (policy_.retain_limit && capacity_ > policy_.retain_limit) {
+			const std::size_t target = std::max(initial_size_, active);
+			if (target <= capacity_ / 2) {
+				reallocate(target);
+				size_ = target;
+			}
+		}
+		if (active == 0 && advised_ == 0 && spill_fd_ < 0 && !block_shared()) {
+			advised_ = advise(buffer_, capacity_);
+			retained().fetch_sub(static_cast<int64_t>(advised_), std::memory_order_relaxed);
+		}
+		return before > resident() ? before - resident() : 0;
+	}
+
+	/*所有MessageBuffer当前持有的存储块字节数，切片单独持有的旧块、madvise掉的页和溢出文件不算*/
+	static std::size_t retained_bytes() {
+		const int64_t n = retained().load(std::memory_order_relaxed);
+		return n > 0 ? static_cast<std::size_t>(n) : 0;
+	}
+
+	void set_spill_policy(const SpillPolicy& policy) {
+		spill_policy_ = policy;
+	}
+
+	const SpillPolicy& get_spill_policy() const {
+		return spill_policy_;
+	}
+
+	/*数据当前在溢出文件里*/
+	bool spilled() const {
+		return spill_fd_ >= 0;
 	}
-		if (static_cast<std::size_t>(n) <= get_free_size()) {
-			write_completed(n);
-			
+
+	/*
+	 * 溢出文件和读位置在文件里的偏移，没有溢出时fd为-1
+	 * 调用者可以自己用sendfile/splice转发可读数据，转发出去之后调用read_completed
+	 */
+	int get_spill_fd() const {
+		return spill_fd_;
+	}
+
+	std::size_t get_spill_offset() const {
+		return rpos_;
+	}
+
+private:
+	/*换一个块，只拷贝有效数据，新增的空间不清零；旧块还被切片引用时留给切片释放*/
+	void reallocate(std::size_t size) {
+		std::size_t capacity = 0;
+		uint8_t* block = BufferPool::allocate(size, capacity);
+		const std::size_t active = get_active_size();
+		if (active) {
+			std::memcpy(block, buffer_ + rpos_, active);
+			counters_.bytes_copied += active;
+		}
+		release_block();
+		buffer_ = block;
+		capacity_ = capacity;
+		rpos_ = 0;
+		wpos_ = active;
+		retained().fetch_add(static_cast<int64_t>(capacity_), std::memory_order_relaxed);
+	}
+
+	/*当前块还有切片引用*/
+	bool block_shared() const {
+		return shared_ && shared_->use_count() > 1;
+	}
+
+	void release_block() {
+		if (spill_fd_ >= 0) {
+			if (shared_) {
+				shared_->release(); /*映射留给切片，文件由映射持有*/
+				shared_ = nullptr;
+			}
+			else {
+				munmap(buffer_, spill_reserved_);
+			}
+			close(spill_fd_);
+			spill_fd_ = -1;
+			return;
+		}
+		retained().fetch_sub(static_cast<int64_t>(capacity_ - advised_), std::memory_order_relaxed);
+		advised_ = 0;
+		if (shared_) {
+			shared_->release();
+			shared_ = nullptr;
 		}
 		else {
-			std::size_t extra_size = n - get_free_size();
-			write_completed(get_free_size());
-			write(reinterpret_cast<uint8_t*>(extra), extra_size);
+			BufferPool::deallocate(buffer_, capacity_);
+		}
+	}
+
+	/*
+	 * 块不小于advise_threshold时把其中完整的页交还内核，返回交还的字节数；块里的内容随之作废
+	 * BufferPool的块不一定页对齐，只处理完全落在块内的页
+	 */
+	std::size_t advise(uint8_t* block, std::size_t capacity) const {
+		if (0 == policy_.advise_threshold || capacity < policy_.advise_threshold) return 0;
+		static const uintptr_t page = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+		const uintptr_t begin = (reinterpret_cast<uintptr_t>(block) + page - 1) & ~(page - 1);
+		const uintptr_t end = (reinterpret_cast<uintptr_t>(block) + capacity) & ~(page - 1);
+		if (end <= begin) return 0;
+		int advice = MADV_DONTNEED;
+#ifdef MADV_FREE
+		if (policy_.lazy_free) advice = MADV_FREE;
+#endif
+		if (madvise(reinterpret_cast<void*>(begin), end - begin, advice) != 0) return 0;
+		return end - begin;
+	}
+
+	/*计入retained_bytes的字节数*/
+	std::size_t resident() const {
+		return spill_fd_ >= 0 ? 0 : capacity_ - advised_;
+	}
+
+	static std::size_t round_chunk(std::size_t size) {
+		return (size + SPILL_CHUNK - 1) & ~(SPILL_CHUNK - 1);
+	}
+
+	/*
+	 * 要扩到size时按溢出策略处理: 已经溢出就延长文件和映射；第一次超过阈值时建文件，把现有数据拷过去（只拷这一次）
+	 * 返回false表示继续用内存块；超过limit或者已经溢出却延长失败时抛std::bad_alloc
+	 */
+	bool grow_spill(std::size_t size) {
+		if (spill_fd_ < 0) {
+			if (0 == spill_policy_.threshold || size <= spill_policy_.threshold) return false;
+			if (size > spill_policy_.limit) throw std::bad_alloc();
+			return start_spill(size);
 		}
+		if (size > spill_reserved_) throw std::bad_alloc();
+		punch_consumed();
+		const std::size_t length = std::min(round_chunk(size), spill_reserved_);
+		if (!extend_file(spill_fd_, capacity_, length)
+			|| mmap(buffer_ + capacity_, length - capacity_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, spill_fd_, static_cast<off_t>(capacity_)) == MAP_FAILED) {
+			throw std::bad_alloc();
+		}
+		capacity_ = length;
+		return true;
+	}
+
+	/*先保留limit大小的地址空间，文件映射在开头，以后延长时用MAP_FIXED接在后面，可读数据始终连续；建不了文件时返回false*/
+	bool start_spill(std::size_t size) {
+		const int fd = open_spill_file();
+		if (fd < 0) return false;
+		const std::size_t reserved = round_chunk(spill_policy_.limit);
+		const std::size_t length = round_chunk(size);
+		void* addr = mmap(nullptr, reserved, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+		if (addr == MAP_FAILED) {
+			close(fd);
+			return false;
+		}
+		if (!extend_file(fd, 0, length) || mmap(addr, length, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED) {
+			munmap(addr, reserved);
+			close(fd);
+			return false;
+		}
+		uint8_t* block = static_cast<uint8_t*>(addr);
+		const std::size_t active = get_active_size();
+		if (active) {
+			std::memcpy(block, buffer_ + rpos_, active);
+			counters_.bytes_copied += active;
+		}
+		release_block();
+		buffer_ = block;
+		capacity_ = length;
+		rpos_ = 0;
+		wpos_ = active;
+		spill_fd_ = fd;
+		spill_reserved_ = reserved;
+		spill_punched_ = 0;
+		return true;
+	}
+
+	int open_spill_file() const {
+		const char* dir = spill_policy_.directory;
+		if (nullptr == dir) dir = getenv("TMPDIR");
+		if (nullptr == dir || '\0' == *dir) dir = "/tmp";
+		int fd = -1;
+#ifdef O_TMPFILE
+		fd = open(dir, O_TMPFILE | O_RDWR | O_EXCL | O_CLOEXEC, 0600);
+#endif
+		if (fd < 0) fd = memfd_create("message_buffer_spill", MFD_CLOEXEC);
+		return fd;
+	}
+
+	/*先分配磁盘块，之后写映射时不会因为磁盘满收到SIGBUS；文件系统不支持fallocate时退回ftruncate*/
+	static bool extend_file(int fd, std::size_t from, std::size_t to) {
+		if (fallocate(fd, 0, static_cast<off_t>(from), static_cast<off_t>(to - from)) == 0) return true;
+		return errno == EOPNOTSUPP && ftruncate(fd, static_cast<off_t>(to)) == 0;
+	}
+
+	/*读位置之前整块的数据已经不需要了，在文件上打洞释放磁盘和页缓存；还有切片时不动*/
+	void punch_consumed() {
+		if (block_shared()) return;
+		const std::size_t end = rpos_ & ~(SPILL_CHUNK - 1);
+		if (end <= spill_punched_) return;
+		if (fallocate(spill_fd_, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, static_cast<off_t>(spill_punched_), static_cast<off_t>(end - spill_punched_)) == 0) {
+			spill_punched_ = end;
+		}
+	}
+
+	/*
+	 * 溢出时读空就回到初始大小的内存块；没读空时只有剩余数据不多于已读的数据才搬到开头，
+	 * 摊下来每个字节最多搬一次，其余情况打洞之后在文件里继续往后写
+	 */
+	void normalize_spill() {
+		const std::size_t active = get_active_size();
+		if (active == 0) {
+			reallocate(initial_size_);
+			size_ = initial_size_;
+			return;
+		}
+		if (block_shared() || active > rpos_) {
+			punch_consumed();
+			return;
+		}
+		if (spill_punched_) {
+			/*洞要重新写入，先把磁盘块分配回来*/
+			if (fallocate(spill_fd_, FALLOC_FL_KEEP_SIZE, 0, static_cast<off_t>(spill_punched_)) != 0) return;
+			spill_punched_ = 0;
+		}
+		std::memmove(buffer_, buffer_ + rpos_, active);
+		counters_.bytes_copied += active;
+		wpos_ = active;
+		rpos_ = 0;
+	}
+
+	/*
+	 * sendfile没有MSG_NOSIGNAL，对端关闭时会产生SIGPIPE: 发送期间屏蔽SIGPIPE，
+	 * 失败为EPIPE时把这次产生的信号取走，和内存里的数据一样只返回EPIPE
+	 */
+	ssize_t send_spilled(int fd) {
+		sigset_t pipe_set, old_set, pending_set;
+		sigemptyset(&pipe_set);
+		sigaddset(&pipe_set, SIGPIPE);
+		pthread_sigmask(SIG_BLOCK, &pipe_set, &old_set);
+		sigpending(&pending_set);
+		const bool was_pending = sigismember(&pending_set, SIGPIPE) == 1;
+		off_t offset = static_cast<off_t>(rpos_);
+		const ssize_t n = ::sendfile(fd, spill_fd_, &offset, get_active_size());
+		const int saved = errno;
+		counters_.syscalls += 3;
+		if (n < 0 && saved == EPIPE && !was_pending) {
+			const struct timespec zero = { 0, 0 };
+			++counters_.syscalls;
+			while (sigtimedwait(&pipe_set, nullptr, &zero) < 0 && errno == EINTR) {}
+		}
+		pthread_sigmask(SIG_SETMASK, &old_set, nullptr);
+		errno = saved;
 		return n;
+	}
 
+	/*madvise过的页又要写入了，重新计入retained_bytes*/
+	void untrack_advised() {
+		retained().fetch_add(static_cast<int64_t>(advised_), std::memory_order_relaxed);
+		advised_ = 0;
 	}
 
-private:
-	std::vector<uint8_t> buffer_;
+	static std::atomic<int64_t>& retained() {
+		static std::atomic<int64_t> bytes(0);
+		return bytes;
+	}
+
+	/*读满了说明内核里可能还有数据，估计值翻倍；连续读得很少时减半*/
+	void update_recv_hint(std::size_t n, std::size_t requested) {
+		if (n == requested) {
+			const std::size_t grown = std::max(recv_hint_, requested) * 2;
+			recv_hint_ = grown < MAX_RECV_HINT ? grown : MAX_RECV_HINT;
+		}
+		else if (n < recv_hint_ / 4) {
+			recv_hint_ = recv_hint_ / 2 > MIN_RECV_HINT ? recv_hint_ / 2 : MIN_RECV_HINT;
+		}
+	}
+
+	uint8_t* buffer_;
+	SharedBlock* shared_;  /*切过片之后才有，持有buffer_的一个引用*/
+	std::size_t size_;     /*逻辑大小，与原来vector的size()一致*/
+	std::size_t capacity_; /*存储块的实际大小*/
 	std::size_t rpos_;
 	std::size_t wpos_;
+	std::size_t recv_hint_;  /*自适应的读取大小估计*/
+	bool use_fionread_;
+	bool coalescing_;
+	bool send_pending_;
+	MessageBufferCounters counters_;
+	std::size_t initial_size_; /*构造时的大小，收缩时换回这么大的块*/
+	std::size_t advised_;      /*当前块里已经madvise掉、不计入retained_bytes的字节数*/
+	unsigned idle_;            /*tick连续看到空缓冲区的次数*/
+	ReclaimPolicy policy_;
+	SpillPolicy spill_policy_;
+	int spill_fd_;                /*溢出文件，-1表示数据在内存块里*/
+	std::size_t spill_reserved_;  /*溢出时保留的地址空间，buffer_是它的起点*/
+	std::size_t spill_punched_;   /*溢出文件开头已经打洞释放的字节数*/
 };
 
 #endif
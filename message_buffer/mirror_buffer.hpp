@@ -0,0 +1,223 @@
+#ifndef __MIRROR_BUFFER_HPP__
+#define __MIRROR_BUFFER_HPP__
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/mman.h>
+
+/*
+ * 双重映射的字节环形缓冲区
+ * 同一个memfd在虚拟地址上连续映射两次，base[i]和base[i + size]是同一个字节，
+ * 所以任何可读、可写区域在虚拟地址上都是连续的，可以直接交给read/write/readv/writev或解析器，不需要normalize的memmove
+ * 接口与MessageBuffer兼容；ThreadSafe为true时一个生产者线程写、一个消费者线程读，下标用acquire/release同步
+ * 下标是单调递增的字节计数，容量向上取整为页大小的2的幂
+ */
+template <bool ThreadSafe = false>
+class MirrorBuffer
+{
+public:
+	MirrorBuffer() : MirrorBuffer(4096) {}
+
+	explicit MirrorBuffer(std::size_t size) : base_(nullptr), size_(0), rpos_(0), wpos_(0)
+	{
+		if (size == 0) size = 4096;
+		map(round_size(size));
+	}
+
+	~MirrorBuffer() {
+		unmap();
+	}
+
+	MirrorBuffer(const MirrorBuffer&) = delete;
+	MirrorBuffer& operator=(const MirrorBuffer&) = delete;
+
+	MirrorBuffer(MirrorBuffer&& other) noexcept
+		: base_(other.base_), size_(other.size_),
+		rpos_(other.rpos_.load(std::memory_order_relaxed)), wpos_(other.wpos_.load(std::memory_order_relaxed))
+	{
+		other.base_ = nullptr;
+		other.size_ = 0;
+		other.rpos_.store(0, std::memory_order_relaxed);
+		other.wpos_.store(0, std::memory_order_relaxed);
+	}
+
+	MirrorBuffer& operator=(MirrorBuffer&& other) noexcept
+	{
+		if (this != &other) {
+			unmap();
+			base_ = other.base_;
+			size_ = other.size_;
+			rpos_.store(other.rpos_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+			wpos_.store(other.wpos_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+			other.base_ = nullptr;
+			other.size_ = 0;
+			other.rpos_.store(0, std::memory_order_relaxed);
+			other.wpos_.store(0, std::memory_order_relaxed);
+		}
+		return *this;
+	}
+
+	/*映射失败（例如没有memfd）时为false*/
+	bool valid() const {
+		return base_ != nullptr;
+	}
+
+	uint8_t* get_base_pointer() {
+		return base_;
+	}
+
+	/*从这里开始的get_active_size()个字节是连续的*/
+	uint8_t* get_read_pointer() {
+		return base_ + (rpos_.load(std::memory_order_relaxed) & (size_ - 1));
+	}
+
+	/*从这里开始的get_free_size()个字节是连续的*/
+	uint8_t* get_write_pointer() {
+		return base_ + (wpos_.load(std::memory_order_relaxed) & (size_ - 1));
+	}
+
+	void read_completed(std::size_t size) {
+		const std::size_t r = rpos_.load(std::memory_order_relaxed);
+		if (size > wpos_.load(ACQUIRE) - r) return;
+		rpos_.store(r + size, RELEASE);
+	}
+
+	void write_completed(std::size_t size) {
+		const std::size_t w = wpos_.load(std::memory_order_relaxed);
+		if (size > size_ - (w - rpos_.load(ACQUIRE))) return;
+		wpos_.store(w + size, RELEASE);
+	}
+
+	std::size_t get_active_size() const {
+		return wpos_.load(ACQUIRE) - rpos_.load(ACQUIRE);
+	}
+
+	std::size_t get_free_size() const {
+		return size_ - get_active_size();
+	}
+
+	std::size_t get_buffer_size() const {
+		return size_;
+	}
+
+	std::size_t get_read_pos() const {
+		return rpos_.load(std::memory_order_relaxed) & (size_ - 1);
+	}
+
+	std::size_t get_write_pos() const {
+		return wpos_.load(std::memory_order_relaxed) & (size_ - 1);
+	}
+
+	/*只是为了和MessageBuffer兼容，读写区域本来就是连续的，不需要搬移数据*/
+	void normalize() {}
+
+	/*
+	 * 空间不足时重新映射一块更大的缓冲区，把现有数据拷贝一次
+	 * 线程安全模式下另一端可能正在访问，不能扩容，返回false
+	 */
+	bool ensure_free_space(std::size_t size) {
+		if (get_free_size() >= size) {
+			return true;
+		}
+		if (ThreadSafe) {
+			return false;
+		}
+		MirrorBuffer bigger(std::max(size_ + size, size_ * 2));
+		if (!bigger.valid()) {
+			return false;
+		}
+		const std::size_t active = get_active_size();
+		std::memcpy(bigger.get_write_pointer(), get_read_pointer(), active);
+		bigger.write_completed(active);
+		*this = std::move(bigger);
+		return true;
+	}
+
+	/*写入数据，空间不足且无法扩容时什么都不写并返回false*/
+	bool write(const uint8_t* data, std::size_t size) {
+		if (NULL == data || 0 == size) return true;
+		if (!ensure_free_space(size)) {
+			return false;
+		}
+		std::memcpy(get_write_pointer(), data, size);
+		write_completed(size);
+		return true;
+	}
+
+	/*可写区域是连续的，一次read直接读到位，不需要额外的栈缓冲区*/
+	int recv(int fd, int* err) {
+		if (nullptr == err) return -1;
+		*err = 0;
+		if (get_free_size() == 0 && !ensure_free_space(size_)) {
+			*err = ENOBUFS;
+			return -1;
+		}
+		ssize_t n = ::read(fd, get_write_pointer(), get_free_size());
+		if (n < 0) {
+			*err = errno;
+			return -1;
+		}
+		if (n > 0) {
+			write_completed(n);
+		}
+		return n;
+	}
+
+private:
+	static constexpr std::memory_order ACQUIRE = ThreadSafe ? std::memory_order_acquire : std::memory_order_relaxed;
+	static constexpr std::memory_order RELEASE = ThreadSafe ? std::memory_order_release : std::memory_order_relaxed;
+
+	static std::size_t round_size(std::size_t size) {
+		std::size_t page = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+		std::size_t n = page;
+		while (n < size) n <<= 1;
+		return n;
+	}
+
+	/*先保留2*size的地址空间，再把memfd用MAP_FIXED映射到前后两半*/
+	void map(std::size_t size) {
+		int fd = memfd_create("mirror_buffer", MFD_CLOEXEC);
+		if (fd < 0) {
+			return;
+		}
+		if (ftruncate(fd, size) != 0) {
+			close(fd);
+			return;
+		}
+		void* addr = mmap(nullptr, size * 2, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (addr == MAP_FAILED) {
+			close(fd);
+			return;
+		}
+		uint8_t* base = static_cast<uint8_t*>(addr);
+		if (mmap(base, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED
+			|| mmap(base + size, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED) {
+			munmap(addr, size * 2);
+			close(fd);
+			return;
+		}
+		close(fd); /*映射会持有memfd的引用*/
+		base_ = base;
+		size_ = size;
+	}
+
+	void unmap() {
+		if (base_) {
+			munmap(base_, size_ * 2);
+			base_ = nullptr;
+			size_ = 0;
+		}
+	}
+
+	uint8_t* base_;
+	std::size_t size_;
+	/*线程安全模式下读写下标分属两个线程，放在不同的cacheline*/
+	alignas(64) std::atomic<std::size_t> rpos_;
+	alignas(64) std::atomic<std::size_t> wpos_;
+};
+
+#endif
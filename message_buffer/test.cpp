@@ -1,10 +1,26 @@
 #include "message_buffer.hpp"
+#include "mirror_buffer.hpp"
+#include "chunked_buffer.hpp"
+#include "buffer_pool.hpp"
+#include "io_loop.hpp"
+#include "frame_codec.hpp"
+#include "delimiter_scan.hpp"
+#include "checksum.hpp"
+#include "forwarder.hpp"
 #include <cassert>
+#include <chrono>
 #include <cstring>
 #include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <poll.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/eventfd.h>
 #include <arpa/inet.h>
 #include <cstdio>
+#include <thread>
+#include <vector>
 
 // 测试1：初始化与基本属性
 void test_initialization() {
@@ -129,6 +145,1382 @@ void test_move_semantics() {
     assert(std::memcmp(buf3.get_read_pointer(), data, active_size) == 0);
 }
 
+// 测试7：双重映射缓冲区，跨越末尾的数据依旧连续
+void test_mirror_buffer() {
+    MirrorBuffer<> buf(4096);
+    assert(buf.valid());
+    assert(buf.get_buffer_size() == 4096);
+    assert(buf.get_free_size() == 4096);
+
+    // 把读写位置推到接近末尾的地方
+    uint8_t filler[4000] = { 0 };
+    buf.write(filler, sizeof(filler));
+    buf.read_completed(sizeof(filler));
+    assert(buf.get_active_size() == 0);
+    assert(buf.get_read_pos() == 4000);
+
+    // 写入200字节，跨过末尾，依然是一次memcpy
+    uint8_t data[200];
+    for (int i = 0; i < 200; ++i) data[i] = static_cast<uint8_t>(i);
+    assert(buf.write(data, sizeof(data)));
+    assert(buf.get_write_pos() == 104);
+    assert(std::memcmp(buf.get_read_pointer(), data, sizeof(data)) == 0);
+    // 绕回部分和缓冲区开头是同一块物理内存
+    assert(std::memcmp(buf.get_base_pointer(), data + 96, 104) == 0);
+    assert(buf.get_free_size() == 4096 - 200);
+
+    // normalize不需要做任何事情
+    uint8_t* before = buf.get_read_pointer();
+    buf.normalize();
+    assert(buf.get_read_pointer() == before);
+    buf.read_completed(200);
+
+    // recv跨过末尾也是一次read
+    int fds[2];
+    assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    buf.write(filler, 3990);
+    buf.read_completed(3990);
+    const char* msg = "mirror buffer recv across the wrap point";
+    assert(write(fds[1], msg, strlen(msg)) == static_cast<ssize_t>(strlen(msg)));
+    int err = 0;
+    assert(buf.recv(fds[0], &err) == static_cast<int>(strlen(msg)));
+    assert(err == 0);
+    assert(std::memcmp(buf.get_read_pointer(), msg, strlen(msg)) == 0);
+    close(fds[0]);
+    close(fds[1]);
+
+    // 非线程安全模式下可以扩容，数据保持不变
+    std::size_t active = buf.get_active_size();
+    assert(buf.ensure_free_space(8192));
+    assert(buf.get_buffer_size() >= 8192 + active);
+    assert(std::memcmp(buf.get_read_pointer(), msg, strlen(msg)) == 0);
+
+    // 移动语义
+    MirrorBuffer<> moved(std::move(buf));
+    assert(!buf.valid());
+    assert(moved.get_active_size() == active);
+}
+
+// 测试8：双重映射缓冲区的SPSC线程安全模式
+void test_mirror_buffer_spsc() {
+    MirrorBuffer<true> buf(4096);
+    assert(buf.valid());
+    const uint32_t COUNT = 200000;
+    std::thread producer([&buf, COUNT]() {
+        uint32_t next = 0;
+        while (next < COUNT) {
+            // 每次写入任意长度的连续整数，区域可能跨过末尾
+            std::size_t n = std::min<std::size_t>(buf.get_free_size() / 4, 1 + next % 97);
+            n = std::min<std::size_t>(n, COUNT - next);
+            if (n == 0) {
+                std::this_thread::yield();
+                continue;
+            }
+            uint32_t* out = reinterpret_cast<uint32_t*>(buf.get_write_pointer());
+            for (std::size_t i = 0; i < n; ++i) out[i] = next++;
+            buf.write_completed(n * 4);
+        }
+        });
+    uint32_t expected = 0;
+    while (expected < COUNT) {
+        std::size_t n = buf.get_active_size() / 4;
+        if (n == 0) {
+            std::this_thread::yield();
+            continue;
+        }
+        const uint32_t* in = reinterpret_cast<const uint32_t*>(buf.get_read_pointer());
+        for (std::size_t i = 0; i < n; ++i) assert(in[i] == expected++);
+        buf.read_completed(n * 4);
+    }
+    producer.join();
+    // 线程安全模式下不能扩容
+    assert(!buf.ensure_free_space(8192));
+}
+
+// 测试9：分块缓冲区，写入和消费都不搬移已有数据
+void test_chunked_buffer() {
+    ChunkedBuffer buf(1024);
+    assert(buf.get_buffer_size() == 1024);
+    assert(buf.get_free_size() == 1024);
+    assert(buf.get_chunk_count() == 1);
+
+    // 写入3000字节，跨越3个块
+    uint8_t data[3000];
+    for (int i = 0; i < 3000; ++i) data[i] = static_cast<uint8_t>(i * 7);
+    buf.write(data, 100);
+    uint8_t* first = buf.get_read_pointer();
+    buf.write(data + 100, 2900);
+    assert(buf.get_active_size() == 3000);
+    assert(buf.get_chunk_count() == 3);
+    assert(buf.get_read_pointer() == first);  // 之前写入的数据没有被移动
+    assert(buf.get_read_size() == 1024);
+
+    // peek可以跨块拷贝
+    uint8_t out[3000];
+    assert(buf.peek(out, sizeof(out)) == 3000);
+    assert(std::memcmp(out, data, 3000) == 0);
+
+    // 跨块消费，读完的块被回收
+    buf.read_completed(1500);
+    assert(buf.get_active_size() == 1500);
+    assert(buf.get_chunk_count() == 2);
+    assert(buf.get_read_size() == 548);
+    assert(std::memcmp(buf.get_read_pointer(), data + 1500, 548) == 0);
+    buf.read_completed(5000);  // 超过可读长度，忽略
+    assert(buf.get_active_size() == 1500);
+
+    // 再写入时复用回收的块
+    buf.write(data, 1000);
+    assert(buf.get_chunk_count() == 3);
+    assert(buf.get_buffer_size() == 3072);
+
+    // ensure_free_space保证连续空间，大于块大小时挂一个大块
+    buf.ensure_free_space(4000);
+    assert(buf.get_free_size() >= 4000);
+    std::memcpy(buf.get_write_pointer(), data, 3000);
+    buf.write_completed(3000);
+    buf.read_completed(2500);
+    assert(buf.get_active_size() == 3000);
+    assert(std::memcmp(buf.get_read_pointer(), data, 3000) == 0);
+
+    // 全部读完后只剩一个块，从头开始写
+    buf.read_completed(3000);
+    assert(buf.get_active_size() == 0);
+    assert(buf.get_chunk_count() == 1);
+
+    // 移动语义
+    buf.write(data, 10);
+    ChunkedBuffer moved(std::move(buf));
+    assert(buf.get_active_size() == 0);
+    assert(moved.get_active_size() == 10);
+    buf.write(data, 10);  // 被移走的对象依然可用
+    assert(buf.get_active_size() == 10);
+}
+
+// 测试10：分块缓冲区用readv/writev直接收发
+void test_chunked_buffer_io() {
+    int fds[2];
+    assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+
+    // 一次recv收下超过尾部剩余空间的数据，多出来的部分直接落在备用块里
+    uint8_t data[1500];
+    for (int i = 0; i < 1500; ++i) data[i] = static_cast<uint8_t>(i);
+    ChunkedBuffer in(1024);
+    in.write(data, 1000);
+    in.read_completed(1000);
+    in.write(data, 900);  // 尾部块只剩124字节
+    assert(write(fds[1], data, 1000) == 1000);
+    int err = 0;
+    assert(in.recv(fds[0], &err) == 1000);
+    assert(err == 0);
+    assert(in.get_active_size() == 1900);
+    assert(in.get_chunk_count() == 2);
+    uint8_t out[1900];
+    assert(in.peek(out, sizeof(out)) == 1900);
+    assert(std::memcmp(out, data, 900) == 0);
+    assert(std::memcmp(out + 900, data, 1000) == 0);
+
+    // send用writev把所有块一次发出去
+    assert(in.send(fds[1], &err) == 1900);
+    assert(err == 0);
+    assert(in.get_active_size() == 0);
+    uint8_t echo[1900];
+    std::size_t got = 0;
+    while (got < sizeof(echo)) {
+        ssize_t n = read(fds[0], echo + got, sizeof(echo) - got);
+        assert(n > 0);
+        got += n;
+    }
+    assert(std::memcmp(echo, out, sizeof(echo)) == 0);
+
+    close(fds[0]);
+    close(fds[1]);
+}
+
+// 测试11：存储块内存池
+void test_buffer_pool() {
+    // 按2的幂分级，同一线程释放后立即复用
+    std::size_t cap = 0;
+    uint8_t* a = BufferPool::allocate(3000, cap);
+    assert(cap == 4096);
+    BufferPool::deallocate(a, cap);
+    std::size_t cap2 = 0;
+    uint8_t* b = BufferPool::allocate(4096, cap2);
+    assert(b == a && cap2 == 4096);
+    BufferPool::deallocate(b, cap2);
+
+    // 超过最大级别的直接分配
+    uint8_t* big = BufferPool::allocate((1 << 20) + 1, cap);
+    assert(cap == (1 << 20) + 1);
+    BufferPool::deallocate(big, cap);
+
+    // 线程退出时本地缓存归还全局池，其他线程可以取到
+    std::size_t before = BufferPool::global_blocks();
+    uint8_t* from_thread = nullptr;
+    std::thread t([&from_thread]() {
+        std::size_t c = 0;
+        from_thread = BufferPool::allocate(8192, c);
+        BufferPool::deallocate(from_thread, c);
+        assert(BufferPool::local_blocks() == 1);
+        });
+    t.join();
+    assert(BufferPool::global_blocks() == before + 1);
+    uint8_t* c = BufferPool::allocate(8000, cap);
+    assert(c == from_thread);
+    BufferPool::deallocate(c, cap);
+
+    // 本地链表满了以后批量溢出到全局池
+    std::vector<uint8_t*> blocks;
+    for (std::size_t i = 0; i < BufferPool::LOCAL_LIMIT + 1; ++i) {
+        blocks.push_back(BufferPool::allocate(512, cap));
+    }
+    before = BufferPool::global_blocks();
+    for (uint8_t* p : blocks) BufferPool::deallocate(p, 512);
+    assert(BufferPool::global_blocks() == before + BufferPool::BATCH);
+
+    // MessageBuffer在块的容量内扩容不需要重新分配
+    MessageBuffer buf(100);
+    uint8_t* base = buf.get_base_pointer();
+    uint8_t data[80] = { 1 };
+    buf.write(data, 80);
+    buf.ensure_free_space(100);
+    assert(buf.get_buffer_size() == 200);  // max(100 + 100, 150)，仍在256字节的块内
+    assert(buf.get_base_pointer() == base);
+    assert(std::memcmp(buf.get_read_pointer(), data, 80) == 0);
+    // 超过块的容量时换块，只搬有效数据
+    buf.read_completed(40);
+    buf.ensure_free_space(1000);
+    assert(buf.get_read_pos() == 0);
+    assert(buf.get_active_size() == 40);
+    assert(std::memcmp(buf.get_read_pointer(), data + 40, 40) == 0);
+}
+
+// 测试12：recv按估计大小预先扩容，数据直接读到位
+void test_recv_sizing() {
+    int fds[2];
+    assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    std::vector<uint8_t> data(100000);
+    for (std::size_t i = 0; i < data.size(); ++i) data[i] = static_cast<uint8_t>(i * 13);
+
+    // FIONREAD: 一次查询一次read就收完全部数据，没有额外的拷贝
+    {
+        MessageBuffer buf;
+        buf.set_use_fionread(true);
+        assert(write(fds[1], data.data(), data.size()) == static_cast<ssize_t>(data.size()));
+        int err = 0;
+        assert(buf.recv(fds[0], &err) == static_cast<int>(data.size()));
+        assert(err == 0);
+        assert(buf.get_counters().syscalls == 2);
+        assert(buf.get_counters().bytes_read == data.size());
+        assert(buf.get_counters().bytes_copied == 0);
+        assert(std::memcmp(buf.get_read_pointer(), data.data(), data.size()) == 0);
+    }
+
+    // 自适应估计: 每次都读满时估计值翻倍，读取次数按对数增长
+    {
+        MessageBuffer buf;
+        assert(buf.get_recv_hint() == MessageBuffer::MIN_RECV_HINT);
+        assert(write(fds[1], data.data(), data.size()) == static_cast<ssize_t>(data.size()));
+        int err = 0;
+        while (buf.get_active_size() < data.size()) {
+            assert(buf.recv(fds[0], &err) > 0);
+        }
+        assert(buf.get_recv_hint() > MessageBuffer::MIN_RECV_HINT);
+        assert(buf.get_counters().syscalls <= 6);
+        assert(std::memcmp(buf.get_read_pointer(), data.data(), data.size()) == 0);
+
+        // 之后连续的小包让估计值回落
+        buf.read_completed(buf.get_active_size());
+        std::size_t hint = buf.get_recv_hint();
+        uint64_t copied = buf.get_counters().bytes_copied;  // 增长过程中换块搬过已有数据
+        for (int i = 0; i < 10; ++i) {
+            assert(write(fds[1], "ping", 4) == 4);
+            assert(buf.recv(fds[0], &err) == 4);
+            buf.read_completed(4);
+        }
+        assert(buf.get_recv_hint() < hint);
+        assert(buf.get_recv_hint() >= MessageBuffer::MIN_RECV_HINT);
+        assert(buf.get_counters().bytes_copied == copied);  // 读空后直接回到开头，不需要搬移
+    }
+
+    close(fds[0]);
+    close(fds[1]);
+}
+
+// 从fd读满size个字节
+static void read_exact(int fd, uint8_t* out, std::size_t size) {
+    std::size_t got = 0;
+    while (got < size) {
+        ssize_t n = read(fd, out + got, size - got);
+        assert(n > 0);
+        got += n;
+    }
+}
+
+// 测试13：发送路径，部分写入、EAGAIN和合并模式
+void test_send() {
+    int fds[2];
+    assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+
+    // 普通模式: send立即写出并推进读位置
+    MessageBuffer out;
+    const uint8_t msg[] = "hello send path";
+    out.write(msg, sizeof(msg));
+    int err = 0;
+    assert(out.send(fds[0], &err) == static_cast<int>(sizeof(msg)));
+    assert(err == 0);
+    assert(out.get_active_size() == 0);
+    assert(!out.has_pending_send());
+    uint8_t in[sizeof(msg)];
+    read_exact(fds[1], in, sizeof(in));
+    assert(std::memcmp(in, msg, sizeof(msg)) == 0);
+
+    // 合并模式: 多次小写入只在flush时发出一次系统调用
+    out.set_coalescing(true);
+    const uint64_t calls = out.get_counters().syscalls;
+    for (int i = 0; i < 10; ++i) {
+        out.write(reinterpret_cast<const uint8_t*>("0123456789"), 10);
+        assert(out.send(fds[0], &err) == 0);
+    }
+    assert(out.has_pending_send());
+    assert(out.get_counters().syscalls == calls);
+    assert(out.flush(fds[0], &err) == 100);
+    assert(out.get_counters().syscalls == calls + 1);
+    assert(!out.has_pending_send());
+    uint8_t batch[100];
+    read_exact(fds[1], batch, sizeof(batch));
+    assert(std::memcmp(batch + 90, "0123456789", 10) == 0);
+    out.set_coalescing(false);
+
+    // 非阻塞fd写满: 返回已写出的部分，*err为EAGAIN，剩余数据留着下次flush
+    fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+    std::vector<uint8_t> big(4 << 20);
+    for (std::size_t i = 0; i < big.size(); ++i) big[i] = static_cast<uint8_t>(i * 31);
+    out.write(big.data(), big.size());
+    int sent = out.send(fds[0], &err);
+    assert(err == EAGAIN);
+    assert(sent > 0 && static_cast<std::size_t>(sent) < big.size());
+    assert(out.get_active_size() == big.size() - sent);
+    assert(out.has_pending_send());
+    std::vector<uint8_t> echo(big.size());
+    std::thread reader([&echo, fd = fds[1]]() { read_exact(fd, echo.data(), echo.size()); });
+    std::size_t total = sent;
+    while (out.get_active_size() > 0) {
+        int n = out.flush(fds[0], &err);
+        assert(n >= 0);
+        total += n;
+        if (err == EAGAIN) std::this_thread::yield();
+    }
+    reader.join();
+    assert(total == big.size());
+    assert(echo == big);
+    assert(out.get_counters().bytes_written == sizeof(msg) + 100 + big.size());
+
+    // 分块缓冲区: 超过IOV_MAX个块时分多次writev
+    ChunkedBuffer chunks(64);
+    chunks.write(big.data(), 64 * 1500);
+    assert(chunks.get_chunk_count() == 1500);
+    fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) & ~O_NONBLOCK);
+    std::vector<uint8_t> echo2(64 * 1500);
+    std::thread reader2([&echo2, fd = fds[1]]() { read_exact(fd, echo2.data(), echo2.size()); });
+    assert(chunks.send(fds[0], &err) == 64 * 1500);
+    assert(err == 0);
+    reader2.join();
+    assert(std::memcmp(echo2.data(), big.data(), echo2.size()) == 0);
+
+    close(fds[0]);
+    close(fds[1]);
+
+    // 对端已经关闭: 返回EPIPE，进程不会被SIGPIPE杀掉
+    assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    close(fds[1]);
+    out.write(msg, sizeof(msg));
+    assert(out.flush(fds[0], &err) == -1 && err == EPIPE);
+    chunks.write(msg, sizeof(msg));
+    assert(chunks.send(fds[0], &err) == -1 && err == EPIPE);
+    // 溢出到文件的数据走sendfile，同样只返回EPIPE，信号屏蔽字恢复原样
+    MessageBuffer spilled(1024);
+    SpillPolicy spill;
+    spill.threshold = 64 * 1024;
+    spilled.set_spill_policy(spill);
+    spilled.write(big.data(), 256 * 1024);
+    assert(spilled.spilled());
+    assert(spilled.flush(fds[0], &err) == -1 && err == EPIPE);
+    sigset_t mask;
+    assert(pthread_sigmask(SIG_BLOCK, nullptr, &mask) == 0 && !sigismember(&mask, SIGPIPE));
+    assert(sigpending(&mask) == 0 && !sigismember(&mask, SIGPIPE));
+    close(fds[0]);
+
+    // 不是socket时退回write/writev
+    int p[2];
+    assert(pipe(p) == 0);
+    assert(out.flush(p[1], &err) == static_cast<int>(sizeof(msg)) && err == 0);
+    assert(chunks.send(p[1], &err) == static_cast<int>(sizeof(msg)) && err == 0);
+    uint8_t piped[2 * sizeof(msg)];
+    read_exact(p[0], piped, sizeof(piped));
+    assert(std::memcmp(piped, msg, sizeof(msg)) == 0 && std::memcmp(piped + sizeof(msg), msg, sizeof(msg)) == 0);
+    close(p[0]);
+    close(p[1]);
+}
+
+// 测试14：IoLoop在各种后端下的收发语义相同（buffers为0时io_uring直接收进MessageBuffer）
+static void run_io_loop(bool prefer_uring, unsigned buffers) {
+    IoLoop loop(prefer_uring, 256, buffers);
+    assert(loop.valid());
+    if (!prefer_uring) assert(loop.backend() == IoLoop::EPOLL);
+    printf("IoLoop backend: %s, %u provided buffers\n", loop.backend() == IoLoop::URING ? "io_uring" : "epoll", buffers);
+
+    const int CONNS = 4;
+    int pairs[CONNS][2];
+    MessageBuffer in[CONNS];
+    MessageBuffer out[CONNS];
+    for (int i = 0; i < CONNS; ++i) {
+        assert(socketpair(AF_UNIX, SOCK_STREAM, 0, pairs[i]) == 0);
+        assert(loop.add(pairs[i][0], &in[i]));
+    }
+
+    // 对端发送，数据追加到各自连接的MessageBuffer
+    std::vector<uint8_t> payload(20000);
+    for (std::size_t i = 0; i < payload.size(); ++i) payload[i] = static_cast<uint8_t>(i * 3);
+    for (int i = 0; i < CONNS; ++i) {
+        assert(write(pairs[i][1], payload.data(), payload.size()) == static_cast<ssize_t>(payload.size()));
+    }
+    std::size_t received = 0;
+    while (received < payload.size() * CONNS) {
+        loop.poll(1000, [&](int fd, int res) {
+            assert(res > 0);
+            bool known = false;
+            for (int i = 0; i < CONNS; ++i) known = known || pairs[i][0] == fd;
+            assert(known);
+            received += res;
+            });
+    }
+    for (int i = 0; i < CONNS; ++i) {
+        assert(in[i].get_active_size() == payload.size());
+        assert(std::memcmp(in[i].get_read_pointer(), payload.data(), payload.size()) == 0);
+    }
+
+    // 回显: send把数据交给IoLoop，out立即变空，可以继续写
+    for (int i = 0; i < CONNS; ++i) {
+        out[i].write(in[i].get_read_pointer(), in[i].get_active_size());
+        in[i].read_completed(in[i].get_active_size());
+        loop.send(pairs[i][0], out[i]);
+        assert(out[i].get_active_size() == 0);
+        out[i].write(reinterpret_cast<const uint8_t*>("tail"), 4);
+        loop.send(pairs[i][0], out[i]);
+    }
+    std::vector<uint8_t> echo(payload.size() + 4);
+    for (int i = 0; i < CONNS; ++i) {
+        std::size_t got = 0;
+        while (got < echo.size()) {
+            loop.poll(0, [](int, int res) { assert(res > 0); });
+            ssize_t n = recv(pairs[i][1], echo.data() + got, echo.size() - got, MSG_DONTWAIT);
+            if (n > 0) got += n;
+        }
+        assert(std::memcmp(echo.data(), payload.data(), payload.size()) == 0);
+        assert(std::memcmp(echo.data() + payload.size(), "tail", 4) == 0);
+    }
+
+    // send返回后out已经是空的，可以立即析构；remove返回后in也可以析构，内核不会再写入
+    {
+        int sp[2];
+        assert(socketpair(AF_UNIX, SOCK_STREAM, 0, sp) == 0);
+        std::unique_ptr<MessageBuffer> tmp_in(new MessageBuffer());
+        assert(loop.add(sp[0], tmp_in.get()));
+        loop.poll(0, [](int, int) {}); // 把recv提交进内核
+        for (int k = 0; k < 3; ++k) {
+            std::unique_ptr<MessageBuffer> tmp_out(new MessageBuffer());
+            tmp_out->write(payload.data(), payload.size());
+            loop.send(sp[0], *tmp_out);
+            assert(tmp_out->get_active_size() == 0);
+        }
+        std::vector<uint8_t> got(payload.size() * 3);
+        std::size_t n = 0;
+        while (n < got.size()) {
+            loop.poll(0, [](int, int res) { assert(res > 0); });
+            ssize_t r = recv(sp[1], got.data() + n, got.size() - n, MSG_DONTWAIT);
+            if (r > 0) n += r;
+        }
+        for (int k = 0; k < 3; ++k) {
+            assert(std::memcmp(got.data() + k * payload.size(), payload.data(), payload.size()) == 0);
+        }
+        loop.remove(sp[0]);
+        tmp_in.reset();
+        assert(write(sp[1], payload.data(), 100) == 100);
+        loop.poll(0, [&](int fd, int) { assert(fd != sp[0]); });
+        close(sp[0]);
+        close(sp[1]);
+    }
+
+    // 发送失败时丢弃积压的数据，之后的send照样把out取空
+    {
+        int sp[2];
+        assert(socketpair(AF_UNIX, SOCK_STREAM, 0, sp) == 0);
+        if (loop.backend() == IoLoop::EPOLL) fcntl(sp[0], F_SETFL, O_NONBLOCK);
+        MessageBuffer tmp_in;
+        assert(loop.add(sp[0], &tmp_in));
+        std::vector<uint8_t> big(4 << 20, 7);
+        MessageBuffer tmp_out;
+        tmp_out.write(big.data(), big.size());
+        loop.send(sp[0], tmp_out);
+        tmp_out.write(big.data(), 1000);
+        loop.send(sp[0], tmp_out); // 排在正在进行的发送后面
+        assert(tmp_out.get_active_size() == 0);
+        loop.poll(0, [](int, int) {});
+        close(sp[1]);
+        bool failed = false;
+        for (int tries = 0; !failed && tries < 100; ++tries) {
+            loop.poll(100, [&](int fd, int res) { if (fd == sp[0] && res < 0) failed = true; });
+        }
+        assert(failed);
+        tmp_out.write(big.data(), 10);
+        loop.send(sp[0], tmp_out);
+        assert(tmp_out.get_active_size() == 0);
+        loop.poll(0, [](int, int) {});
+        loop.remove(sp[0]);
+        close(sp[0]);
+    }
+
+    // 对端关闭时回调0，remove之后不再回调
+    close(pairs[0][1]);
+    bool closed = false;
+    while (!closed) {
+        loop.poll(1000, [&](int fd, int res) {
+            if (fd == pairs[0][0] && res == 0) closed = true;
+            });
+    }
+    loop.remove(pairs[0][0]);
+    assert(write(pairs[1][1], "x", 1) == 1);
+    bool got_one = false;
+    while (!got_one) {
+        loop.poll(1000, [&](int fd, int res) {
+            assert(fd != pairs[0][0]);
+            if (fd == pairs[1][0] && res > 0) got_one = true;
+            });
+    }
+    for (int i = 1; i < CONNS; ++i) loop.remove(pairs[i][0]);
+    loop.poll(0, [](int, int) {});
+    assert(loop.get_counters().syscalls > 0);
+    for (int i = 0; i < CONNS; ++i) {
+        close(pairs[i][0]);
+        if (i) close(pairs[i][1]);
+    }
+}
+
+void test_io_loop() {
+    run_io_loop(true, 256);
+    run_io_loop(true, 4); // 缓冲区不够用，multishot会因为ENOBUFS停下再重新提交
+    run_io_loop(true, 0);
+    run_io_loop(false, 0);
+
+    // 析构时取消还在内核里的recv和send并等它们结束，之后内核不再读写in和发送的数据
+    for (unsigned buffers : { 0u, 256u }) {
+        int sp[2];
+        assert(socketpair(AF_UNIX, SOCK_STREAM, 0, sp) == 0);
+        std::unique_ptr<MessageBuffer> in(new MessageBuffer());
+        {
+            IoLoop loop(true, 256, buffers);
+            assert(loop.add(sp[0], in.get()));
+            MessageBuffer out;
+            std::vector<uint8_t> big(4 << 20, 9);
+            out.write(big.data(), big.size());
+            loop.send(sp[0], out); // 对端不读，发送停在内核里
+            loop.poll(0, [](int, int) {});
+        }
+        in.reset();
+        assert(write(sp[1], "x", 1) == 1);
+        struct pollfd pfd = { sp[0], POLLIN, 0 };
+        assert(::poll(&pfd, 1, 1000) == 1);
+        char c = 0;
+        assert(read(sp[0], &c, 1) == 1 && c == 'x'); // 没有残留的recv把它收走
+        close(sp[0]);
+        close(sp[1]);
+    }
+}
+
+// 测试15：长度前缀分帧，帧直接指向缓冲区内部，只有尾部放不下残帧时才搬移
+void test_frame_codec() {
+    // 各种前缀宽度和字节序都能原样解回
+    for (unsigned width : { 1u, 2u, 4u, 8u, FrameCodec::VARINT }) {
+        for (bool big_endian : { true, false }) {
+            FrameCodec codec(width, big_endian, 1000);
+            MessageBuffer buf;
+            uint8_t payload[200];
+            for (int i = 0; i < 200; ++i) payload[i] = static_cast<uint8_t>(i);
+            for (std::size_t len : { 0, 1, 127, 128, 200 }) assert(codec.encode(buf, payload, len));
+            FrameView frames[8];
+            assert(codec.decode(buf, frames, 8) == 5);
+            const std::size_t expect[] = { 0, 1, 127, 128, 200 };
+            for (int i = 0; i < 5; ++i) {
+                assert(frames[i].size == expect[i]);
+                assert(std::memcmp(frames[i].data, payload, expect[i]) == 0);
+                assert(frames[i].data >= buf.get_base_pointer() && frames[i].data < buf.get_base_pointer() + buf.get_buffer_size());
+            }
+            assert(buf.get_active_size() == 0);
+        }
+    }
+
+    // 前缀的字节序
+    {
+        uint8_t header[FrameCodec::MAX_VARINT_BYTES];
+        FrameCodec be(4, true), le(2, false), varint(FrameCodec::VARINT);
+        assert(be.write_header(header, 0x01020304) == 4);
+        assert(header[0] == 1 && header[3] == 4);
+        assert(le.write_header(header, 0x0102) == 2);
+        assert(header[0] == 2 && header[1] == 1);
+        assert(varint.write_header(header, 300) == 2);
+        assert(header[0] == 0xac && header[1] == 0x02);
+        uint8_t big[300] = { 0 };
+        MessageBuffer buf;
+        assert(!FrameCodec(1).encode(buf, big, 300)); // 1字节前缀放不下
+        assert(buf.get_active_size() == 0);
+        // 不支持的前缀宽度直接报错，不会当成varint
+        bool thrown = false;
+        try {
+            FrameCodec bad(3);
+        }
+        catch (const std::invalid_argument&) {
+            thrown = true;
+        }
+        assert(thrown);
+    }
+
+    // 帧被拆成任意小段到达，一批里的多个帧一次返回
+    {
+        FrameCodec codec(2);
+        MessageBuffer wire;
+        const uint8_t a[] = "hello", b[] = "frame", c[] = "codec";
+        codec.encode(wire, a, 5);
+        codec.encode(wire, b, 5);
+        codec.encode(wire, c, 5);
+        MessageBuffer buf;
+        FrameView frames[4];
+        int got = 0;
+        for (std::size_t i = 0; i < wire.get_active_size(); ++i) {
+            buf.write(wire.get_read_pointer() + i, 1);
+            const int n = codec.decode(buf, frames, 4);
+            assert(n >= 0);
+            if (n == 1) {
+                assert(frames[0].size == 5);
+                assert(std::memcmp(frames[0].data, got == 0 ? a : got == 1 ? b : c, 5) == 0);
+            }
+            got += n;
+            codec.reserve(buf);
+        }
+        assert(got == 3);
+        assert(codec.missing() == 0);
+
+        // for_each逐帧回调
+        codec.encode(wire, a, 5);
+        int calls = 0;
+        assert(codec.for_each(wire, [&](const uint8_t* data, std::size_t size) {
+            assert(size == 5);
+            assert(std::memcmp(data, calls < 3 ? (calls == 0 ? a : calls == 1 ? b : c) : a, 5) == 0);
+            ++calls;
+            }) == 4);
+        assert(calls == 4);
+    }
+
+    // 只有残帧放不下时才搬移
+    {
+        FrameCodec codec(4, true, 1 << 20);
+        MessageBuffer buf(64);
+        uint8_t payload[64] = { 0 };
+        codec.encode(buf, payload, 20);    // 24字节
+        codec.encode(buf, payload, 20);    // 48字节
+        const uint8_t partial[] = { 0, 0, 0, 8, 1, 2 }; // 8字节的帧只到了2字节
+        buf.write(partial, sizeof(partial));
+        FrameView frames[4];
+        assert(codec.decode(buf, frames, 4) == 2);
+        assert(codec.missing() == 6);
+        const uint64_t copied = buf.get_counters().bytes_copied;
+        codec.reserve(buf);                // 尾部还有10字节，放得下
+        assert(buf.get_read_pos() == 48);
+        assert(buf.get_counters().bytes_copied == copied);
+        const uint8_t rest[] = { 3, 4, 5, 6, 7, 8 };
+        buf.write(rest, sizeof(rest));
+        assert(codec.decode(buf, frames, 4) == 1);
+        assert(frames[0].size == 8 && frames[0].data[0] == 1 && frames[0].data[7] == 8);
+
+        // 56字节处开始一个40字节负载的帧，尾部放不下，残帧搬到开头
+        buf.read_completed(buf.get_active_size());
+        codec.reserve(buf);
+        assert(buf.get_read_pos() == 0);
+        codec.encode(buf, payload, 52);    // 56字节
+        const uint8_t big_header[] = { 0, 0, 0, 40, 9 };
+        buf.write(big_header, sizeof(big_header));
+        assert(codec.decode(buf, frames, 4) == 1);
+        assert(codec.missing() == 39);
+        codec.reserve(buf);
+        assert(buf.get_read_pos() == 0);
+        assert(buf.get_free_size() >= 39);
+        assert(buf.get_active_size() == 5 && buf.get_read_pointer()[4] == 9);
+    }
+
+    // 超过上限和格式错误的varint
+    {
+        FrameCodec codec(4, true, 100);
+        MessageBuffer buf;
+        const uint8_t too_large[] = { 0, 0, 0, 101 };
+        buf.write(too_large, sizeof(too_large));
+        FrameView frames[1];
+        assert(codec.decode(buf, frames, 1) == -1);
+        assert(codec.error() == FrameCodec::TOO_LARGE);
+
+        FrameCodec varint(FrameCodec::VARINT);
+        MessageBuffer bad;
+        const uint8_t overlong[] = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x02 };
+        bad.write(overlong, sizeof(overlong));
+        assert(varint.decode(bad, frames, 1) == -1);
+        assert(varint.error() == FrameCodec::BAD_VARINT);
+    }
+}
+
+// 测试16：引用计数切片，缓冲区要覆盖被引用的数据时才换块
+void test_buffer_slice() {
+    // take不拷贝，切片指向缓冲区内部
+    {
+        MessageBuffer buf;
+        buf.write(reinterpret_cast<const uint8_t*>("hello world"), 11);
+        const uint8_t* base = buf.get_base_pointer();
+        BufferSlice hello = buf.take(5);
+        assert(hello.size() == 5 && hello.data() == base);
+        BufferSlice copy = hello;
+        assert(copy.data() == hello.data());
+        assert(std::memcmp(hello.sub(1, 3).data(), "ell", 3) == 0);
+        assert(hello.sub(4, 2).empty());
+
+        // 读位置要退回开头，块还被引用: 换新块，旧数据原样留给切片
+        buf.normalize();
+        assert(buf.get_base_pointer() != base);
+        assert(buf.get_active_size() == 6 && std::memcmp(buf.get_read_pointer(), " world", 6) == 0);
+        buf.write(reinterpret_cast<const uint8_t*>("XXXXXXXXXX"), 10);
+        assert(std::memcmp(copy.data(), "hello", 5) == 0);
+
+        // 切片都释放之后，块不再共享，normalize原地搬移
+        hello = BufferSlice();
+        copy = BufferSlice();
+        BufferSlice world = buf.take(6);
+        world = BufferSlice();
+        const uint8_t* current = buf.get_base_pointer();
+        buf.normalize();
+        assert(buf.get_base_pointer() == current);
+        assert(buf.get_active_size() == 10 && buf.get_read_pos() == 0);
+
+        assert(buf.slice(buf.get_base_pointer() + 5, 6).empty()); // 超出已写入的范围
+        assert(buf.take(11).empty());
+    }
+
+    // 切片比缓冲区活得久，最后一个切片释放时块回到内存池
+    {
+        BufferSlice kept;
+        {
+            MessageBuffer buf;
+            buf.write(reinterpret_cast<const uint8_t*>("payload"), 7);
+            kept = buf.take(7);
+        }
+        const std::size_t before = BufferPool::local_blocks();
+        assert(std::memcmp(kept.data(), "payload", 7) == 0);
+        kept = BufferSlice();
+        assert(BufferPool::local_blocks() == before + 1);
+    }
+
+    // 解出的帧直接做成切片排队，之后缓冲区继续收数据、扩容都不影响
+    {
+        FrameCodec codec(2);
+        MessageBuffer buf(64);
+        const uint8_t a[] = "first", b[] = "second";
+        codec.encode(buf, a, 5);
+        codec.encode(buf, b, 6);
+        std::vector<BufferSlice> queue;
+        assert(codec.for_each(buf, [&](const uint8_t* data, std::size_t size) {
+            queue.push_back(buf.slice(data, size));
+            }) == 2);
+        std::vector<uint8_t> big(1000, 'z');
+        buf.write(big.data(), big.size());
+        assert(queue[0].size() == 5 && std::memcmp(queue[0].data(), a, 5) == 0);
+        assert(queue[1].size() == 6 && std::memcmp(queue[1].data(), b, 6) == 0);
+    }
+
+    // 切片交给别的线程释放
+    {
+        MessageBuffer buf;
+        std::vector<BufferSlice> slices;
+        for (int i = 0; i < 100; ++i) {
+            buf.write(reinterpret_cast<const uint8_t*>("0123456789"), 10);
+            slices.push_back(buf.take(10));
+            buf.normalize();
+        }
+        std::thread t([moved = std::move(slices)]() mutable {
+            for (auto& s : moved) assert(std::memcmp(s.data(), "0123456789", 10) == 0);
+            moved.clear();
+            });
+        t.join();
+    }
+}
+
+// 测试17：分隔符查找，每种实现都和逐字节的结果一致，跨向量边界的\r\n也能找到
+void test_delimiter_scan() {
+    const uint8_t set[] = { ' ', ':', '\r' };
+    uint32_t seed = 12345;
+    std::vector<uint8_t> data(300);
+    for (DelimiterScan::Isa isa : { DelimiterScan::SCALAR, DelimiterScan::SSE2, DelimiterScan::AVX2 }) {
+        if (!DelimiterScan::use_isa(isa)) continue;
+        assert(DelimiterScan::isa() == isa);
+        for (int round = 0; round < 2000; ++round) {
+            const std::size_t n = round % 200;
+            for (auto& b : data) {
+                seed = seed * 1103515245 + 12345;
+                b = static_cast<uint8_t>('a' + (seed >> 16) % 26);
+            }
+            // 零到三个随机位置放上分隔符的成分，常常只放\r不放\n
+            for (int k = 0; k < round % 4 && n > 0; ++k) {
+                seed = seed * 1103515245 + 12345;
+                const std::size_t at = (seed >> 8) % n;
+                data[at] = (seed & 1) ? '\r' : ((seed & 2) ? '\n' : ':');
+            }
+            if (round % 7 == 0 && n >= 33) { data[31] = '\r'; data[32] = '\n'; } // 跨越AVX2的边界
+            if (round % 11 == 0 && n >= 17) { data[15] = '\r'; data[16] = '\n'; } // 跨越SSE2的边界
+            std::size_t expect_byte = DelimiterScan::NPOS, expect_pair = DelimiterScan::NPOS, expect_any = DelimiterScan::NPOS;
+            for (std::size_t i = 0; i < n; ++i) {
+                if (expect_byte == DelimiterScan::NPOS && data[i] == '\n') expect_byte = i;
+                if (expect_pair == DelimiterScan::NPOS && i + 1 < n && data[i] == '\r' && data[i + 1] == '\n') expect_pair = i;
+                if (expect_any == DelimiterScan::NPOS && (data[i] == ' ' || data[i] == ':' || data[i] == '\r')) expect_any = i;
+            }
+            assert(DelimiterScan::find_byte(data.data(), n, '\n') == expect_byte);
+            assert(DelimiterScan::find_pair(data.data(), n, '\r', '\n') == expect_pair);
+            assert(DelimiterScan::find_any(data.data(), n, set, sizeof(set)) == expect_any);
+        }
+    }
+    DelimiterScan::use_isa(DelimiterScan::supported(DelimiterScan::AVX2) ? DelimiterScan::AVX2 : DelimiterScan::SCALAR);
+
+    // 一行分几次到达，已经扫描过的部分不再重扫，末尾的\r留到下一次和\n一起比较
+    MessageBuffer buf;
+    DelimiterScanner lines;
+    const std::string head(100, 'h');
+    buf.write(reinterpret_cast<const uint8_t*>(head.data()), head.size());
+    assert(lines.next(buf) == DelimiterScan::NPOS);
+    assert(lines.scanned() == 99);
+    buf.write(reinterpret_cast<const uint8_t*>("tail\r"), 5);
+    assert(lines.next(buf) == DelimiterScan::NPOS);
+    assert(lines.scanned() == 104);
+    buf.normalize();
+    buf.write(reinterpret_cast<const uint8_t*>("\nGET /\r\n"), 8);
+    const std::size_t end = lines.next(buf);
+    assert(end == 104);
+    assert(lines.scanned() == 0);
+    buf.read_completed(end + lines.delimiter_size());
+    assert(lines.next(buf) == 5);
+    assert(std::memcmp(buf.get_read_pointer(), "GET /", 5) == 0);
+    buf.read_completed(5 + lines.delimiter_size());
+    assert(lines.next(buf) == DelimiterScan::NPOS);
+
+    DelimiterScanner tokens = DelimiterScanner::any(set, sizeof(set));
+    buf.write(reinterpret_cast<const uint8_t*>("key:value"), 9);
+    assert(tokens.next(buf) == 3);
+    DelimiterScanner nl = DelimiterScanner::byte('\n');
+    assert(nl.next(buf) == DelimiterScan::NPOS && nl.scanned() == 9);
+}
+
+// 测试18：CRC32C和Internet校验和，分段、分散区域和增量计算的结果与一次算完相同
+void test_checksum() {
+    const uint8_t check[] = "123456789";
+    std::vector<uint8_t> data(3 * 8192 * 2 + 3 * 256 + 77);
+    uint32_t seed = 99;
+    for (auto& b : data) {
+        seed = seed * 1103515245 + 12345;
+        b = static_cast<uint8_t>(seed >> 16);
+    }
+    for (bool hw : { false, true }) {
+        if (!Crc32c::use_hardware(hw)) continue;
+        assert(Crc32c::hardware() == hw);
+        assert(Crc32c::compute(check, 9) == 0xe3069283);
+        std::vector<uint8_t> zeros(32, 0), ones(32, 0xff);
+        assert(Crc32c::compute(zeros.data(), 32) == 0x8a9136aa);
+        assert(Crc32c::compute(ones.data(), 32) == 0x62a8ab43);
+        assert(Crc32c::extend(Crc32c::compute(check, 4), check + 4, 5) == 0xe3069283);
+    }
+    // 两种实现在各种长度和对齐上一致，覆盖三路交错的长块和短块
+    for (std::size_t len : { 0, 1, 7, 8, 63, 767, 768, 1000, 24575, 24576, 24576 + 768 + 5, 49152 + 845 }) {
+        for (std::size_t off : { 0, 1, 3 }) {
+            if (off + len > data.size()) continue;
+            Crc32c::use_hardware(false);
+            const uint32_t sw = Crc32c::compute(data.data() + off, len);
+            if (Crc32c::use_hardware(true)) assert(Crc32c::compute(data.data() + off, len) == sw);
+        }
+    }
+    Crc32c::use_hardware(true);
+
+    // 分散的区域
+    const uint32_t whole = Crc32c::compute(data.data(), data.size());
+    struct iovec iov[3];
+    iov[0].iov_base = data.data();
+    iov[0].iov_len = 1001;
+    iov[1].iov_base = data.data() + 1001;
+    iov[1].iov_len = 30000;
+    iov[2].iov_base = data.data() + 31001;
+    iov[2].iov_len = data.size() - 31001;
+    assert(Crc32c::extend(0, iov, 3) == whole);
+
+    // 数据一段段写进缓冲区，每次只算新增的部分；帧结束的位置之后的数据不计入
+    {
+        MessageBuffer buf(64);
+        Crc32c crc;
+        const std::size_t frame = 40000;
+        std::size_t off = 0;
+        while (off < data.size()) {
+            const std::size_t n = std::min<std::size_t>(1448, data.size() - off);
+            buf.write(data.data() + off, n);
+            off += n;
+            crc.update(buf, frame);
+        }
+        assert(crc.covered() == frame);
+        assert(crc.value() == Crc32c::compute(data.data(), frame));
+        buf.read_completed(frame);
+        crc.consumed(frame);
+        assert(crc.covered() == 0);
+        crc.reset();
+        crc.update(buf);
+        assert(crc.value() == Crc32c::compute(data.data() + frame, data.size() - frame));
+    }
+
+    // RFC 1071里的例子
+    const uint8_t rfc[] = { 0x00, 0x01, 0xf2, 0x03, 0xf4, 0xf5, 0xf6, 0xf7 };
+    assert(InternetChecksum::compute(rfc, sizeof(rfc)) == static_cast<uint16_t>(~0xddf2));
+    for (std::size_t len : { 0, 1, 2, 3, 9, 100, 1001 }) {
+        uint32_t ref = 0;
+        for (std::size_t i = 0; i < len; i += 2) ref += (data[i] << 8) | (i + 1 < len ? data[i + 1] : 0);
+        while (ref >> 16) ref = (ref & 0xffff) + (ref >> 16);
+        const uint16_t sum = InternetChecksum::compute(data.data(), len);
+        assert(sum == static_cast<uint16_t>(~ref));
+        // 奇数长度的分段增量累加
+        InternetChecksum inc;
+        for (std::size_t i = 0; i < len; i += 3) inc.update(data.data() + i, std::min<std::size_t>(3, len - i));
+        assert(inc.value() == sum);
+    }
+    // 把校验和追加到数据后面，整体的校验和为0
+    std::vector<uint8_t> packet(data.begin(), data.begin() + 100);
+    const uint16_t sum = InternetChecksum::compute(packet.data(), packet.size());
+    packet.push_back(static_cast<uint8_t>(sum >> 8));
+    packet.push_back(static_cast<uint8_t>(sum));
+    assert(InternetChecksum::compute(packet.data(), packet.size()) == 0);
+}
+
+// 测试19：空闲回收，缩回初始大小、madvise整页，retained_bytes跟着增减
+void test_reclaim() {
+    const std::size_t base = MessageBuffer::retained_bytes();
+    std::vector<uint8_t> burst(256 * 1024, 'x');
+
+    // 默认策略不回收，突发之后的大块一直保留
+    {
+        MessageBuffer buf(1024);
+        assert(MessageBuffer::retained_bytes() == base + buf.get_capacity());
+        buf.write(burst.data(), burst.size());
+        buf.read_completed(burst.size());
+        assert(buf.tick() == 0 && buf.get_capacity() >= burst.size());
+        assert(MessageBuffer::retained_bytes() == base + buf.get_capacity());
+    }
+    assert(MessageBuffer::retained_bytes() == base);
+
+    // 连续idle_cycles次空闲之后换回初始大小的块
+    {
+        MessageBuffer buf(1024);
+        ReclaimPolicy policy;
+        policy.shrink_threshold = 64 * 1024;
+        policy.idle_cycles = 2;
+        buf.set_reclaim_policy(policy);
+        buf.write(burst.data(), burst.size());
+        const std::size_t big = buf.get_capacity();
+        assert(buf.tick() == 0); // 还有数据，不算空闲
+        buf.read_completed(burst.size());
+        assert(buf.tick() == 0 && buf.tick() == 0);
+        assert(buf.tick() == big - 1024);
+        assert(buf.get_capacity() == 1024 && buf.get_buffer_size() == 1024);
+        assert(MessageBuffer::retained_bytes() == base + 1024);
+        assert(buf.tick() == 0); // 已经收缩过，没有额外开销
+        buf.write(burst.data(), 10);
+        assert(buf.get_active_size() == 10 && std::memcmp(buf.get_read_pointer(), burst.data(), 10) == 0);
+    }
+    assert(MessageBuffer::retained_bytes() == base);
+
+    // 不收缩的大块madvise掉整页，之后继续写入时重新计入
+    {
+        MessageBuffer buf(256 * 1024);
+        ReclaimPolicy policy;
+        policy.advise_threshold = 128 * 1024;
+        policy.lazy_free = true;
+        buf.set_reclaim_policy(policy);
+        buf.write(burst.data(), burst.size());
+        buf.read_completed(burst.size());
+        const std::size_t released = buf.reclaim();
+        assert(released > 0 && released <= buf.get_capacity());
+        assert(MessageBuffer::retained_bytes() == base + buf.get_capacity() - released);
+        assert(buf.reclaim() == 0);
+        buf.write(burst.data(), 100);
+        assert(MessageBuffer::retained_bytes() == base + buf.get_capacity());
+        assert(std::memcmp(buf.get_read_pointer(), burst.data(), 100) == 0);
+    }
+    assert(MessageBuffer::retained_bytes() == base);
+
+    // retain_limit: 没读空也把剩下的少量数据搬进小块
+    {
+        MessageBuffer buf(1024);
+        ReclaimPolicy policy;
+        policy.retain_limit = 16 * 1024;
+        buf.set_reclaim_policy(policy);
+        buf.write(burst.data(), burst.size());
+        buf.read_completed(burst.size() - 3000);
+        assert(buf.reclaim() > 0);
+        assert(buf.get_capacity() <= 16 * 1024 && buf.get_active_size() == 3000);
+        assert(std::memcmp(buf.get_read_pointer(), burst.data() + burst.size() - 3000, 3000) == 0);
+        assert(MessageBuffer::retained_bytes() == base + buf.get_capacity());
+    }
+
+    // 块还被切片引用时收缩，旧块留给切片，不madvise
+    {
+        BufferSlice kept;
+        {
+            MessageBuffer buf(1024);
+            ReclaimPolicy policy;
+            policy.shrink_threshold = 64 * 1024;
+            policy.advise_threshold = 64 * 1024;
+            buf.set_reclaim_policy(policy);
+            buf.write(burst.data(), burst.size());
+            kept = buf.take(burst.size());
+            assert(buf.tick() > 0 && buf.get_capacity() == 1024);
+            assert(MessageBuffer::retained_bytes() == base + 1024);
+        }
+        assert(kept.size() == burst.size() && std::memcmp(kept.data(), burst.data(), burst.size()) == 0);
+    }
+
+    // 移动之后统计不变
+    {
+        MessageBuffer a(4096);
+        MessageBuffer b(std::move(a));
+        MessageBuffer c(1024);
+        c = std::move(b);
+        assert(MessageBuffer::retained_bytes() == base + 4096);
+    }
+    assert(MessageBuffer::retained_bytes() == base);
+}
+
+// 测试20：溢出到文件，扩容不拷贝，读过的整块打洞，读空后回到内存块
+void test_spill() {
+    std::vector<uint8_t> data(3 * MessageBuffer::SPILL_CHUNK + 12345);
+    for (std::size_t i = 0; i < data.size(); ++i) data[i] = static_cast<uint8_t>(i * 7 + (i >> 12));
+    const std::size_t base = MessageBuffer::retained_bytes();
+
+    // 超过阈值之后数据搬进文件，扩容不再拷贝，不计入retained_bytes
+    {
+        MessageBuffer buf(1024);
+        SpillPolicy policy;
+        policy.threshold = 64 * 1024;
+        buf.set_spill_policy(policy);
+        std::size_t off = 0;
+        while (off < 32 * 1024) {
+            buf.write(data.data() + off, 1448);
+            off += 1448;
+        }
+        assert(!buf.spilled() && buf.get_spill_fd() == -1);
+        while (off < data.size()) {
+            const std::size_t n = std::min<std::size_t>(1448, data.size() - off);
+            buf.write(data.data() + off, n);
+            off += n;
+        }
+        assert(buf.spilled() && buf.get_spill_fd() >= 0);
+        assert(MessageBuffer::retained_bytes() == base);
+        assert(buf.get_counters().bytes_copied < 128 * 1024); // 只有溢出前在内存里的那部分被拷过
+        assert(buf.get_active_size() == data.size());
+        assert(std::memcmp(buf.get_read_pointer(), data.data(), data.size()) == 0);
+
+        // 读过的整块在文件上打洞
+        buf.read_completed(MessageBuffer::SPILL_CHUNK + 100);
+        buf.ensure_free_space(2 * MessageBuffer::SPILL_CHUNK);
+        struct stat st;
+        assert(fstat(buf.get_spill_fd(), &st) == 0);
+        assert(static_cast<std::size_t>(st.st_blocks) * 512 <= static_cast<std::size_t>(st.st_size) - MessageBuffer::SPILL_CHUNK);
+        assert(buf.get_spill_offset() == MessageBuffer::SPILL_CHUNK + 100);
+        assert(std::memcmp(buf.get_read_pointer(), data.data() + buf.get_spill_offset(), buf.get_active_size()) == 0);
+
+        // 切片比缓冲区活得久，映射留给切片
+        BufferSlice tail = buf.take(1000);
+        assert(std::memcmp(tail.data(), data.data() + MessageBuffer::SPILL_CHUNK + 100, 1000) == 0);
+
+        // flush用sendfile从文件发出剩余的数据
+        const int out = memfd_create("spill_out", MFD_CLOEXEC);
+        assert(out >= 0);
+        const std::size_t rest = buf.get_active_size();
+        int err = 0;
+        assert(buf.flush(out, &err) == static_cast<int>(rest) && err == 0);
+        std::vector<uint8_t> sent(rest);
+        assert(pread(out, sent.data(), rest, 0) == static_cast<ssize_t>(rest));
+        assert(std::memcmp(sent.data(), data.data() + data.size() - rest, rest) == 0);
+        close(out);
+
+        // 读空之后回到初始大小的内存块
+        buf.normalize();
+        assert(!buf.spilled() && buf.get_capacity() == 1024 && buf.get_buffer_size() == 1024);
+        assert(MessageBuffer::retained_bytes() == base + 1024);
+        assert(std::memcmp(tail.data(), data.data() + MessageBuffer::SPILL_CHUNK + 100, 1000) == 0);
+        buf.write(data.data(), 10);
+        assert(std::memcmp(buf.get_read_pointer(), data.data(), 10) == 0);
+    }
+    assert(MessageBuffer::retained_bytes() == base);
+
+    // 剩余数据不多于已读数据时搬到文件开头，地址空间不会一直往后用
+    {
+        MessageBuffer buf(1024);
+        SpillPolicy policy;
+        policy.threshold = 64 * 1024;
+        policy.limit = 4 * MessageBuffer::SPILL_CHUNK;
+        buf.set_spill_policy(policy);
+        std::size_t in = 0, out = 0;
+        for (int round = 0; round < 40; ++round) {
+            const std::size_t n = 500 * 1024;
+            for (std::size_t i = 0; i < n; i += 1448) {
+                const std::size_t m = std::min<std::size_t>(1448, n - i);
+                buf.write(data.data() + (in + i) % (data.size() - 2000), m);
+            }
+            in += n;
+            const std::size_t consume = buf.get_active_size() - 1000;
+            buf.read_completed(consume);
+            out += consume;
+        }
+        assert(buf.spilled() && buf.get_active_size() == in - out);
+        // 超过limit时抛bad_alloc
+        bool thrown = false;
+        try {
+            buf.ensure_free_space(5 * MessageBuffer::SPILL_CHUNK);
+        }
+        catch (const std::bad_alloc&) {
+            thrown = true;
+        }
+        assert(thrown);
+    }
+
+    // 溢出的缓冲区读空后reclaim也回到内存块，移动之后照常释放
+    {
+        MessageBuffer buf(4096);
+        SpillPolicy policy;
+        policy.threshold = 64 * 1024;
+        buf.set_spill_policy(policy);
+        buf.write(data.data(), 200 * 1024);
+        MessageBuffer moved(std::move(buf));
+        assert(moved.spilled() && !buf.spilled());
+        moved.read_completed(200 * 1024);
+        moved.reclaim();
+        assert(!moved.spilled() && moved.get_capacity() == 4096);
+    }
+    assert(MessageBuffer::retained_bytes() == base);
+
+    // 溢出且没读空时retain_limit不把文件里的数据搬回内存，只给读过的整块打洞
+    {
+        MessageBuffer buf(4096);
+        SpillPolicy policy;
+        policy.threshold = 64 * 1024;
+        buf.set_spill_policy(policy);
+        ReclaimPolicy reclaim;
+        reclaim.retain_limit = 16 * 1024;
+        buf.set_reclaim_policy(reclaim);
+        for (int i = 0; i < 3; ++i) buf.write(data.data(), data.size());
+        buf.read_completed(2 * data.size());
+        const std::size_t capacity = buf.get_capacity();
+        assert(buf.reclaim() == 0);
+        assert(buf.spilled() && buf.get_capacity() == capacity);
+        assert(MessageBuffer::retained_bytes() == base);
+        assert(buf.get_active_size() == data.size());
+        assert(std::memcmp(buf.get_read_pointer(), data.data(), data.size()) == 0);
+        struct stat st;
+        assert(fstat(buf.get_spill_fd(), &st) == 0);
+        assert(static_cast<std::size_t>(st.st_blocks) * 512 <= static_cast<std::size_t>(st.st_size) - 2 * MessageBuffer::SPILL_CHUNK);
+    }
+    assert(MessageBuffer::retained_bytes() == base);
+}
+
+// 回环上的一对TCP连接，MSG_ZEROCOPY只支持TCP/UDP；rcvbuf非0时在握手之前设置fds[1]的接收缓冲区
+static void tcp_pair(int fds[2], int rcvbuf = 0) {
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    assert(listener >= 0);
+    if (rcvbuf) assert(setsockopt(listener, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf)) == 0);
+    struct sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    assert(bind(listener, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) == 0);
+    socklen_t len = sizeof(addr);
+    assert(getsockname(listener, reinterpret_cast<struct sockaddr*>(&addr), &len) == 0);
+    assert(listen(listener, 1) == 0);
+    fds[0] = socket(AF_INET, SOCK_STREAM, 0);
+    assert(connect(fds[0], reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) == 0);
+    fds[1] = accept(listener, nullptr, nullptr);
+    assert(fds[1] >= 0);
+    close(listener);
+    fcntl(fds[0], F_SETFL, O_NONBLOCK);
+    fcntl(fds[1], F_SETFL, O_NONBLOCK);
+}
+
+// 从fd读到want字节为止
+static std::vector<uint8_t> read_exactly(int fd, std::size_t want) {
+    std::vector<uint8_t> got;
+    uint8_t tmp[65536];
+    for (int tries = 0; got.size() < want && tries < 100000; ++tries) {
+        const ssize_t n = read(fd, tmp, sizeof(tmp));
+        if (n > 0) got.insert(got.end(), tmp, tmp + n);
+        else usleep(100);
+    }
+    return got;
+}
+
+// 测试21：转发，splice不进用户态，MSG_ZEROCOPY的切片留到完成通知才释放
+void test_forwarder() {
+    std::vector<uint8_t> data(300 * 1024);
+    for (std::size_t i = 0; i < data.size(); ++i) data[i] = static_cast<uint8_t>(i * 13 + (i >> 10));
+
+    // splice: src -> pipe -> dst，数据不进用户态
+    {
+        int a[2], b[2];
+        tcp_pair(a);
+        tcp_pair(b);
+        Forwarder fw(a[1], b[0]);
+        assert(fw.splicing());
+        int err = 0;
+        assert(fw.forward(&err) == -1 && err == EAGAIN);
+        std::vector<uint8_t> got;
+        std::size_t written = 0;
+        for (int tries = 0; got.size() < data.size() && tries < 100000; ++tries) {
+            if (written < data.size()) {
+                const ssize_t n = write(a[0], data.data() + written, std::min<std::size_t>(8192, data.size() - written));
+                if (n > 0) written += n;
+            }
+            fw.forward(&err, 16384); // 配额小于数据量，也可能因为dst写满留在pipe里
+            uint8_t tmp[65536];
+            const ssize_t n = read(b[1], tmp, sizeof(tmp));
+            if (n > 0) got.insert(got.end(), tmp, tmp + n);
+        }
+        assert(got == data);
+        assert(fw.get_counters().bytes_spliced == data.size() && fw.get_counters().bytes_copied == 0);
+        assert(fw.pending() == 0);
+
+        // 对端关闭写之后返回0
+        shutdown(a[0], SHUT_WR);
+        int n = -1;
+        for (int tries = 0; tries < 1000 && n != 0; ++tries) {
+            n = fw.forward(&err);
+            if (n != 0) usleep(100);
+        }
+        assert(n == 0 && err == 0);
+        close(a[0]); close(a[1]); close(b[0]); close(b[1]);
+    }
+
+    // src不支持splice（eventfd）时退回拷贝路径
+    {
+        const int src = eventfd(42, EFD_NONBLOCK);
+        int fds[2];
+        assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+        Forwarder fw(src, fds[0]);
+        int err = 0;
+        assert(fw.forward(&err) == 8);
+        assert(!fw.splicing() && err == EAGAIN);
+        uint64_t value = 0;
+        assert(read(fds[1], &value, sizeof(value)) == 8 && value == 42);
+        assert(fw.get_counters().bytes_copied == 8 && fw.get_counters().bytes_spliced == 0);
+        assert(fw.forward(&err) == -1 && err == EAGAIN);
+        close(src); close(fds[0]); close(fds[1]);
+    }
+
+    // MSG_ZEROCOPY: 发出的数据做成切片留到完成通知，期间buf照常写入
+    {
+        int a[2];
+        tcp_pair(a);
+        Forwarder fw(-1, a[0]);
+        MessageBuffer buf;
+        int err = 0;
+        if (!fw.zerocopy()) {
+            printf("SO_ZEROCOPY unavailable, zerocopy send not tested\n");
+        }
+        buf.write(data.data(), 100);
+        assert(fw.send(buf, &err) == 100 && fw.zerocopy_pending() == 0); // 小于阈值直接拷贝
+        buf.write(data.data() + 100, 64 * 1024);
+        const uint8_t* sent_from = buf.get_read_pointer();
+        const int n = fw.send(buf, &err);
+        assert(n > 0);
+        if (fw.zerocopy()) {
+            assert(fw.zerocopy_pending() > 0);
+            buf.write(data.data(), 64 * 1024); // 块还被切片引用，换新块写入
+            assert(buf.get_read_pointer() != sent_from || static_cast<std::size_t>(n) < 64 * 1024);
+        }
+        else {
+            buf.write(data.data(), 64 * 1024);
+        }
+        std::vector<uint8_t> got = read_exactly(a[1], 100 + static_cast<std::size_t>(n));
+        assert(got.size() == 100 + static_cast<std::size_t>(n));
+        assert(std::memcmp(got.data(), data.data(), got.size()) == 0);
+        assert(fw.drain(5000) && fw.zerocopy_pending() == 0);
+        const ForwardCounters& c = fw.get_counters();
+        assert(c.bytes_zerocopy + c.bytes_zerocopy_copied + c.bytes_copied == 100 + static_cast<std::size_t>(n));
+        // 回环上内核总是拷贝，收到通知之后不再用MSG_ZEROCOPY
+        if (c.bytes_zerocopy_copied > 0) assert(!fw.zerocopy());
+        close(a[0]); close(a[1]);
+    }
+
+    // 析构时还有未确认的零拷贝发送，等通知到了才把块还给池子
+    {
+        int a[2];
+        tcp_pair(a);
+        int n = 0;
+        {
+            Forwarder fw(-1, a[0]);
+            MessageBuffer buf;
+            int err = 0;
+            buf.write(data.data(), 64 * 1024);
+            n = fw.send(buf, &err);
+            assert(n > 0);
+        }
+        std::vector<uint8_t> got = read_exactly(a[1], static_cast<std::size_t>(n));
+        assert(got.size() == static_cast<std::size_t>(n));
+        assert(std::memcmp(got.data(), data.data(), got.size()) == 0);
+        close(a[0]); close(a[1]);
+    }
+
+    // 对端不读、接收窗口满了，通知一直不来: 析构只等drain_timeout_ms，剩下的交给孤儿列表，对端读走之后释放
+    {
+        int a[2];
+        tcp_pair(a, 64 * 1024);
+        ForwardOptions options;
+        options.drain_timeout_ms = 50;
+        std::size_t sent = 0;
+        bool stalled = false;
+        std::chrono::steady_clock::time_point start;
+        {
+            Forwarder fw(-1, a[0], options);
+            MessageBuffer buf;
+            for (int i = 0; i < 8; ++i) buf.write(data.data(), data.size());
+            int err = 0;
+            const int n = fw.send(buf, &err);
+            assert(n > 0);
+            sent = static_cast<std::size_t>(n);
+            fw.reap();
+            stalled = fw.zerocopy_pending() > 0;
+            if (!fw.zerocopy() && !stalled) {
+                printf("SO_ZEROCOPY unavailable, stalled zerocopy send not tested\n");
+            }
+            if (stalled) assert(!fw.drain(10));
+            start = std::chrono::steady_clock::now();
+        }
+        assert(std::chrono::steady_clock::now() - start < std::chrono::seconds(1));
+        if (stalled) assert(Forwarder::reap_orphans() > 0);
+        std::vector<uint8_t> got = read_exactly(a[1], sent);
+        assert(got.size() == sent);
+        for (std::size_t off = 0; off < sent; off += data.size()) {
+            const std::size_t m = std::min(data.size(), sent - off);
+            assert(std::memcmp(got.data() + off, data.data(), m) == 0);
+        }
+        for (int tries = 0; Forwarder::reap_orphans() > 0 && tries < 10000; ++tries) usleep(100);
+        assert(Forwarder::reap_orphans() == 0);
+        close(a[0]); close(a[1]);
+    }
+}
+
 int main() {
     test_initialization();
     test_write_read();
@@ -136,6 +1528,21 @@ int main() {
     test_ensure_free_space();
     test_recv();
     test_move_semantics();
+    test_mirror_buffer();
+    test_mirror_buffer_spsc();
+    test_chunked_buffer();
+    test_chunked_buffer_io();
+    test_buffer_pool();
+    test_recv_sizing();
+    test_send();
+    test_io_loop();
+    test_frame_codec();
+    test_buffer_slice();
+    test_delimiter_scan();
+    test_checksum();
+    test_reclaim();
+    test_spill();
+    test_forwarder();
 
     printf("All tests passed!\n");
     return 0;
@@ -0,0 +1,157 @@
+#ifndef __BROADCAST_RING_HPP__
+#define __BROADCAST_RING_HPP__
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <utility>
+#include <initializer_list>
+
+/*
+ * Disruptor风格的单生产者多消费者广播环形缓冲区
+ * 每个事件只发布一次，每个消费者用自己的序号（独占一个cacheline）按自己的节奏读取全部事件；
+ * 消费者可以依赖其他消费者，只有依赖的阶段处理完某个事件之后才能处理它，从而串成流水线
+ * 生产者只受最慢的消费者限制；槽位在构造时一次性默认构造，之后每一圈都在原地复用，不会析构再构造
+ * 所有消费者都要在生产者开始发布之前通过add_consumer注册
+ */
+template <typename T, std::size_t Capacity>
+class BroadcastRing
+{
+public:
+	static_assert(Capacity && !(Capacity & (Capacity - 1)), "Capacity must be power of 2");
+
+	class Consumer
+	{
+	public:
+		/*下一个要处理的序号，也就是已经处理完的事件个数*/
+		uint64_t sequence() const {
+			return sequence_.load(std::memory_order_acquire);
+		}
+
+	private:
+		friend class BroadcastRing;
+		Consumer() : sequence_(0), available_cache_(0) {}
+
+		/*Consumer是堆上分配的，C++17之前new不保证alignas(64)，所以前后用填充把序号隔离在独立的cacheline里*/
+		char pad_before_[64];
+		std::atomic<uint64_t> sequence_; /*只由消费者自己写，生产者和下游阶段读取*/
+		uint64_t available_cache_;       /*上次看到的可处理上界，只有消费者自己访问*/
+		std::vector<const Consumer*> deps_;
+		char pad_after_[64];
+	};
+
+	BroadcastRing() : slots_(new T[Capacity]), next_(0), gating_cache_(0), published_(0) {}
+
+	BroadcastRing(const BroadcastRing&) = delete;
+	BroadcastRing& operator=(const BroadcastRing&) = delete;
+
+	/*注册一个消费者，deps中的消费者处理完的事件它才能处理；没有依赖时直接跟在生产者后面*/
+	Consumer* add_consumer(std::initializer_list<const Consumer*> deps = {}) {
+		consumers_.emplace_back(new Consumer());
+		Consumer* c = consumers_.back().get();
+		c->deps_.assign(deps.begin(), deps.end());
+		/*被依赖的消费者一定不会比依赖它的消费者慢，生产者只需要检查流水线末端的消费者*/
+		for (const Consumer* dep : deps) {
+			for (auto it = gating_.begin(); it != gating_.end(); ++it) {
+				if (*it == dep) {
+					gating_.erase(it);
+					break;
+				}
+			}
+		}
+		gating_.push_back(c);
+		return c;
+	}
+
+	/*
+	 * 生产者: 取得下一个槽位的引用，槽位里是上一圈留下的对象，直接在原地修改
+	 * 所有消费者都还没处理完上一圈的这个槽位时返回nullptr；写完后调用publish()
+	 */
+	T* try_claim() {
+		if (next_ - gating_cache_ >= Capacity) {
+			gating_cache_ = min_gating_sequence();
+			if (next_ - gating_cache_ >= Capacity) {
+				return nullptr;
+			}
+		}
+		return &slots_[next_ & (Capacity - 1)];
+	}
+
+	/*发布try_claim得到的槽位*/
+	void publish() {
+		++next_;
+		published_.store(next_, std::memory_order_release);
+	}
+
+	template<typename U>
+	bool push(U&& value) {
+		T* slot = try_claim();
+		if (nullptr == slot) {
+			return false;
+		}
+		*slot = std::forward<U>(value); /*赋值到已有对象上，复用它已经持有的资源*/
+		publish();
+		return true;
+	}
+
+	/*
+	 * 消费者: 就地处理最多max个可处理的事件，f(T& event, uint64_t sequence)
+	 * 可处理的上界是生产者的发布位置和所有依赖阶段序号中的最小值；处理完一批后只做一次release发布
+	 * 平行（互不依赖）的消费者会同时读到同一个事件，只有位于依赖链上的阶段才可以修改事件
+	 */
+	template<typename F>
+	std::size_t poll(Consumer* c, F&& f, std::size_t max = Capacity) {
+		const uint64_t seq = c->sequence_.load(std::memory_order_relaxed);
+		if (c->available_cache_ == seq) {
+			c->available_cache_ = available_for(c);
+			if (c->available_cache_ == seq) {
+				return 0;
+			}
+		}
+		uint64_t end = c->available_cache_;
+		if (end - seq > max) {
+			end = seq + max;
+		}
+		for (uint64_t s = seq; s != end; ++s) {
+			f(slots_[s & (Capacity - 1)], s);
+		}
+		c->sequence_.store(end, std::memory_order_release);
+		return static_cast<std::size_t>(end - seq);
+	}
+
+	/*已经发布的事件总数*/
+	uint64_t published() const {
+		return published_.load(std::memory_order_acquire);
+	}
+
+private:
+	uint64_t available_for(const Consumer* c) const {
+		uint64_t avail = published_.load(std::memory_order_acquire);
+		for (const Consumer* dep : c->deps_) {
+			const uint64_t s = dep->sequence_.load(std::memory_order_acquire);
+			if (s < avail) avail = s;
+		}
+		return avail;
+	}
+
+	uint64_t min_gating_sequence() const {
+		uint64_t min = next_;
+		for (const Consumer* c : gating_) {
+			const uint64_t s = c->sequence_.load(std::memory_order_acquire);
+			if (s < min) min = s;
+		}
+		return min;
+	}
+
+	std::unique_ptr<T[]> slots_;
+	std::vector<std::unique_ptr<Consumer>> consumers_;
+	std::vector<const Consumer*> gating_;
+	/*下面两个只有生产者访问*/
+	alignas(64) uint64_t next_;
+	uint64_t gating_cache_;
+	alignas(64) std::atomic<uint64_t> published_;
+};
+
+#endif
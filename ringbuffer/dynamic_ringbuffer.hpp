@@ -0,0 +1,152 @@
+#ifndef __DYNAMIC_RINGBUFFER_HPP__
+#define __DYNAMIC_RINGBUFFER_HPP__
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <unistd.h>
+#include <sys/mman.h>
+
+/*DynamicRingBuffer槽位数组的分配方式*/
+struct RingAllocOptions
+{
+	bool huge_pages = false; /*先尝试MAP_HUGETLB，失败后退回普通页并madvise(MADV_HUGEPAGE)*/
+	bool prefault = true;    /*构造时把每一页都写一遍，第一波数据不会触发缺页*/
+};
+
+/*
+ * 运行时决定容量的SPSC RingBuffer，语义与RingBuffer相同
+ * 槽位数组单独用mmap分配，不会占用栈或者撑大宿主对象；容量向上取整为2的幂，继续用掩码取模
+ * 下标缓存与RingBuffer的CacheIndex=true相同
+ */
+template <typename T>
+class DynamicRingBuffer
+{
+public:
+	explicit DynamicRingBuffer(std::size_t capacity, const RingAllocOptions& options = RingAllocOptions())
+		: slots_(nullptr), mask_(0), map_size_(0), huge_(false),
+		read_(0), write_cache_(0), write_(0), read_cache_(0)
+	{
+		std::size_t cap = 2;
+		while (cap < capacity) cap <<= 1;
+		allocate(cap, options);
+	}
+
+	~DynamicRingBuffer() {
+		if (nullptr == slots_) return;
+		std::size_t r = read_.load(std::memory_order_relaxed);
+		const std::size_t w = write_.load(std::memory_order_relaxed);
+		while (r != w) {
+			slot(r)->~T();
+			r = (r + 1) & mask_;
+		}
+		munmap(slots_, map_size_);
+	}
+
+	DynamicRingBuffer(const DynamicRingBuffer&) = delete;
+	DynamicRingBuffer& operator=(const DynamicRingBuffer&) = delete;
+
+	/*mmap失败时为false*/
+	bool valid() const {
+		return slots_ != nullptr;
+	}
+
+	/*与RingBuffer一样需要空出一个槽位，最多容纳capacity() - 1个元素*/
+	std::size_t capacity() const {
+		return mask_ + 1;
+	}
+
+	/*是否真正拿到了MAP_HUGETLB的大页*/
+	bool huge_pages() const {
+		return huge_;
+	}
+
+	template<typename U>
+	bool push(U&& value) {
+		const std::size_t w = write_.load(std::memory_order_relaxed);
+		const std::size_t next_w = (w + 1) & mask_;
+		if (next_w == read_cache_) {
+			read_cache_ = read_.load(std::memory_order_acquire);
+			if (next_w == read_cache_) {
+				return false;
+			}
+		}
+		new (slot(w)) T(std::forward<U>(value));
+		write_.store(next_w, std::memory_order_release);
+		return true;
+	}
+
+	bool pop(T& value) {
+		const std::size_t r = read_.load(std::memory_order_relaxed);
+		if (r == write_cache_) {
+			write_cache_ = write_.load(std::memory_order_acquire);
+			if (r == write_cache_) {
+				return false;
+			}
+		}
+		T* elem = slot(r);
+		value = std::move(*elem);
+		elem->~T();
+		read_.store((r + 1) & mask_, std::memory_order_release);
+		return true;
+	}
+
+	std::size_t size() const {
+		const std::size_t r = read_.load(std::memory_order_acquire);
+		const std::size_t w = write_.load(std::memory_order_acquire);
+		return (w - r) & mask_;
+	}
+
+private:
+	T* slot(std::size_t i) const {
+		return slots_ + i;
+	}
+
+	void allocate(std::size_t cap, const RingAllocOptions& options) {
+		const std::size_t page = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+		const std::size_t huge_page = 2 * 1024 * 1024;
+		const std::size_t bytes = cap * sizeof(T);
+		void* addr = MAP_FAILED;
+		if (options.huge_pages) {
+			map_size_ = (bytes + huge_page - 1) & ~(huge_page - 1);
+			addr = mmap(nullptr, map_size_, PROT_READ | PROT_WRITE,
+				MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | (options.prefault ? MAP_POPULATE : 0), -1, 0);
+			huge_ = addr != MAP_FAILED;
+		}
+		if (addr == MAP_FAILED) {
+			/*没有预留hugetlbfs页时退回透明大页，按2MB对齐长度，方便内核整页合并*/
+			map_size_ = options.huge_pages ? (bytes + huge_page - 1) & ~(huge_page - 1) : (bytes + page - 1) & ~(page - 1);
+			addr = mmap(nullptr, map_size_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			if (addr == MAP_FAILED) {
+				map_size_ = 0;
+				return;
+			}
+			if (options.huge_pages) {
+				madvise(addr, map_size_, MADV_HUGEPAGE);
+			}
+			if (options.prefault) {
+				/*madvise之后再触碰，缺页时才能直接分配大页*/
+				volatile uint8_t* p = static_cast<uint8_t*>(addr);
+				for (std::size_t off = 0; off < map_size_; off += page) {
+					p[off] = 0;
+				}
+			}
+		}
+		slots_ = static_cast<T*>(addr);
+		mask_ = cap - 1;
+	}
+
+	T* slots_;
+	std::size_t mask_;
+	std::size_t map_size_;
+	bool huge_;
+	alignas(64) std::atomic<std::size_t> read_;
+	std::size_t write_cache_;
+	alignas(64) std::atomic<std::size_t> write_;
+	std::size_t read_cache_;
+};
+
+#endif
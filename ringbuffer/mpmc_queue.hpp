@@ -0,0 +1,123 @@
+#ifndef __MPMC_QUEUE_HPP__
+#define __MPMC_QUEUE_HPP__
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+/*
+ * 有界无锁多生产者多消费者队列（每个槽位带序号）
+ * 槽位i的序号seq含义:
+ *   seq == pos       槽位空闲，位置为pos的生产者可以写入
+ *   seq == pos + 1   槽位已写入，位置为pos的消费者可以读取
+ * 消费完成后把seq设为pos + Capacity，交给下一圈的生产者
+ * 与RingBuffer不同，这里不需要空出一个槽位来区分空和满，可用容量就是Capacity
+ */
+template <typename T, std::size_t Capacity>
+class MPMCQueue
+{
+public:
+	static_assert(Capacity >= 2 && !(Capacity & (Capacity - 1)), "Capacity must be power of 2");
+
+	MPMCQueue() : enqueue_pos_(0), dequeue_pos_(0) {
+		for (std::size_t i = 0; i < Capacity; ++i) {
+			slots_[i].seq.store(i, std::memory_order_relaxed);
+		}
+	}
+
+	~MPMCQueue() {
+		/*析构时已经没有并发访问，把还没被消费的元素析构掉*/
+		std::size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+		const std::size_t end = enqueue_pos_.load(std::memory_order_relaxed);
+		while (pos != end) {
+			reinterpret_cast<T*>(&slots_[pos & (Capacity - 1)].storage)->~T();
+			++pos;
+		}
+	}
+
+	MPMCQueue(const MPMCQueue&) = delete;
+	MPMCQueue& operator=(const MPMCQueue&) = delete;
+
+	template<typename U>
+	bool push(U&& value) {
+		Slot* slot;
+		std::size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+		for (;;) {
+			slot = &slots_[pos & (Capacity - 1)];
+			const std::size_t seq = slot->seq.load(std::memory_order_acquire);
+			const std::intptr_t diff = static_cast<std::intptr_t>(seq) - static_cast<std::intptr_t>(pos);
+			if (diff == 0) {
+				/*槽位空闲，抢占这个位置；失败时pos会被更新为最新值*/
+				if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+					break;
+				}
+			}
+			else if (diff < 0) {
+				/*上一圈的元素还没被消费，队列已满*/
+				return false;
+			}
+			else {
+				/*其他生产者已经抢走了这个位置*/
+				pos = enqueue_pos_.load(std::memory_order_relaxed);
+			}
+		}
+		new (&slot->storage) T(std::forward<U>(value));
+		slot->seq.store(pos + 1, std::memory_order_release);
+		return true;
+	}
+
+	bool pop(T& value) {
+		Slot* slot;
+		std::size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+		for (;;) {
+			slot = &slots_[pos & (Capacity - 1)];
+			const std::size_t seq = slot->seq.load(std::memory_order_acquire);
+			const std::intptr_t diff = static_cast<std::intptr_t>(seq) - static_cast<std::intptr_t>(pos + 1);
+			if (diff == 0) {
+				if (dequeue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+					break;
+				}
+			}
+			else if (diff < 0) {
+				/*生产者还没写入，队列为空*/
+				return false;
+			}
+			else {
+				pos = dequeue_pos_.load(std::memory_order_relaxed);
+			}
+		}
+		T* elem = reinterpret_cast<T*>(&slot->storage);
+		value = std::move(*elem);
+		elem->~T();
+		slot->seq.store(pos + Capacity, std::memory_order_release);
+		return true;
+	}
+
+	/*并发情况下只是一个近似值*/
+	std::size_t size() const {
+		const std::size_t d = dequeue_pos_.load(std::memory_order_acquire);
+		const std::size_t e = enqueue_pos_.load(std::memory_order_acquire);
+		return e > d ? e - d : 0;
+	}
+
+	static constexpr std::size_t capacity() {
+		return Capacity;
+	}
+
+private:
+	struct Slot
+	{
+		std::atomic<std::size_t> seq;
+		std::aligned_storage_t<sizeof(T), alignof(T)> storage; /*和RingBuffer一样通过placement new支持非POD类型*/
+	};
+
+	/*生产者和消费者竞争的位置分别放在独立的cacheline里*/
+	alignas(64) std::atomic<std::size_t> enqueue_pos_;
+	alignas(64) std::atomic<std::size_t> dequeue_pos_;
+	alignas(64) Slot slots_[Capacity];
+};
+
+#endif
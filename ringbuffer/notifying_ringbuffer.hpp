@@ -0,0 +1,82 @@
+#ifndef __NOTIFYING_RINGBUFFER_HPP__
+#define __NOTIFYING_RINGBUFFER_HPP__
+
+#include <cstddef>
+#include <utility>
+#include "ringbuffer.hpp"
+
+/*
+ * 带eventfd通知的RingBuffer，fd()可以直接注册到epoll（水平触发）
+ * 生产者可以在reactor以外的任意一个线程push，但底层RingBuffer是SPSC，同一时刻只能有一个生产者线程，
+ * 多个线程都要投递时由调用者在push前加锁；只有队列从空变为非空（reactor已经drain完并重新挂起）时才写一次eventfd；
+ * reactor线程在epoll返回fd可读后调用drain处理积压的元素，和定时器、socket在同一个循环里处理
+ * 构造后先检查valid()，eventfd创建失败时fd()为-1，注册到epoll也不会有任何通知
+ */
+template <typename T, std::size_t Capacity>
+class NotifyingRingBuffer
+{
+public:
+	NotifyingRingBuffer() {
+		/*初始状态队列为空，reactor相当于已经挂起*/
+		rb_.wait_strategy().arm([this]() { return rb_.size() != 0; });
+	}
+
+	NotifyingRingBuffer(const NotifyingRingBuffer&) = delete;
+	NotifyingRingBuffer& operator=(const NotifyingRingBuffer&) = delete;
+
+	int fd() const {
+		return rb_.wait_strategy().fd();
+	}
+
+	bool valid() const {
+		return rb_.wait_strategy().valid();
+	}
+
+	template<typename U>
+	bool push(U&& value) {
+		return rb_.push(std::forward<U>(value));
+	}
+
+	template<typename InputIt>
+	std::size_t push_n(InputIt first, InputIt last) {
+		return rb_.push_n(first, last);
+	}
+
+	/*
+	 * reactor线程调用: 对每个元素就地调用f(T&)，最多处理max个，返回处理的个数
+	 * 队列取空后重新挂起；因为max提前返回时fd保持可读，下一轮epoll会继续处理
+	 */
+	template<typename F>
+	std::size_t drain(F&& f, std::size_t max = static_cast<std::size_t>(-1)) {
+		auto& waiter = rb_.wait_strategy();
+		waiter.clear();
+		std::size_t total = 0;
+		for (;;) {
+			while (total < max) {
+				std::size_t n = rb_.consume_n([&f](T* data, std::size_t count) {
+					for (std::size_t i = 0; i < count; ++i) {
+						f(data[i]);
+					}
+					}, max - total);
+				if (n == 0) break;
+				total += n;
+			}
+			if (!waiter.arm([this]() { return rb_.size() != 0; })) {
+				return total;
+			}
+			if (total >= max) {
+				waiter.signal();
+				return total;
+			}
+		}
+	}
+
+	std::size_t size() const {
+		return rb_.size();
+	}
+
+private:
+	RingBuffer<T, Capacity, true, EventfdWait<0>> rb_;
+};
+
+#endif
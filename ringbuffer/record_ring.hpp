@@ -0,0 +1,169 @@
+#ifndef __RECORD_RING_HPP__
+#define __RECORD_RING_HPP__
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+/*
+ * 变长记录的SPSC字节环形缓冲区
+ * 生产者: reserve(n)拿到一段连续可写的区域，直接在里面填写数据，然后commit()发布
+ * 消费者: peek()拿到下一条记录的只读视图，处理完后release()归还空间
+ * 每条记录前面有8字节的长度头，整体按8字节对齐；尾部放不下时写一个填充头，记录从缓冲区开头重新开始，
+ * 所以记录在内存里总是连续的，收发两端都不需要额外的memcpy或堆分配
+ * 下标是单调递增的字节计数，取模后才是缓冲区内的位置
+ */
+template <std::size_t Capacity>
+class RecordRing
+{
+public:
+	static_assert(Capacity >= 64 && !(Capacity & (Capacity - 1)), "Capacity must be power of 2");
+
+	struct Record
+	{
+		const uint8_t* data;
+		std::size_t size;
+
+		explicit operator bool() const {
+			return data != nullptr;
+		}
+	};
+
+	RecordRing()
+		: read_(0), write_cache_(0), pending_read_(0),
+		write_(0), read_cache_(0), reserved_(0), reserved_pad_(0), reserved_valid_(false), buffer_() {}
+
+	RecordRing(const RecordRing&) = delete;
+	RecordRing& operator=(const RecordRing&) = delete;
+
+	/*
+	 * 单条记录的最大长度
+	 * 记录最多占一半缓冲区，这样即使需要跳过尾部，空缓冲区也一定放得下
+	 */
+	static constexpr std::size_t max_record_size() {
+		return Capacity / 2 - HEADER_SIZE;
+	}
+
+	/*
+	 * 预留n字节的连续可写区域，空间不足返回nullptr
+	 * 预留之后必须先commit才能再次reserve
+	 */
+	uint8_t* reserve(std::size_t n) {
+		if (n > max_record_size()) {
+			return nullptr;
+		}
+		const std::size_t w = write_.load(std::memory_order_relaxed);
+		const std::size_t pos = w & (Capacity - 1);
+		const std::size_t total = record_bytes(n);
+		/*尾部剩余空间放不下整条记录时，跳过尾部从头开始*/
+		const std::size_t pad = (Capacity - pos < total) ? Capacity - pos : 0;
+		if (Capacity - (w - read_cache_) < pad + total) {
+			read_cache_ = read_.load(std::memory_order_acquire);
+			if (Capacity - (w - read_cache_) < pad + total) {
+				return nullptr;
+			}
+		}
+		reserved_ = n;
+		reserved_pad_ = pad;
+		reserved_valid_ = true;
+		return &buffer_[(pos + pad) & (Capacity - 1)] + HEADER_SIZE;
+	}
+
+	/*发布最近一次reserve的区域，used可以小于预留的大小；没有成功的reserve时什么都不做*/
+	void commit(std::size_t used) {
+		if (!reserved_valid_) return;
+		if (used > reserved_) used = reserved_;
+		const std::size_t w = write_.load(std::memory_order_relaxed);
+		const std::size_t pos = w & (Capacity - 1);
+		if (reserved_pad_) {
+			write_header(pos, PADDING);
+		}
+		write_header((pos + reserved_pad_) & (Capacity - 1), used);
+		write_.store(w + reserved_pad_ + record_bytes(used), std::memory_order_release);
+		reserved_ = 0;
+		reserved_pad_ = 0;
+		reserved_valid_ = false;
+	}
+
+	void commit() {
+		commit(reserved_);
+	}
+
+	/*拷贝写入一条记录的便捷接口*/
+	bool push(const void* data, std::size_t n) {
+		uint8_t* dst = reserve(n);
+		if (nullptr == dst) {
+			return false;
+		}
+		std::memcpy(dst, data, n);
+		commit(n);
+		return true;
+	}
+
+	/*查看下一条记录，没有数据时返回空视图；视图在release之前一直有效*/
+	Record peek() {
+		std::size_t r = read_.load(std::memory_order_relaxed);
+		if (r == write_cache_) {
+			write_cache_ = write_.load(std::memory_order_acquire);
+			if (r == write_cache_) {
+				return Record{ nullptr, 0 };
+			}
+		}
+		std::size_t pos = r & (Capacity - 1);
+		uint64_t len = read_header(pos);
+		if (len == PADDING) {
+			/*填充头和后面的记录是同一次commit发布的，这里一定有数据*/
+			r += Capacity - pos;
+			pos = 0;
+			len = read_header(pos);
+		}
+		pending_read_ = r + record_bytes(len);
+		return Record{ &buffer_[pos] + HEADER_SIZE, static_cast<std::size_t>(len) };
+	}
+
+	/*归还最近一次peek到的记录所占的空间*/
+	void release() {
+		read_.store(pending_read_, std::memory_order_release);
+	}
+
+	bool empty() const {
+		return read_.load(std::memory_order_acquire) == write_.load(std::memory_order_acquire);
+	}
+
+	/*已占用的字节数（包括记录头、对齐和填充）*/
+	std::size_t used_bytes() const {
+		const std::size_t r = read_.load(std::memory_order_acquire);
+		const std::size_t w = write_.load(std::memory_order_acquire);
+		return w - r;
+	}
+
+private:
+	static constexpr std::size_t HEADER_SIZE = sizeof(uint64_t);
+	static constexpr uint64_t PADDING = ~static_cast<uint64_t>(0);
+
+	static std::size_t record_bytes(std::size_t n) {
+		return (HEADER_SIZE + n + 7) & ~static_cast<std::size_t>(7);
+	}
+
+	void write_header(std::size_t pos, uint64_t len) {
+		*reinterpret_cast<uint64_t*>(&buffer_[pos]) = len;
+	}
+
+	uint64_t read_header(std::size_t pos) const {
+		return *reinterpret_cast<const uint64_t*>(&buffer_[pos]);
+	}
+
+	/*和RingBuffer一样，缓存的对方下标和本侧下标放在同一个cacheline*/
+	alignas(64) std::atomic<std::size_t> read_;
+	std::size_t write_cache_;
+	std::size_t pending_read_;
+	alignas(64) std::atomic<std::size_t> write_;
+	std::size_t read_cache_;
+	std::size_t reserved_;
+	std::size_t reserved_pad_;
+	bool reserved_valid_; /*reserve成功之后、commit之前为true；reserved_为0也是合法的预留*/
+	alignas(64) uint8_t buffer_[Capacity];
+};
+
+#endif
@@ -0,0 +1,163 @@
+#ifndef __RING_STATS_HPP__
+#define __RING_STATS_HPP__
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+/*
+ * RingBuffer的统计策略，作为第五个模板参数传入
+ * 策略类提供一个成员模板Recorder<Capacity>，RingBuffer在对应位置调用它的钩子:
+ *   生产者: on_full()                  push发现队列已满
+ *           on_push(w, n, occupancy)   槽位[w, w + n)已经构造、即将发布，occupancy()返回发布后的真实占用
+ *   消费者: on_empty()                 pop发现队列为空
+ *           on_pop(r, n)               即将归还槽位[r, r + n)
+ * 默认的NoStats全部是空函数，编译后没有任何额外的指令和内存访问
+ */
+struct NoStats
+{
+	template <std::size_t Capacity>
+	struct Recorder
+	{
+		void on_full() {}
+		template<typename Occupancy>
+		void on_push(std::size_t, std::size_t, Occupancy&&) {}
+		void on_empty() {}
+		void on_pop(std::size_t, std::size_t) {}
+	};
+};
+
+/*
+ * 计数器版本的统计策略
+ * 每2^SampleShift次push采样一次: 生产者relaxed读取一次read_，更新高水位和占用直方图；
+ * 队列满时高水位直接记为Capacity - 1，所以"满过"一定能看到，平时的峰值是采样值
+ * Latency为true时，被采样的那次push在旁路数组里记下时间戳，消费者取出该槽位时把入队到出队的耗时记进直方图
+ * 生产者和消费者的计数器各自独占cacheline，只由本侧线程写入（单写者，不需要原子RMW），
+ * 其他线程可以随时relaxed读取，不会碰到read_/write_所在的cacheline
+ */
+template <unsigned SampleShift = 6, bool Latency = false>
+struct RingStats
+{
+	static constexpr std::size_t OCCUPANCY_BUCKETS = 16; /*线性分桶，第i个桶是[i, i + 1) * Capacity / 16*/
+	static constexpr std::size_t LATENCY_BUCKETS = 32;   /*按纳秒取log2分桶，第i个桶是[2^(i-1), 2^i)ns，0号桶是0ns*/
+
+	template <std::size_t Capacity>
+	class Recorder
+	{
+	public:
+		Recorder() {
+			for (uint64_t& stamp : stamps_.at) stamp = 0;
+		}
+
+		/*生产者拿到false的次数*/
+		uint64_t push_full() const {
+			return producer_.full.load(std::memory_order_relaxed);
+		}
+
+		/*消费者扑空的次数（pop_wait每次等待只计一次）*/
+		uint64_t pop_empty() const {
+			return consumer_.empty.load(std::memory_order_relaxed);
+		}
+
+		/*观察到的最大占用*/
+		std::size_t high_water() const {
+			return static_cast<std::size_t>(producer_.high_water.load(std::memory_order_relaxed));
+		}
+
+		uint64_t occupancy_histogram(std::size_t bucket) const {
+			return producer_.occupancy[bucket].load(std::memory_order_relaxed);
+		}
+
+		uint64_t latency_histogram(std::size_t bucket) const {
+			return consumer_.latency[bucket].load(std::memory_order_relaxed);
+		}
+
+		void on_full() {
+			bump(producer_.full);
+			if (producer_.high_water.load(std::memory_order_relaxed) != Capacity - 1) {
+				producer_.high_water.store(Capacity - 1, std::memory_order_relaxed);
+			}
+		}
+
+		template<typename Occupancy>
+		void on_push(std::size_t w, std::size_t n, Occupancy&& occupancy) {
+			if ((producer_.pushes++ & ((uint64_t(1) << SampleShift) - 1)) != 0) {
+				return;
+			}
+			const std::size_t used = occupancy();
+			if (used > producer_.high_water.load(std::memory_order_relaxed)) {
+				producer_.high_water.store(used, std::memory_order_relaxed);
+			}
+			bump(producer_.occupancy[used * OCCUPANCY_BUCKETS / Capacity]);
+			if (Latency) {
+				/*只给这一批的最后一个元素打时间戳，写入在write_的release之前完成*/
+				stamps_.at[(w + n - 1) & (Capacity - 1)] = now();
+			}
+		}
+
+		void on_empty() {
+			bump(consumer_.empty);
+		}
+
+		void on_pop(std::size_t r, std::size_t n) {
+			if (!Latency) {
+				return;
+			}
+			uint64_t t = 0;
+			for (std::size_t i = 0; i < n; ++i) {
+				uint64_t& stamp = stamps_.at[(r + i) & (Capacity - 1)];
+				if (stamp) {
+					if (!t) t = now();
+					bump(consumer_.latency[latency_bucket(t - stamp)]);
+					stamp = 0; /*归还槽位之前清零，生产者下一圈重新打戳*/
+				}
+			}
+		}
+
+	private:
+		static void bump(std::atomic<uint64_t>& counter) {
+			counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		}
+
+		static uint64_t now() {
+			return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+				std::chrono::steady_clock::now().time_since_epoch()).count());
+		}
+
+		static std::size_t latency_bucket(uint64_t ns) {
+			std::size_t b = 0;
+			while (ns && b < LATENCY_BUCKETS - 1) {
+				ns >>= 1;
+				++b;
+			}
+			return b;
+		}
+
+		struct alignas(64) Producer
+		{
+			uint64_t pushes = 0; /*采样计数，只有生产者读写*/
+			std::atomic<uint64_t> full{ 0 };
+			std::atomic<uint64_t> high_water{ 0 };
+			std::atomic<uint64_t> occupancy[OCCUPANCY_BUCKETS] = {};
+		};
+
+		struct alignas(64) Consumer
+		{
+			std::atomic<uint64_t> empty{ 0 };
+			std::atomic<uint64_t> latency[LATENCY_BUCKETS] = {};
+		};
+
+		/*时间戳数组跟着槽位走，由write_/read_的release-acquire保护，不需要原子操作；关闭时只剩一个cacheline*/
+		struct alignas(64) Stamps
+		{
+			uint64_t at[Latency ? Capacity : 1];
+		};
+
+		Producer producer_;
+		Consumer consumer_;
+		Stamps stamps_;
+	};
+};
+
+#endif
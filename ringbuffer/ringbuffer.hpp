@@ -1,15 +1,26 @@
 #ifndef __RINGBUFFER_HPP__
 #define __RINGBUFFER_HPP__
 
+#include <algorithm>
 #include <atomic>
+#include <iterator>
 #include <type_traits>
+#include "wait_strategy.hpp"
+#include "ring_stats.hpp"
 
-template <typename T, std::size_t Capacity>
+/*
+ * CacheIndex为true时，生产者缓存一份read_、消费者缓存一份write_，
+ * 只有缓存值显示满/空时才重新acquire读取对方的下标，避免每次操作都让对方的cacheline在核间来回迁移
+ * 设为false保留每次都读取对方下标的旧行为，便于对比测试
+ * WaitStrategy决定pop_wait在队列为空时如何等待，见wait_strategy.hpp
+ * Stats决定是否记录满/空次数、占用和延迟，默认NoStats没有任何开销，见ring_stats.hpp
+ */
+template <typename T, std::size_t Capacity, bool CacheIndex = true, typename WaitStrategy = BusySpinWait, typename Stats = NoStats>
 class RingBuffer
 {
 public:
 	static_assert(Capacity && !(Capacity& (Capacity - 1)), "Capacity must be power of 2");
-	RingBuffer() : read_(0), write_(0) {}
+	RingBuffer() : read_(0), write_cache_(0), write_(0), read_cache_(0) {}
 	~RingBuffer() {
 		/*只要完成了线程切换，relaxed也可以拿到最新值*/
 		std::size_t r = read_.load(std::memory_order_relaxed);
@@ -22,27 +33,161 @@ public:
 	
 	template<typename U>
 	bool push(U&& value) {
+		return emplace(std::forward<U>(value));
+	}
+
+	/*用参数直接在槽位上构造元素，省掉先构造临时对象再移动*/
+	template<typename... Args>
+	bool emplace(Args&&... args) {
 		const std::size_t w = write_.load(std::memory_order_relaxed); /*在SPSC的情况下，relaxed也可以保证可见性*/
-		const std::size_t next_w = (w + 1) & (Capacity - 1);
-		if (next_w == read_.load(std::memory_order_acquire)) {
+		if (writable(w, 1) == 0) {
+			stats_.on_full();
 			return false;
 		}
-		new (&buffer_[w]) T(std::forward<U>(value));
+		const std::size_t next_w = (w + 1) & (Capacity - 1);
+		new (&buffer_[w]) T(std::forward<Args>(args)...);
+		stats_.on_push(w, 1, [this, next_w]() { return occupancy(next_w); });
 		write_.store(next_w, std::memory_order_release);
+		wait_.notify();
 		return true;
 	}
 
 	bool pop(T& value) {
 		const std::size_t r = read_.load(std::memory_order_relaxed);
-		if (r == write_.load(std::memory_order_acquire)) {
+		if (readable(r, 1) == 0) {
+			stats_.on_empty();
 			return false;
 		}
 		value = std::move(*reinterpret_cast<T*>(&buffer_[r]));
 		reinterpret_cast<T*>(&buffer_[r])->~T();
+		stats_.on_pop(r, 1);
 		read_.store((r + 1) & (Capacity - 1), std::memory_order_release);
 		return true;
 	}
 
+	/*队首元素的指针，队列为空时返回nullptr；元素留在槽位里，直到pop_front才析构*/
+	T* front() {
+		const std::size_t r = read_.load(std::memory_order_relaxed);
+		if (readable(r, 1) == 0) {
+			stats_.on_empty();
+			return nullptr;
+		}
+		return reinterpret_cast<T*>(&buffer_[r]);
+	}
+
+	/*析构队首元素并归还槽位，调用前front()必须返回过非空*/
+	void pop_front() {
+		const std::size_t r = read_.load(std::memory_order_relaxed);
+		reinterpret_cast<T*>(&buffer_[r])->~T();
+		stats_.on_pop(r, 1);
+		read_.store((r + 1) & (Capacity - 1), std::memory_order_release);
+	}
+
+	/*就地处理队首元素f(T&)，不需要移动到调用者的对象里，队列为空时返回false*/
+	template<typename F>
+	bool consume(F&& f) {
+		T* elem = front();
+		if (nullptr == elem) {
+			return false;
+		}
+		f(*elem);
+		pop_front();
+		return true;
+	}
+
+	/*批量写入: 一次acquire读取read_，构造完所有元素后只做一次release发布，返回实际写入的个数*/
+	template<typename InputIt>
+	std::size_t push_n(InputIt first, InputIt last) {
+		const std::size_t w = write_.load(std::memory_order_relaxed);
+		const std::size_t free = writable(w, batch_hint(first, last, typename std::iterator_traits<InputIt>::iterator_category()));
+		std::size_t n = 0;
+		for (; n < free && first != last; ++n, ++first) {
+			new (&buffer_[(w + n) & (Capacity - 1)]) T(*first); /*传入move_iterator即可移动构造*/
+		}
+		if (first != last) {
+			stats_.on_full(); /*没能全部写入*/
+		}
+		if (n) {
+			const std::size_t next_w = (w + n) & (Capacity - 1);
+			stats_.on_push(w, n, [this, next_w]() { return occupancy(next_w); });
+			write_.store(next_w, std::memory_order_release);
+			wait_.notify();
+		}
+		return n;
+	}
+
+	/*批量读取: 最多取出max个元素移动到out，一次release归还所有槽位，返回实际读取的个数*/
+	template<typename OutputIt>
+	std::size_t pop_n(OutputIt out, std::size_t max) {
+		const std::size_t r = read_.load(std::memory_order_relaxed);
+		std::size_t n = readable(r, max);
+		if (n > max) n = max;
+		if (n == 0 && max) {
+			stats_.on_empty();
+		}
+		for (std::size_t i = 0; i < n; ++i) {
+			T* elem = reinterpret_cast<T*>(&buffer_[(r + i) & (Capacity - 1)]);
+			*out = std::move(*elem);
+			++out;
+			elem->~T();
+		}
+		if (n) {
+			stats_.on_pop(r, n);
+			read_.store((r + n) & (Capacity - 1), std::memory_order_release);
+		}
+		return n;
+	}
+
+	/*
+	 * 批量就地读取: 最多max个元素，按连续区间回调f(T* data, std::size_t count)，绕回时最多回调两次
+	 * 回调返回后统一析构并一次release归还槽位，元素不需要移动出来
+	 */
+	template<typename F>
+	std::size_t consume_n(F&& f, std::size_t max) {
+		const std::size_t r = read_.load(std::memory_order_relaxed);
+		std::size_t n = readable(r, max);
+		if (n > max) n = max;
+		if (n == 0) {
+			if (max) stats_.on_empty();
+			return 0;
+		}
+		T* data = reinterpret_cast<T*>(&buffer_[0]);
+		const std::size_t first = std::min(n, Capacity - r);
+		f(data + r, first);
+		if (n > first) {
+			f(data, n - first);
+		}
+		for (std::size_t i = 0; i < n; ++i) {
+			data[(r + i) & (Capacity - 1)].~T();
+		}
+		stats_.on_pop(r, n);
+		read_.store((r + n) & (Capacity - 1), std::memory_order_release);
+		return n;
+	}
+
+	/*阻塞读取: 队列为空时按WaitStrategy等待，直到取到一个元素*/
+	void pop_wait(T& value) {
+		const std::size_t r = read_.load(std::memory_order_relaxed);
+		if (readable(r, 1) == 0) {
+			stats_.on_empty();
+			wait_.wait([this, r]() { return readable(r, 1) != 0; });
+		}
+		pop(value);
+	}
+
+	WaitStrategy& wait_strategy() {
+		return wait_;
+	}
+
+	const WaitStrategy& wait_strategy() const {
+		return wait_;
+	}
+
+	/*统计计数器，任意线程都可以读取，接口见ring_stats.hpp*/
+	const typename Stats::template Recorder<Capacity>& stats() const {
+		return stats_;
+	}
+
 	std::size_t size() const {
 		const std::size_t r = read_.load(std::memory_order_acquire);
 		const std::size_t w = write_.load(std::memory_order_acquire);
@@ -50,9 +195,56 @@ public:
 	}
 
 private:
+	/*前向迭代器可以预先算出批量大小，输入迭代器只能按最大值估计*/
+	template<typename It>
+	static std::size_t batch_hint(It first, It last, std::forward_iterator_tag) {
+		return static_cast<std::size_t>(std::distance(first, last));
+	}
+
+	template<typename It>
+	static std::size_t batch_hint(It, It, std::input_iterator_tag) {
+		return Capacity - 1;
+	}
+
+	/*生产者侧: 发布到next_w之后的真实占用，只在统计采样时调用，relaxed读取read_不会多出同步*/
+	std::size_t occupancy(std::size_t next_w) const {
+		return (next_w - read_.load(std::memory_order_relaxed)) & (Capacity - 1);
+	}
+
+	/*生产者侧: 写位置w之后还有多少空槽，缓存值不够want个时才重新读取read_*/
+	std::size_t writable(std::size_t w, std::size_t want) {
+		if (!CacheIndex) {
+			return (read_.load(std::memory_order_acquire) - w - 1) & (Capacity - 1);
+		}
+		std::size_t free = (read_cache_ - w - 1) & (Capacity - 1);
+		if (free < want) {
+			read_cache_ = read_.load(std::memory_order_acquire);
+			free = (read_cache_ - w - 1) & (Capacity - 1);
+		}
+		return free;
+	}
+
+	/*消费者侧: 读位置r之后有多少可读元素，缓存值不够want个时才重新读取write_*/
+	std::size_t readable(std::size_t r, std::size_t want) {
+		if (!CacheIndex) {
+			return (write_.load(std::memory_order_acquire) - r) & (Capacity - 1);
+		}
+		std::size_t avail = (write_cache_ - r) & (Capacity - 1);
+		if (avail < want) {
+			write_cache_ = write_.load(std::memory_order_acquire);
+			avail = (write_cache_ - r) & (Capacity - 1);
+		}
+		return avail;
+	}
+
 	/*read和write不应该在一个cacheline里面，否则缓存失效的话read_和write_同时失效，造成伪共享的问题*/
+	/*缓存的对方下标只由本侧线程读写，和本侧的下标放在同一个cacheline里*/
 	alignas(64) std::atomic<std::size_t> read_; /*alignas设置64个字节对齐，防止在一个cacheline*/
+	std::size_t write_cache_;
 	alignas(64) std::atomic<std::size_t> write_;
+	std::size_t read_cache_;
+	alignas(64) WaitStrategy wait_; /*生产者只在发布后读取，消费者只在挂起时修改*/
+	typename Stats::template Recorder<Capacity> stats_; /*NoStats是空类，和wait_共用cacheline*/
 	alignas(64) std::aligned_storage_t<sizeof(T), alignof(T)> buffer_[Capacity]; /*通过placement new兼容支持POD和非POD类型*/
 };
 
@@ -0,0 +1,867 @@
+#include "ringbuffer.hpp"
+#include "mpmc_queue.hpp"
+#include "record_ring.hpp"
+#include "shm_ringbuffer.hpp"
+#include "broadcast_ring.hpp"
+#include "dynamic_ringbuffer.hpp"
+#include "thread_pool.hpp"
+#include <iostream>
+#include <iomanip>
+#include <thread>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <cstdint>
+#include <algorithm>
+#include <pthread.h>
+#include <sched.h>
+#include <ctime>
+#include <cstring>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+using bench_clock = std::chrono::steady_clock;
+
+static void report(const std::string& name, std::size_t ops, bench_clock::duration elapsed) {
+    double sec = std::chrono::duration<double>(elapsed).count();
+    std::cout << std::left << std::setw(40) << name
+        << std::right << std::setw(10) << std::fixed << std::setprecision(2)
+        << (ops / sec / 1e6) << " Mops/s" << std::endl;
+}
+
+// 对照组：用互斥锁保护SPSC的RingBuffer，模拟目前扇入点的做法
+template <typename T, std::size_t Capacity>
+class MutexQueue
+{
+public:
+    template<typename U>
+    bool push(U&& value) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return rb_.push(std::forward<U>(value));
+    }
+
+    bool pop(T& value) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return rb_.pop(value);
+    }
+
+private:
+    std::mutex mutex_;
+    RingBuffer<T, Capacity> rb_;
+};
+
+// producers个生产者各写入per_producer个元素，consumers个消费者取完为止
+template <typename Queue>
+static void bench_mpmc(const std::string& name, int producers, int consumers, std::size_t per_producer) {
+    Queue q;
+    const std::size_t total = per_producer * producers;
+    std::atomic<std::size_t> consumed(0);
+    std::atomic<bool> start(false);
+    std::vector<std::thread> threads;
+
+    for (int p = 0; p < producers; ++p) {
+        threads.emplace_back([&]() {
+            while (!start.load(std::memory_order_acquire)) std::this_thread::yield();
+            for (std::size_t i = 0; i < per_producer; ++i) {
+                while (!q.push(i)) std::this_thread::yield();
+            }
+            });
+    }
+    for (int c = 0; c < consumers; ++c) {
+        threads.emplace_back([&]() {
+            while (!start.load(std::memory_order_acquire)) std::this_thread::yield();
+            std::size_t val;
+            while (consumed.load(std::memory_order_relaxed) < total) {
+                if (q.pop(val)) {
+                    consumed.fetch_add(1, std::memory_order_relaxed);
+                }
+                else {
+                    std::this_thread::yield();
+                }
+            }
+            });
+    }
+
+    auto begin = bench_clock::now();
+    start.store(true, std::memory_order_release);
+    for (auto& t : threads) t.join();
+    report(name + " " + std::to_string(producers) + "P/" + std::to_string(consumers) + "C", total, bench_clock::now() - begin);
+}
+
+static void bench_mpmc_scaling() {
+    std::cout << "== MPMC throughput ==" << std::endl;
+    const std::size_t OPS = 1 << 20;
+    for (int n : { 1, 2, 4, 8 }) {
+        bench_mpmc<MPMCQueue<std::size_t, 1024>>("MPMCQueue", n, n, OPS / n);
+        bench_mpmc<MutexQueue<std::size_t, 1024>>("mutex + RingBuffer", n, n, OPS / n);
+    }
+    std::cout << std::endl;
+}
+
+// 行情扇出场景里的小结构体
+struct Tick
+{
+    uint32_t symbol;
+    uint32_t qty;
+    uint64_t price;
+};
+
+// 逐个push/pop，与ringbuffer_test.cpp中的循环相同
+static void bench_spsc_single(std::size_t total) {
+    RingBuffer<Tick, 4096> rb;
+    auto begin = bench_clock::now();
+    std::thread producer([&]() {
+        for (std::size_t i = 0; i < total; ++i) {
+            Tick t{ static_cast<uint32_t>(i), 1, i };
+            while (!rb.push(t)) std::this_thread::yield();
+        }
+        });
+    std::thread consumer([&]() {
+        Tick t;
+        for (std::size_t i = 0; i < total; ++i) {
+            while (!rb.pop(t)) std::this_thread::yield();
+        }
+        });
+    producer.join();
+    consumer.join();
+    report("SPSC per-element push/pop", total, bench_clock::now() - begin);
+}
+
+// 每次最多batch个元素，一次发布
+static void bench_spsc_batch(std::size_t total, std::size_t batch) {
+    RingBuffer<Tick, 4096> rb;
+    auto begin = bench_clock::now();
+    std::thread producer([&]() {
+        std::vector<Tick> buf(batch);
+        std::size_t sent = 0;
+        while (sent < total) {
+            std::size_t count = std::min(batch, total - sent);
+            for (std::size_t i = 0; i < count; ++i) buf[i] = Tick{ static_cast<uint32_t>(sent + i), 1, sent + i };
+            std::size_t off = 0;
+            while (off < count) {
+                std::size_t n = rb.push_n(buf.begin() + off, buf.begin() + count);
+                if (n == 0) std::this_thread::yield();
+                off += n;
+            }
+            sent += count;
+        }
+        });
+    std::thread consumer([&]() {
+        std::vector<Tick> buf(batch);
+        std::size_t received = 0;
+        while (received < total) {
+            std::size_t n = rb.pop_n(buf.begin(), batch);
+            if (n == 0) std::this_thread::yield();
+            received += n;
+        }
+        });
+    producer.join();
+    consumer.join();
+    report("SPSC push_n/pop_n batch=" + std::to_string(batch), total, bench_clock::now() - begin);
+}
+
+// 就地批量消费，不把元素移动出来
+static void bench_spsc_consume_n(std::size_t total, std::size_t batch) {
+    RingBuffer<Tick, 4096> rb;
+    auto begin = bench_clock::now();
+    std::thread producer([&]() {
+        std::vector<Tick> buf(batch);
+        std::size_t sent = 0;
+        while (sent < total) {
+            std::size_t count = std::min(batch, total - sent);
+            for (std::size_t i = 0; i < count; ++i) buf[i] = Tick{ static_cast<uint32_t>(sent + i), 1, sent + i };
+            std::size_t off = 0;
+            while (off < count) {
+                std::size_t n = rb.push_n(buf.begin() + off, buf.begin() + count);
+                if (n == 0) std::this_thread::yield();
+                off += n;
+            }
+            sent += count;
+        }
+        });
+    std::thread consumer([&]() {
+        std::size_t received = 0;
+        uint64_t sum = 0;
+        while (received < total) {
+            std::size_t n = rb.consume_n([&](Tick* data, std::size_t count) {
+                for (std::size_t i = 0; i < count; ++i) sum += data[i].price;
+                }, batch);
+            if (n == 0) std::this_thread::yield();
+            received += n;
+        }
+        volatile uint64_t sink = sum;
+        (void)sink;
+        });
+    producer.join();
+    consumer.join();
+    report("SPSC push_n/consume_n batch=" + std::to_string(batch), total, bench_clock::now() - begin);
+}
+
+static void bench_spsc_batching() {
+    std::cout << "== SPSC batch vs per-element (16-byte Tick) ==" << std::endl;
+    const std::size_t OPS = 1 << 22;
+    bench_spsc_single(OPS);
+    for (std::size_t batch : { 16, 64, 256 }) {
+        bench_spsc_batch(OPS, batch);
+    }
+    bench_spsc_consume_n(OPS, 256);
+    std::cout << std::endl;
+}
+
+// 把当前线程绑定到cpu上，cpu数不够时退化为取模
+static void pin_to_cpu(int cpu) {
+    const int ncpu = static_cast<int>(std::thread::hardware_concurrency());
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(ncpu > 0 ? cpu % ncpu : 0, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+// 生产者和消费者分别绑在两个核上，测试吞吐
+template <bool CacheIndex>
+static void bench_pinned_throughput(std::size_t total) {
+    RingBuffer<uint64_t, 1024, CacheIndex> rb;
+    std::atomic<bool> start(false);
+    std::thread producer([&]() {
+        pin_to_cpu(0);
+        while (!start.load(std::memory_order_acquire)) std::this_thread::yield();
+        for (uint64_t i = 0; i < total; ++i) {
+            while (!rb.push(i)) std::this_thread::yield();
+        }
+        });
+    std::thread consumer([&]() {
+        pin_to_cpu(1);
+        while (!start.load(std::memory_order_acquire)) std::this_thread::yield();
+        uint64_t v;
+        for (std::size_t i = 0; i < total; ++i) {
+            while (!rb.pop(v)) std::this_thread::yield();
+        }
+        });
+    auto begin = bench_clock::now();
+    start.store(true, std::memory_order_release);
+    producer.join();
+    consumer.join();
+    report(std::string("pinned SPSC throughput CacheIndex=") + (CacheIndex ? "true" : "false"), total, bench_clock::now() - begin);
+}
+
+// 两个队列一来一回测往返延迟
+template <bool CacheIndex>
+static void bench_pinned_latency(std::size_t rounds) {
+    RingBuffer<uint64_t, 1024, CacheIndex> ping;
+    RingBuffer<uint64_t, 1024, CacheIndex> pong;
+    std::thread echo([&]() {
+        pin_to_cpu(1);
+        uint64_t v;
+        for (std::size_t i = 0; i < rounds; ++i) {
+            while (!ping.pop(v)) std::this_thread::yield();
+            while (!pong.push(v)) std::this_thread::yield();
+        }
+        });
+    bench_clock::duration elapsed;
+    std::thread sender([&]() {
+        pin_to_cpu(0);
+        uint64_t v;
+        auto begin = bench_clock::now();
+        for (uint64_t i = 0; i < rounds; ++i) {
+            while (!ping.push(i)) std::this_thread::yield();
+            while (!pong.pop(v)) std::this_thread::yield();
+        }
+        elapsed = bench_clock::now() - begin;
+        });
+    sender.join();
+    echo.join();
+    double ns = std::chrono::duration<double, std::nano>(elapsed).count() / rounds;
+    std::cout << std::left << std::setw(40) << (std::string("pinned round trip CacheIndex=") + (CacheIndex ? "true" : "false"))
+        << std::right << std::setw(10) << std::fixed << std::setprecision(1) << ns << " ns" << std::endl;
+}
+
+static void bench_index_cache() {
+    std::cout << "== index cache (producer cpu 0, consumer cpu 1) ==" << std::endl;
+    if (std::thread::hardware_concurrency() < 2) {
+        std::cout << "(only one cpu available, both threads share it)" << std::endl;
+    }
+    const std::size_t OPS = 1 << 22;
+    bench_pinned_throughput<false>(OPS);
+    bench_pinned_throughput<true>(OPS);
+    bench_pinned_latency<false>(1 << 16);
+    bench_pinned_latency<true>(1 << 16);
+    std::cout << std::endl;
+}
+
+// 生产者间隔一段时间发送时间戳，消费者用pop_wait等待，统计唤醒延迟和消费者CPU占用
+template <typename Wait>
+static void bench_wakeup(const std::string& name, int rounds, std::chrono::microseconds gap) {
+    RingBuffer<int64_t, 64, true, Wait> rb;
+    double total_ns = 0;
+    double cpu_ms = 0;
+    std::thread consumer([&]() {
+        struct timespec cpu_begin, cpu_end;
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu_begin);
+        int64_t sent = 0;
+        for (int i = 0; i < rounds; ++i) {
+            rb.pop_wait(sent);
+            total_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(bench_clock::now().time_since_epoch()).count() - sent;
+        }
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu_end);
+        cpu_ms = (cpu_end.tv_sec - cpu_begin.tv_sec) * 1e3 + (cpu_end.tv_nsec - cpu_begin.tv_nsec) / 1e6;
+        });
+    auto begin = bench_clock::now();
+    for (int i = 0; i < rounds; ++i) {
+        std::this_thread::sleep_for(gap);
+        int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(bench_clock::now().time_since_epoch()).count();
+        while (!rb.push(now)) std::this_thread::yield();
+    }
+    consumer.join();
+    double wall_ms = std::chrono::duration<double, std::milli>(bench_clock::now() - begin).count();
+    std::cout << std::left << std::setw(40) << name
+        << std::right << std::setw(10) << std::fixed << std::setprecision(1) << (total_ns / rounds / 1e3) << " us wakeup"
+        << std::setw(10) << (cpu_ms / wall_ms * 100) << " % consumer cpu" << std::endl;
+}
+
+static void bench_wait_strategies() {
+    std::cout << "== wait strategies (one message every 100us) ==" << std::endl;
+    const int ROUNDS = 2000;
+    const std::chrono::microseconds GAP(100);
+    bench_wakeup<BusySpinWait>("BusySpinWait", ROUNDS, GAP);
+    bench_wakeup<SpinYieldWait<>>("SpinYieldWait", ROUNDS, GAP);
+    bench_wakeup<FutexWait<>>("FutexWait", ROUNDS, GAP);
+    bench_wakeup<EventfdWait<>>("EventfdWait", ROUNDS, GAP);
+    std::cout << std::endl;
+}
+
+// 变长消息: 每条消息都装进一个std::string再放进RingBuffer
+static void bench_var_string(std::size_t total) {
+    RingBuffer<std::string, 1024> rb;
+    char payload[256];
+    std::memset(payload, 'x', sizeof(payload));
+    auto begin = bench_clock::now();
+    std::thread producer([&]() {
+        for (std::size_t i = 0; i < total; ++i) {
+            std::string msg(payload, 16 + i % 240); /*超过SSO长度的消息需要堆分配*/
+            while (!rb.push(std::move(msg))) std::this_thread::yield();
+        }
+        });
+    std::thread consumer([&]() {
+        std::string msg;
+        std::size_t bytes = 0;
+        for (std::size_t i = 0; i < total; ++i) {
+            while (!rb.pop(msg)) std::this_thread::yield();
+            bytes += msg.size();
+        }
+        volatile std::size_t sink = bytes;
+        (void)sink;
+        });
+    producer.join();
+    consumer.join();
+    report("RingBuffer<std::string> 16..255B", total, bench_clock::now() - begin);
+}
+
+// 变长消息: reserve/commit直接写进RecordRing，消费者peek后就地读取
+static void bench_var_record(std::size_t total) {
+    static RecordRing<1 << 18> ring;
+    char payload[256];
+    std::memset(payload, 'x', sizeof(payload));
+    auto begin = bench_clock::now();
+    std::thread producer([&]() {
+        for (std::size_t i = 0; i < total; ++i) {
+            std::size_t len = 16 + i % 240;
+            uint8_t* dst;
+            while ((dst = ring.reserve(len)) == nullptr) std::this_thread::yield();
+            std::memcpy(dst, payload, len);
+            ring.commit();
+        }
+        });
+    std::thread consumer([&]() {
+        std::size_t bytes = 0;
+        for (std::size_t i = 0; i < total; ++i) {
+            RecordRing<1 << 18>::Record rec;
+            while (!(rec = ring.peek())) std::this_thread::yield();
+            bytes += rec.size;
+            ring.release();
+        }
+        volatile std::size_t sink = bytes;
+        (void)sink;
+        });
+    producer.join();
+    consumer.join();
+    report("RecordRing reserve/commit 16..255B", total, bench_clock::now() - begin);
+}
+
+static void bench_variable_length() {
+    std::cout << "== variable-length messages ==" << std::endl;
+    const std::size_t OPS = 1 << 21;
+    bench_var_string(OPS);
+    bench_var_record(OPS);
+    std::cout << std::endl;
+}
+
+// 跨进程传递的64字节消息
+struct IpcMsg
+{
+    uint64_t seq;
+    char body[56];
+};
+
+// 子进程通过继承的memfd attach并写入，父进程读取
+static void bench_ipc_shm(std::size_t total) {
+    ShmRingBuffer<IpcMsg, 4096> ring;
+    if (!ring.create_memfd()) {
+        std::cout << "memfd_create failed" << std::endl;
+        return;
+    }
+    auto begin = bench_clock::now();
+    pid_t pid = fork();
+    if (pid == 0) {
+        ShmRingBuffer<IpcMsg, 4096> child;
+        if (!child.attach_fd(ring.fd())) _exit(1);
+        IpcMsg msg;
+        std::memset(&msg, 0, sizeof(msg));
+        for (std::size_t i = 0; i < total; ++i) {
+            msg.seq = i;
+            while (!child.push(msg)) sched_yield();
+        }
+        _exit(0);
+    }
+    IpcMsg msg;
+    for (std::size_t i = 0; i < total; ++i) {
+        while (!ring.pop(msg)) sched_yield();
+    }
+    waitpid(pid, nullptr, 0);
+    report("two-process ShmRingBuffer 64B", total, bench_clock::now() - begin);
+}
+
+// 对照组: 目前的Unix socket方式，每条消息一次write/read
+static void bench_ipc_socket(std::size_t total) {
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+        std::cout << "socketpair failed" << std::endl;
+        return;
+    }
+    auto begin = bench_clock::now();
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(fds[0]);
+        IpcMsg msg;
+        std::memset(&msg, 0, sizeof(msg));
+        for (std::size_t i = 0; i < total; ++i) {
+            msg.seq = i;
+            if (write(fds[1], &msg, sizeof(msg)) != sizeof(msg)) _exit(1);
+        }
+        _exit(0);
+    }
+    close(fds[1]);
+    IpcMsg msg;
+    for (std::size_t i = 0; i < total; ++i) {
+        std::size_t got = 0;
+        while (got < sizeof(msg)) {
+            ssize_t n = read(fds[0], reinterpret_cast<char*>(&msg) + got, sizeof(msg) - got);
+            if (n <= 0) break;
+            got += n;
+        }
+    }
+    waitpid(pid, nullptr, 0);
+    close(fds[0]);
+    report("two-process unix socket 64B", total, bench_clock::now() - begin);
+}
+
+static void bench_ipc() {
+    std::cout << "== inter-process ==" << std::endl;
+    const std::size_t OPS = 1 << 20;
+    bench_ipc_shm(OPS);
+    bench_ipc_socket(OPS);
+    std::cout << std::endl;
+}
+
+// 对照组: 每个阶段一个RingBuffer，生产者把事件拷贝三份
+static void bench_fanout_copy(std::size_t total) {
+    RingBuffer<Tick, 1024> rings[3];
+    auto begin = bench_clock::now();
+    std::vector<std::thread> stages;
+    for (auto& rb : rings) {
+        stages.emplace_back([&rb, total]() {
+            Tick t;
+            uint64_t sum = 0;
+            for (std::size_t i = 0; i < total; ++i) {
+                while (!rb.pop(t)) std::this_thread::yield();
+                sum += t.price;
+            }
+            volatile uint64_t sink = sum;
+            (void)sink;
+            });
+    }
+    for (std::size_t i = 0; i < total; ++i) {
+        Tick t{ static_cast<uint32_t>(i), 1, i };
+        for (auto& rb : rings) {
+            while (!rb.push(t)) std::this_thread::yield();
+        }
+    }
+    for (auto& t : stages) t.join();
+    report("3 stages, one RingBuffer copy each", total, bench_clock::now() - begin);
+}
+
+// 一次发布，三个消费者各自读取
+static void bench_fanout_broadcast(std::size_t total) {
+    BroadcastRing<Tick, 1024> ring;
+    BroadcastRing<Tick, 1024>::Consumer* consumers[3] = { ring.add_consumer(), ring.add_consumer(), ring.add_consumer() };
+    auto begin = bench_clock::now();
+    std::vector<std::thread> stages;
+    for (auto* c : consumers) {
+        stages.emplace_back([&ring, c, total]() {
+            uint64_t sum = 0;
+            std::size_t done = 0;
+            while (done < total) {
+                std::size_t n = ring.poll(c, [&sum](Tick& t, uint64_t) { sum += t.price; });
+                if (n == 0) std::this_thread::yield();
+                done += n;
+            }
+            volatile uint64_t sink = sum;
+            (void)sink;
+            });
+    }
+    for (std::size_t i = 0; i < total; ++i) {
+        Tick* slot;
+        while ((slot = ring.try_claim()) == nullptr) std::this_thread::yield();
+        *slot = Tick{ static_cast<uint32_t>(i), 1, i };
+        ring.publish();
+    }
+    for (auto& t : stages) t.join();
+    report("3 stages, BroadcastRing", total, bench_clock::now() - begin);
+}
+
+static void bench_fanout() {
+    std::cout << "== broadcast to 3 stages ==" << std::endl;
+    const std::size_t OPS = 1 << 21;
+    bench_fanout_copy(OPS);
+    bench_fanout_broadcast(OPS);
+    std::cout << std::endl;
+}
+
+// 64字节的大元素，1M个槽位就是64MB，访问模式对TLB很敏感
+struct WideEvent
+{
+    uint64_t seq;
+    uint64_t payload[7];
+};
+
+// 冷启动: 构造之后第一波写满队列的耗时，主要是缺页的代价
+static void bench_first_burst(const std::string& name, const RingAllocOptions& options, std::size_t capacity) {
+    auto begin = bench_clock::now();
+    DynamicRingBuffer<WideEvent> rb(capacity, options);
+    auto constructed = bench_clock::now();
+    WideEvent e = {};
+    std::size_t n = 0;
+    while (rb.push(e)) ++n;
+    auto filled = bench_clock::now();
+    std::cout << std::left << std::setw(40) << name
+        << std::right << std::setw(10) << std::fixed << std::setprecision(2)
+        << std::chrono::duration<double, std::milli>(constructed - begin).count() << " ms construct"
+        << std::setw(10) << std::chrono::duration<double, std::milli>(filled - constructed).count() << " ms first burst"
+        << (rb.huge_pages() ? " (hugetlb)" : "") << std::endl;
+}
+
+// 生产者领先消费者半个队列，双方都在大范围内存上流式访问
+static void bench_wide_stream(const std::string& name, const RingAllocOptions& options, std::size_t capacity, std::size_t total) {
+    DynamicRingBuffer<WideEvent> rb(capacity, options);
+    auto begin = bench_clock::now();
+    std::thread producer([&]() {
+        WideEvent e = {};
+        for (std::size_t i = 0; i < total; ++i) {
+            e.seq = i;
+            while (!rb.push(e)) std::this_thread::yield();
+        }
+        });
+    std::thread consumer([&]() {
+        WideEvent e;
+        uint64_t sum = 0;
+        for (std::size_t i = 0; i < total; ++i) {
+            while (!rb.pop(e)) std::this_thread::yield();
+            sum += e.seq;
+        }
+        volatile uint64_t sink = sum;
+        (void)sink;
+        });
+    producer.join();
+    consumer.join();
+    report(name, total, bench_clock::now() - begin);
+}
+
+static void bench_dynamic() {
+    std::cout << "== runtime-sized ring, 1M x 64B slots ==" << std::endl;
+    const std::size_t CAPACITY = 1 << 20;
+    RingAllocOptions cold;
+    cold.prefault = false;
+    RingAllocOptions warm;
+    RingAllocOptions huge;
+    huge.huge_pages = true;
+    bench_first_burst("4K pages, no prefault", cold, CAPACITY);
+    bench_first_burst("4K pages, prefault", warm, CAPACITY);
+    bench_first_burst("huge pages, prefault", huge, CAPACITY);
+    bench_wide_stream("stream 4K pages", warm, CAPACITY, 1 << 23);
+    bench_wide_stream("stream huge pages", huge, CAPACITY, 1 << 23);
+    std::cout << std::endl;
+}
+
+// 非平凡类型: 带堆内存的字符串和较大的结构体
+struct Order
+{
+    std::string symbol;
+    std::string client;
+    uint64_t fields[12];
+
+    Order() = default;
+    Order(const char* s, const char* c, uint64_t id) : symbol(s), client(c) {
+        for (auto& f : fields) f = id;
+    }
+};
+
+static const char* ORDER_SYMBOL = "SYMBOL-LONG-ENOUGH-TO-SKIP-SSO-0001";
+static const char* ORDER_CLIENT = "CLIENT-ACCOUNT-NAME-ALSO-HEAP-ALLOCATED";
+
+// 旧方式: 构造临时对象push进去，pop时移动赋值到调用者的对象再析构槽位
+static void bench_order_push_pop(std::size_t total) {
+    RingBuffer<Order, 1024> rb;
+    auto begin = bench_clock::now();
+    std::thread producer([&]() {
+        for (std::size_t i = 0; i < total; ++i) {
+            while (!rb.push(Order(ORDER_SYMBOL, ORDER_CLIENT, i))) std::this_thread::yield();
+        }
+        });
+    std::thread consumer([&]() {
+        Order o;
+        uint64_t sum = 0;
+        for (std::size_t i = 0; i < total; ++i) {
+            while (!rb.pop(o)) std::this_thread::yield();
+            sum += o.fields[0] + o.symbol.size();
+        }
+        volatile uint64_t sink = sum;
+        (void)sink;
+        });
+    producer.join();
+    consumer.join();
+    report("Order push(tmp)/pop(T&)", total, bench_clock::now() - begin);
+}
+
+// 新方式: emplace直接在槽位上构造，consume就地读取
+static void bench_order_emplace_consume(std::size_t total) {
+    RingBuffer<Order, 1024> rb;
+    auto begin = bench_clock::now();
+    std::thread producer([&]() {
+        for (std::size_t i = 0; i < total; ++i) {
+            while (!rb.emplace(ORDER_SYMBOL, ORDER_CLIENT, i)) std::this_thread::yield();
+        }
+        });
+    std::thread consumer([&]() {
+        uint64_t sum = 0;
+        for (std::size_t i = 0; i < total; ++i) {
+            while (!rb.consume([&sum](Order& o) { sum += o.fields[0] + o.symbol.size(); })) std::this_thread::yield();
+        }
+        volatile uint64_t sink = sum;
+        (void)sink;
+        });
+    producer.join();
+    consumer.join();
+    report("Order emplace/consume", total, bench_clock::now() - begin);
+}
+
+static void bench_in_place() {
+    std::cout << "== in-place emplace/consume (non-trivial T) ==" << std::endl;
+    const std::size_t OPS = 1 << 20;
+    bench_order_push_pop(OPS);
+    bench_order_emplace_consume(OPS);
+    std::cout << std::endl;
+}
+
+// 统计策略的开销: 与bench_spsc_single相同的循环，只换Stats参数
+template <typename Stats>
+static void bench_stats_spsc(const std::string& name, std::size_t total) {
+    RingBuffer<Tick, 4096, true, BusySpinWait, Stats> rb;
+    auto begin = bench_clock::now();
+    std::thread producer([&]() {
+        for (std::size_t i = 0; i < total; ++i) {
+            Tick t{ static_cast<uint32_t>(i), 1, i };
+            while (!rb.push(t)) std::this_thread::yield();
+        }
+        });
+    std::thread consumer([&]() {
+        Tick t;
+        for (std::size_t i = 0; i < total; ++i) {
+            while (!rb.pop(t)) std::this_thread::yield();
+        }
+        });
+    producer.join();
+    consumer.join();
+    report(name, total, bench_clock::now() - begin);
+}
+
+static void bench_stats() {
+    std::cout << "== stats policy overhead ==" << std::endl;
+    const std::size_t OPS = 1 << 22;
+    bench_stats_spsc<NoStats>("NoStats", OPS);
+    bench_stats_spsc<RingStats<6>>("RingStats<6>", OPS);
+    bench_stats_spsc<RingStats<6, true>>("RingStats<6, latency>", OPS);
+    bench_stats_spsc<RingStats<0, true>>("RingStats<0, latency>", OPS);
+    std::cout << std::endl;
+}
+
+// 对照组: 目前的做法，所有线程共用一个加锁的全局队列
+class GlobalQueuePool
+{
+public:
+    explicit GlobalQueuePool(std::size_t threads) : stop_(false) {
+        for (std::size_t i = 0; i < threads; ++i) {
+            threads_.emplace_back([this]() {
+                for (;;) {
+                    std::function<void()> task;
+                    {
+                        std::unique_lock<std::mutex> lock(mutex_);
+                        cond_.wait(lock, [this]() { return stop_ || !tasks_.empty(); });
+                        if (tasks_.empty()) return;
+                        task = std::move(tasks_.front());
+                        tasks_.pop_front();
+                    }
+                    task();
+                }
+                });
+        }
+    }
+
+    ~GlobalQueuePool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        cond_.notify_all();
+        for (auto& t : threads_) t.join();
+    }
+
+    template<typename F>
+    void submit(F&& f) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            tasks_.emplace_back(std::forward<F>(f));
+        }
+        cond_.notify_one();
+    }
+
+    bool run_one() {
+        std::function<void()> task;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (tasks_.empty()) return false;
+            task = std::move(tasks_.front());
+            tasks_.pop_front();
+        }
+        task();
+        return true;
+    }
+
+    template<typename Pred>
+    void wait_until(Pred&& done) {
+        while (!done()) {
+            if (!run_one()) std::this_thread::yield();
+        }
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    std::deque<std::function<void()>> tasks_;
+    std::vector<std::thread> threads_;
+    bool stop_;
+};
+
+// fork-join: 递归的fib，小于阈值时串行计算
+template <typename Pool>
+static uint64_t pool_fib(Pool& pool, int n) {
+    if (n < 18) {
+        uint64_t a = 0, b = 1;
+        for (int i = 0; i < n; ++i) {
+            uint64_t c = a + b;
+            a = b;
+            b = c;
+        }
+        /*模拟叶子任务的计算量*/
+        volatile uint64_t spin = 0;
+        for (int i = 0; i < 2000; ++i) spin = spin + i;
+        return a;
+    }
+    std::atomic<int> pending(1);
+    uint64_t left = 0;
+    pool.submit([&pool, &left, &pending, n]() {
+        left = pool_fib(pool, n - 1);
+        pending.store(0, std::memory_order_release);
+        });
+    uint64_t right = pool_fib(pool, n - 2);
+    pool.wait_until([&pending]() { return pending.load(std::memory_order_acquire) == 0; });
+    return left + right;
+}
+
+template <typename Pool>
+static void bench_fork_join(const std::string& name, std::size_t threads) {
+    Pool pool(threads);
+    std::atomic<bool> done(false);
+    uint64_t result = 0;
+    auto begin = bench_clock::now();
+    pool.submit([&]() {
+        result = pool_fib(pool, 30);
+        done.store(true, std::memory_order_release);
+        });
+    pool.wait_until([&done]() { return done.load(std::memory_order_acquire); });
+    double ms = std::chrono::duration<double, std::milli>(bench_clock::now() - begin).count();
+    std::cout << std::left << std::setw(40) << (name + " fork-join fib(30) " + std::to_string(threads) + "T")
+        << std::right << std::setw(10) << std::fixed << std::setprecision(2) << ms << " ms" << std::endl;
+    (void)result;
+}
+
+// 大量小任务: 外部提交少量根任务，每个根任务在线程池内部再提交许多小任务
+template <typename Pool>
+static void bench_small_tasks(const std::string& name, std::size_t threads) {
+    const int ROOTS = 64;
+    const int PER_ROOT = 8192;
+    Pool pool(threads);
+    std::atomic<int> remaining(ROOTS * PER_ROOT);
+    auto begin = bench_clock::now();
+    for (int r = 0; r < ROOTS; ++r) {
+        pool.submit([&pool, &remaining]() {
+            for (int i = 0; i < PER_ROOT; ++i) {
+                pool.submit([&remaining]() { remaining.fetch_sub(1, std::memory_order_relaxed); });
+            }
+            });
+    }
+    pool.wait_until([&remaining]() { return remaining.load(std::memory_order_relaxed) == 0; });
+    report(name + " small tasks " + std::to_string(threads) + "T", ROOTS * PER_ROOT, bench_clock::now() - begin);
+}
+
+static void bench_thread_pool() {
+    std::cout << "== work-stealing pool vs global queue ==" << std::endl;
+    for (std::size_t n : { 1, 2, 4, 8 }) {
+        bench_fork_join<ThreadPool>("stealing", n);
+        bench_fork_join<GlobalQueuePool>("global ", n);
+    }
+    for (std::size_t n : { 1, 2, 4, 8 }) {
+        bench_small_tasks<ThreadPool>("stealing", n);
+        bench_small_tasks<GlobalQueuePool>("global ", n);
+    }
+    std::cout << std::endl;
+}
+
+int main() {
+    bench_mpmc_scaling();
+    bench_spsc_batching();
+    bench_in_place();
+    bench_stats();
+    bench_index_cache();
+    bench_wait_strategies();
+    bench_variable_length();
+    bench_ipc();
+    bench_fanout();
+    bench_dynamic();
+    bench_thread_pool();
+    return 0;
+}
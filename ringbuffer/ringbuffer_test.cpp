@@ -1,10 +1,26 @@
 #include "ringbuffer.hpp"
+#include "mpmc_queue.hpp"
+#include "notifying_ringbuffer.hpp"
+#include "record_ring.hpp"
+#include "shm_ringbuffer.hpp"
+#include "broadcast_ring.hpp"
+#include "dynamic_ringbuffer.hpp"
+#include "work_stealing_deque.hpp"
+#include "thread_pool.hpp"
 #include <iostream>
 #include <thread>
 #include <vector>
 #include <string>
 #include <cassert>
 #include <chrono>
+#include <atomic>
+#include <iterator>
+#include <ctime>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <cstring>
+#include <sys/wait.h>
+#include <sys/resource.h>
 
 // 测试POD类型（int）
 void test_pod_type() {
@@ -128,11 +144,895 @@ void test_edge_cases() {
     std::cout << "Edge cases test passed.\n" << std::endl;
 }
 
+// 测试关闭下标缓存（旧行为）与开启缓存的结果一致
+// 小容量下生产者和消费者不断追上对方，缓存的对方下标频繁过期
+template <bool CacheIndex>
+static void stale_cache_reload() {
+    const int DATA_SIZE = 100000;
+    RingBuffer<int, 16, CacheIndex> rb;
+    std::thread producer([&rb]() {
+        for (int i = 0; i < DATA_SIZE; ++i) {
+            while (!rb.push(i)) std::this_thread::yield();
+        }
+        });
+    int expected = 0;
+    int val;
+    while (expected < DATA_SIZE) {
+        if (!rb.pop(val)) {
+            std::this_thread::yield();
+            continue;
+        }
+        assert(val == expected++);
+    }
+    producer.join();
+}
+
+void test_index_cache_switch() {
+    std::cout << "Testing index cache switch..." << std::endl;
+    RingBuffer<int, 4, true> cached;
+    RingBuffer<int, 4, false> uncached;
+    int a, b;
+    for (int round = 0; round < 10; ++round) {
+        for (int i = 0; i < 4; ++i) {
+            assert(cached.push(round * 4 + i) == uncached.push(round * 4 + i));
+        }
+        assert(cached.size() == 3 && uncached.size() == 3);
+        for (int i = 0; i < 4; ++i) {
+            bool ok = cached.pop(a);
+            assert(ok == uncached.pop(b));
+            if (ok) assert(a == b);
+        }
+    }
+
+    // 缓存值过期时必须重新读取对方下标
+    stale_cache_reload<true>();
+    stale_cache_reload<false>();
+
+    std::cout << "Index cache switch test passed.\n" << std::endl;
+}
+
+// 测试批量接口push_n/pop_n/consume_n
+void test_batch() {
+    std::cout << "Testing batch push_n/pop_n/consume_n..." << std::endl;
+    RingBuffer<std::string, 8> rb;
+    std::vector<std::string> in = { "a", "b", "c", "d", "e", "f", "g", "h", "i" };
+
+    // 只能写入Capacity-1个
+    assert(rb.push_n(in.begin(), in.end()) == 7);
+    assert(rb.size() == 7);
+
+    std::vector<std::string> out;
+    assert(rb.pop_n(std::back_inserter(out), 3) == 3);
+    assert((out == std::vector<std::string>{ "a", "b", "c" }));
+
+    // 移动写入，写位置绕回
+    std::vector<std::string> more = { "x", "y", "z" };
+    assert(rb.push_n(std::make_move_iterator(more.begin()), std::make_move_iterator(more.end())) == 3);
+    assert(rb.size() == 7);
+
+    // 跨越绕回点的就地读取会分成两段回调
+    std::vector<std::string> seen;
+    int calls = 0;
+    std::size_t n = rb.consume_n([&](std::string* data, std::size_t count) {
+        ++calls;
+        seen.insert(seen.end(), data, data + count);
+        }, 100);
+    assert(n == 7);
+    assert(calls == 2);
+    assert((seen == std::vector<std::string>{ "d", "e", "f", "g", "x", "y", "z" }));
+    assert(rb.size() == 0);
+    assert(rb.pop_n(std::back_inserter(out), 4) == 0);
+    assert(rb.consume_n([](std::string*, std::size_t) { assert(false); }, 4) == 0);
+
+    std::cout << "Batch test passed.\n" << std::endl;
+}
+
+// 批量接口的单生产者单消费者多线程场景
+void test_batch_multithread() {
+    std::cout << "Testing batch SPSC multithread scenario..." << std::endl;
+    const int DATA_SIZE = 100000;
+    RingBuffer<int, 1024> rb;
+
+    std::thread producer([&rb]() {
+        int buf[64];
+        int next = 0;
+        while (next < DATA_SIZE) {
+            int count = std::min(64, DATA_SIZE - next);
+            for (int i = 0; i < count; ++i) buf[i] = next + i;
+            next += static_cast<int>(rb.push_n(buf, buf + count));
+            std::this_thread::yield();
+        }
+        });
+
+    std::thread consumer([&rb]() {
+        int expected = 0;
+        int buf[64];
+        while (expected < DATA_SIZE) {
+            std::size_t n = rb.pop_n(buf, 64);
+            for (std::size_t i = 0; i < n; ++i) {
+                assert(buf[i] == expected);
+                expected++;
+            }
+            if (n == 0) std::this_thread::yield();
+        }
+        });
+
+    producer.join();
+    consumer.join();
+    assert(rb.size() == 0);
+
+    std::cout << "Batch SPSC multithread test passed.\n" << std::endl;
+}
+
+// 使用阻塞读取pop_wait的单生产者单消费者场景
+template <typename Wait>
+void run_pop_wait(const char* name) {
+    const int DATA_SIZE = 20000;
+    RingBuffer<int, 64, true, Wait> rb;
+    std::thread consumer([&rb]() {
+        int val;
+        for (int expected = 0; expected < DATA_SIZE; ++expected) {
+            rb.pop_wait(val);
+            assert(val == expected);
+        }
+        });
+    for (int i = 0; i < DATA_SIZE; ++i) {
+        while (!rb.push(i)) std::this_thread::yield();
+        if (i % 1000 == 0) {
+            // 偶尔停一下，让消费者进入睡眠
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+        }
+    }
+    consumer.join();
+    assert(rb.size() == 0);
+    std::cout << "  " << name << " ok" << std::endl;
+}
+
+// 阻塞策略下空闲的消费者不应该消耗CPU
+template <typename Wait>
+void run_idle_consumer(const char* name) {
+    RingBuffer<int, 64, true, Wait> rb;
+    double cpu_ms = 0;
+    std::thread consumer([&]() {
+        struct timespec begin, end;
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &begin);
+        int val;
+        rb.pop_wait(val);
+        assert(val == 42);
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &end);
+        cpu_ms = (end.tv_sec - begin.tv_sec) * 1e3 + (end.tv_nsec - begin.tv_nsec) / 1e6;
+        });
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    assert(rb.push(42));
+    consumer.join();
+    assert(cpu_ms < 50);
+    std::cout << "  " << name << " idle cpu " << cpu_ms << " ms" << std::endl;
+}
+
+void test_wait_strategies() {
+    std::cout << "Testing wait strategies..." << std::endl;
+    run_pop_wait<BusySpinWait>("BusySpinWait");
+    run_pop_wait<SpinYieldWait<>>("SpinYieldWait");
+    run_pop_wait<FutexWait<>>("FutexWait");
+    run_pop_wait<EventfdWait<>>("EventfdWait");
+    run_idle_consumer<FutexWait<>>("FutexWait");
+    run_idle_consumer<EventfdWait<>>("EventfdWait");
+    std::cout << "Wait strategies test passed.\n" << std::endl;
+}
+
+static bool fd_readable(int fd) {
+    struct pollfd pfd = { fd, POLLIN, 0 };
+    return poll(&pfd, 1, 0) == 1;
+}
+
+// 测试eventfd通知的RingBuffer: 只有空变为非空时才写eventfd
+void test_notifying_ringbuffer() {
+    std::cout << "Testing notifying ringbuffer..." << std::endl;
+    NotifyingRingBuffer<int, 8> rb;
+    assert(rb.valid() && rb.fd() >= 0);
+    assert(!fd_readable(rb.fd()));
+
+    assert(rb.push(1));
+    assert(fd_readable(rb.fd()));
+    assert(rb.push(2));
+    assert(rb.push(3));
+
+    std::vector<int> got;
+    // 限制数量时fd保持可读，下一轮继续处理
+    assert(rb.drain([&got](int& v) { got.push_back(v); }, 2) == 2);
+    assert(fd_readable(rb.fd()));
+    assert(rb.drain([&got](int& v) { got.push_back(v); }) == 1);
+    assert((got == std::vector<int>{ 1, 2, 3 }));
+    assert(!fd_readable(rb.fd()));
+
+    // 连续push只写一次eventfd
+    assert(rb.push(4));
+    assert(rb.push(5));
+    uint64_t counter = 0;
+    assert(read(rb.fd(), &counter, sizeof(counter)) == sizeof(counter));
+    assert(counter == 1);
+    assert(rb.drain([&got](int& v) { got.push_back(v); }) == 2);
+
+    // 与epoll配合: 另一个线程的push能及时唤醒epoll_wait
+    const int DATA_SIZE = 20000;
+    NotifyingRingBuffer<int, 64> q;
+    int epfd = epoll_create1(0);
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.fd = q.fd();
+    assert(epoll_ctl(epfd, EPOLL_CTL_ADD, q.fd(), &ev) == 0);
+    std::thread producer([&q]() {
+        for (int i = 0; i < DATA_SIZE; ++i) {
+            while (!q.push(i)) std::this_thread::yield();
+            if (i % 1000 == 0) std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+        });
+    int expected = 0;
+    while (expected < DATA_SIZE) {
+        struct epoll_event evs[4];
+        int n = epoll_wait(epfd, evs, 4, -1);
+        assert(n >= 0);
+        q.drain([&expected](int& v) { assert(v == expected); expected++; });
+    }
+    producer.join();
+    close(epfd);
+
+    // fd用完时eventfd创建失败: valid()报告出来，pop_wait退化为自旋而不是在fd -1上永远睡眠
+    pid_t pid = fork();
+    assert(pid >= 0);
+    if (pid == 0) {
+        struct rlimit lim = { 0, 0 };
+        setrlimit(RLIMIT_NOFILE, &lim);
+        NotifyingRingBuffer<int, 8> broken;
+        RingBuffer<int, 8, true, EventfdWait<>> waiting;
+        if (broken.valid() || broken.fd() != -1 || waiting.wait_strategy().valid()) _exit(1);
+        std::thread producer([&waiting]() {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            while (!waiting.push(7)) {}
+            });
+        int v = 0;
+        waiting.pop_wait(v);
+        producer.join();
+        _exit(v == 7 ? 0 : 1);
+    }
+    int status = 0;
+    assert(waitpid(pid, &status, 0) == pid);
+    assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+    std::cout << "Notifying ringbuffer test passed.\n" << std::endl;
+}
+
+// 测试变长记录环形缓冲区
+void test_record_ring() {
+    std::cout << "Testing record ring..." << std::endl;
+    RecordRing<128> ring;
+    assert(!ring.peek());
+
+    // reserve/commit直接在缓冲区里写
+    uint8_t* p = ring.reserve(10);
+    assert(p != nullptr);
+    std::memcpy(p, "0123456789", 10);
+    ring.commit(5);  // 只提交实际用到的部分
+    assert(ring.push("hello world", 11));
+
+    RecordRing<128>::Record rec = ring.peek();
+    assert(rec && rec.size == 5 && std::memcmp(rec.data, "01234", 5) == 0);
+    ring.release();
+    rec = ring.peek();
+    assert(rec && rec.size == 11 && std::memcmp(rec.data, "hello world", 11) == 0);
+    ring.release();
+    assert(ring.empty() && !ring.peek());
+
+    // 前面两条记录占了16+24=40字节，再放一条48字节的记录（占56字节）后尾部只剩32字节
+    uint8_t big[100];
+    for (int i = 0; i < 100; ++i) big[i] = static_cast<uint8_t>(i);
+    assert(ring.push(big, 48));
+    assert(ring.used_bytes() == 56);
+    // 48字节的记录需要跳过尾部32字节再占56字节，总共88字节，而空闲只有72字节
+    assert(ring.reserve(48) == nullptr);
+    // reserve失败之后commit什么都不做，不会覆盖未读的记录
+    ring.commit();
+    ring.commit(10);
+    assert(ring.used_bytes() == 56);
+    rec = ring.peek();
+    assert(rec && rec.size == 48 && std::memcmp(rec.data, big, 48) == 0);
+    ring.release();
+    // 现在可以绕回到开头，区域依旧连续
+    p = ring.reserve(48);
+    assert(p != nullptr);
+    std::memcpy(p, big, 48);
+    ring.commit();
+    assert(ring.used_bytes() == 32 + 56);
+    rec = ring.peek();
+    assert(rec.data == p);
+    assert(rec && rec.size == 48 && std::memcmp(rec.data, big, 48) == 0);
+    ring.release();
+    assert(ring.empty());
+
+    // 超过容量的记录永远放不下
+    assert(ring.reserve(RecordRing<128>::max_record_size() + 1) == nullptr);
+    assert(ring.reserve(RecordRing<128>::max_record_size()) != nullptr);
+    ring.commit(0);
+    rec = ring.peek();
+    assert(rec && rec.size == 0);
+    ring.release();
+
+    // 多线程下传递不同长度的记录
+    const int DATA_SIZE = 50000;
+    RecordRing<4096> mt;
+    std::thread producer([&mt]() {
+        for (int i = 0; i < DATA_SIZE; ++i) {
+            std::size_t len = 4 + i % 200;
+            uint8_t* dst;
+            while ((dst = mt.reserve(len)) == nullptr) std::this_thread::yield();
+            std::memcpy(dst, &i, 4);
+            std::memset(dst + 4, static_cast<uint8_t>(i), len - 4);
+            mt.commit();
+        }
+        });
+    for (int expected = 0; expected < DATA_SIZE; ++expected) {
+        RecordRing<4096>::Record r;
+        while (!(r = mt.peek())) std::this_thread::yield();
+        int val;
+        std::memcpy(&val, r.data, 4);
+        assert(val == expected);
+        assert(r.size == static_cast<std::size_t>(4 + expected % 200));
+        for (std::size_t i = 4; i < r.size; ++i) assert(r.data[i] == static_cast<uint8_t>(expected));
+        mt.release();
+    }
+    producer.join();
+    assert(mt.empty());
+
+    std::cout << "Record ring test passed.\n" << std::endl;
+}
+
+// 测试跨进程共享内存RingBuffer
+void test_shm_ringbuffer() {
+    std::cout << "Testing shared-memory ringbuffer..." << std::endl;
+    struct Msg
+    {
+        int seq;
+        char tag[12];
+    };
+
+    // 版本和大小检查: 模板参数不一致时attach失败
+    ShmRingBuffer<Msg, 16> owner;
+    assert(owner.create_memfd());
+    ShmRingBuffer<Msg, 32> wrong_capacity;
+    assert(!wrong_capacity.attach_fd(owner.fd()));
+    ShmRingBuffer<int, 16> wrong_type;
+    assert(!wrong_type.attach_fd(owner.fd()));
+    ShmRingBuffer<Msg, 16> peer;
+    assert(peer.attach_fd(owner.fd()));
+    Msg m = { 7, "seven" };
+    assert(owner.push(m));
+    Msg out;
+    assert(peer.pop(out) && out.seq == 7 && std::strcmp(out.tag, "seven") == 0);
+    assert(!peer.pop(out));
+
+    // 子进程通过名字attach后写入，父进程读取
+    const int DATA_SIZE = 100000;
+    char name[64];
+    snprintf(name, sizeof(name), "/rb_test_%d", static_cast<int>(getpid()));
+    ShmRingBuffer<Msg, 1024> parent;
+    assert(parent.create(name));
+    ShmRingBuffer<Msg, 1024> duplicate;
+    assert(!duplicate.create(name));  // 已存在
+    pid_t pid = fork();
+    assert(pid >= 0);
+    if (pid == 0) {
+        ShmRingBuffer<Msg, 1024> child;
+        if (!child.attach(name)) _exit(1);
+        for (int i = 0; i < DATA_SIZE; ++i) {
+            Msg msg = { i, "child" };
+            while (!child.push(msg)) sched_yield();
+        }
+        _exit(0);
+    }
+    for (int expected = 0; expected < DATA_SIZE; ++expected) {
+        while (!parent.pop(out)) sched_yield();
+        assert(out.seq == expected);
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+    assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    assert((ShmRingBuffer<Msg, 1024>::unlink(name)));
+    assert(parent.size() == 0);
+
+    std::cout << "Shared-memory ringbuffer test passed.\n" << std::endl;
+}
+
+// 统计构造次数，用来验证广播环形缓冲区的槽位原地复用
+struct CountedEvent
+{
+    static std::atomic<int> constructed;
+    uint64_t value = 0;
+    CountedEvent() { constructed.fetch_add(1, std::memory_order_relaxed); }
+    CountedEvent& operator=(uint64_t v) { value = v; return *this; }
+};
+std::atomic<int> CountedEvent::constructed(0);
+
+// 测试广播环形缓冲区: 多个独立消费者，以及依赖阶段
+void test_broadcast_ring() {
+    std::cout << "Testing broadcast ring..." << std::endl;
+    CountedEvent::constructed.store(0);
+    BroadcastRing<CountedEvent, 64> ring;
+    auto* persist = ring.add_consumer();
+    auto* analytics = ring.add_consumer();
+    auto* forward = ring.add_consumer({ persist });  // 持久化之后才能转发
+    assert(CountedEvent::constructed.load() == 64);
+
+    // 单线程: 生产者受最慢的消费者限制
+    for (uint64_t i = 0; i < 64; ++i) assert(ring.push(i));
+    assert(ring.try_claim() == nullptr);
+    // forward依赖persist，persist还没处理时forward什么都拿不到
+    assert(ring.poll(forward, [](CountedEvent&, uint64_t) {}) == 0);
+    assert(ring.poll(persist, [](CountedEvent& e, uint64_t seq) { assert(e.value == seq); }, 10) == 10);
+    assert(ring.poll(forward, [](CountedEvent& e, uint64_t seq) { assert(e.value == seq); }) == 10);
+    // analytics还没处理，生产者仍然不能覆盖
+    assert(ring.try_claim() == nullptr);
+    assert(ring.poll(analytics, [](CountedEvent&, uint64_t) {}) == 64);
+    assert(ring.push(64));
+    // 每次poll处理到上次看到的上界为止，直到取空
+    auto drain = [&ring](BroadcastRing<CountedEvent, 64>::Consumer* c) {
+        std::size_t total = 0, n;
+        while ((n = ring.poll(c, [](CountedEvent& e, uint64_t seq) { assert(e.value == seq); })) != 0) total += n;
+        return total;
+    };
+    assert(drain(persist) == 55);
+    assert(drain(forward) == 55);
+    assert(drain(analytics) == 1);
+
+    // 多线程: 每个消费者都按顺序看到全部事件
+    const uint64_t DATA_SIZE = 200000;
+    BroadcastRing<CountedEvent, 256> mt;
+    auto* a = mt.add_consumer();
+    auto* b = mt.add_consumer();
+    auto* c = mt.add_consumer({ a, b });
+    std::vector<std::thread> stages;
+    for (auto* consumer : { a, b, c }) {
+        stages.emplace_back([&mt, consumer, a, b, c, DATA_SIZE]() {
+            uint64_t expected = 0;
+            while (expected < DATA_SIZE) {
+                std::size_t n = mt.poll(consumer, [&](CountedEvent& e, uint64_t seq) {
+                    assert(seq == expected);
+                    assert(e.value == expected);
+                    if (consumer == c) {
+                        // 依赖的阶段一定已经处理过这个事件
+                        assert(a->sequence() > seq && b->sequence() > seq);
+                    }
+                    expected++;
+                    });
+                if (n == 0) std::this_thread::yield();
+            }
+            });
+    }
+    for (uint64_t i = 0; i < DATA_SIZE; ++i) {
+        while (!mt.push(i)) std::this_thread::yield();
+    }
+    for (auto& t : stages) t.join();
+    assert(mt.published() == DATA_SIZE);
+    // 两个环形缓冲区一共只构造过64+256个事件对象
+    assert(CountedEvent::constructed.load() == 64 + 256);
+
+    std::cout << "Broadcast ring test passed.\n" << std::endl;
+}
+
+// 测试运行时容量的RingBuffer
+void test_dynamic_ringbuffer() {
+    std::cout << "Testing dynamic ringbuffer..." << std::endl;
+    DynamicRingBuffer<std::string> rb(5);  // 向上取整为8
+    assert(rb.valid());
+    assert(rb.capacity() == 8);
+    for (int i = 0; i < 7; ++i) assert(rb.push(std::to_string(i)));
+    assert(!rb.push("full"));
+    assert(rb.size() == 7);
+    std::string val;
+    for (int i = 0; i < 7; ++i) {
+        assert(rb.pop(val));
+        assert(val == std::to_string(i));
+    }
+    assert(!rb.pop(val));
+    // 留几个元素给析构函数处理
+    assert(rb.push("left"));
+    assert(rb.push("over"));
+
+    // 大页选项: 没有预留大页时退回普通页，队列依旧可用
+    RingAllocOptions options;
+    options.huge_pages = true;
+    DynamicRingBuffer<uint64_t> big(1 << 20, options);
+    assert(big.valid());
+    assert(big.capacity() == (1 << 20));
+    const uint64_t DATA_SIZE = 3 << 20;  // 绕三圈
+    std::thread producer([&big, DATA_SIZE]() {
+        for (uint64_t i = 0; i < DATA_SIZE; ++i) {
+            while (!big.push(i)) std::this_thread::yield();
+        }
+        });
+    uint64_t v;
+    for (uint64_t expected = 0; expected < DATA_SIZE; ++expected) {
+        while (!big.pop(v)) std::this_thread::yield();
+        assert(v == expected);
+    }
+    producer.join();
+    assert(big.size() == 0);
+
+    std::cout << "Dynamic ringbuffer test passed" << (big.huge_pages() ? " (hugetlb)" : "") << ".\n" << std::endl;
+}
+
+// 统计拷贝、移动和析构次数
+struct Tracked
+{
+    static int moves;
+    static int destroys;
+    std::string name;
+    int id;
+    Tracked(std::string n, int i) : name(std::move(n)), id(i) {}
+    Tracked(Tracked&& other) noexcept : name(std::move(other.name)), id(other.id) { ++moves; }
+    Tracked& operator=(Tracked&& other) noexcept { name = std::move(other.name); id = other.id; ++moves; return *this; }
+    ~Tracked() { ++destroys; }
+};
+int Tracked::moves = 0;
+int Tracked::destroys = 0;
+
+// 测试emplace/front/pop_front/consume
+void test_in_place() {
+    std::cout << "Testing emplace/consume..." << std::endl;
+    {
+        RingBuffer<Tracked, 4> rb;
+        Tracked::moves = Tracked::destroys = 0;
+        assert(rb.emplace("alpha", 1));
+        assert(rb.emplace(std::string(40, 'b'), 2));
+        assert(rb.emplace("gamma", 3));
+        assert(!rb.emplace("full", 4));
+        assert(Tracked::moves == 0);  // 直接在槽位上构造
+
+        Tracked* head = rb.front();
+        assert(head != nullptr && head->name == "alpha" && head->id == 1);
+        head->name += "!";  // 可以原地修改
+        assert(rb.front()->name == "alpha!");
+        rb.pop_front();
+        assert(Tracked::destroys == 1);
+
+        bool ok = rb.consume([](Tracked& t) {
+            assert(t.id == 2 && t.name.size() == 40);
+            });
+        assert(ok);
+        assert(rb.consume([](Tracked& t) { assert(t.id == 3); }));
+        assert(!rb.consume([](Tracked&) { assert(false); }));
+        assert(rb.front() == nullptr);
+        assert(Tracked::moves == 0);
+        assert(Tracked::destroys == 3);
+        assert(rb.emplace("left", 5));
+    }
+    assert(Tracked::destroys == 4);  // 剩余元素由析构函数处理
+
+    // 多线程下emplace + consume
+    const int DATA_SIZE = 100000;
+    RingBuffer<std::string, 256> rb;
+    std::thread producer([&rb]() {
+        for (int i = 0; i < DATA_SIZE; ++i) {
+            while (!rb.emplace(static_cast<std::size_t>(i % 50), static_cast<char>('a' + i % 26))) std::this_thread::yield();
+        }
+        });
+    for (int expected = 0; expected < DATA_SIZE; ++expected) {
+        while (!rb.consume([expected](std::string& s) {
+            assert(s == std::string(expected % 50, static_cast<char>('a' + expected % 26)));
+            })) {
+            std::this_thread::yield();
+        }
+    }
+    producer.join();
+
+    std::cout << "Emplace/consume test passed.\n" << std::endl;
+}
+
+// 测试统计策略
+void test_stats() {
+    std::cout << "Testing ring stats..." << std::endl;
+    // 默认的NoStats不占空间: 大小与去掉stats_成员的同样布局相同，而真正的统计会让对象变大
+    struct NoStatsLayout
+    {
+        alignas(64) std::atomic<std::size_t> read;
+        std::size_t write_cache;
+        alignas(64) std::atomic<std::size_t> write;
+        std::size_t read_cache;
+        alignas(64) BusySpinWait wait;
+        alignas(64) std::aligned_storage_t<sizeof(int), alignof(int)> buffer[64];
+    };
+    static_assert(sizeof(RingBuffer<int, 64>) == sizeof(NoStatsLayout), "NoStats must be free");
+    static_assert(sizeof(RingBuffer<int, 64, true, BusySpinWait, RingStats<>>) > sizeof(NoStatsLayout), "layout check must see a stats member");
+
+    {
+        // 每次push都采样
+        RingBuffer<int, 8, true, BusySpinWait, RingStats<0>> rb;
+        int val;
+        assert(!rb.pop(val));
+        assert(rb.front() == nullptr);
+        assert(rb.stats().pop_empty() == 2);
+
+        for (int i = 0; i < 5; ++i) assert(rb.push(i));
+        assert(rb.stats().high_water() == 5);
+        assert(rb.stats().push_full() == 0);
+        for (int i = 0; i < 5; ++i) assert(rb.pop(val));
+        assert(rb.stats().high_water() == 5);
+
+        for (int i = 0; i < 7; ++i) assert(rb.push(i));
+        assert(!rb.push(7));
+        int more[] = { 1, 2 };
+        assert(rb.push_n(more, more + 2) == 0);
+        assert(rb.stats().push_full() == 2);
+        assert(rb.stats().high_water() == 7);
+
+        uint64_t samples = 0;
+        for (std::size_t b = 0; b < RingStats<0>::OCCUPANCY_BUCKETS; ++b) {
+            samples += rb.stats().occupancy_histogram(b);
+        }
+        assert(samples == 12);
+        assert(rb.stats().occupancy_histogram(7 * RingStats<0>::OCCUPANCY_BUCKETS / 8) == 1);
+
+        int out[8];
+        assert(rb.pop_n(out, 8) == 7);
+        assert(rb.pop_n(out, 8) == 0);
+        assert(rb.consume_n([](int*, std::size_t) {}, 4) == 0);
+        assert(rb.stats().pop_empty() == 4);
+    }
+
+    {
+        // 跨线程: 记录延迟，另一个线程可以同时读取计数器
+        const int DATA_SIZE = 100000;
+        RingBuffer<int, 64, true, BusySpinWait, RingStats<4, true>> rb;
+        std::atomic<bool> done(false);
+        std::thread producer([&rb]() {
+            for (int i = 0; i < DATA_SIZE; ++i) {
+                while (!rb.push(i)) std::this_thread::yield();
+            }
+            });
+        std::thread monitor([&rb, &done]() {
+            uint64_t last = 0;
+            while (!done.load()) {
+                uint64_t full = rb.stats().push_full();
+                assert(full >= last);
+                last = full;
+                std::this_thread::yield();
+            }
+            });
+        int val;
+        for (int i = 0; i < DATA_SIZE; ++i) {
+            while (!rb.pop(val)) std::this_thread::yield();
+            assert(val == i);
+        }
+        producer.join();
+        done = true;
+        monitor.join();
+
+        uint64_t latencies = 0;
+        for (std::size_t b = 0; b < RingStats<4, true>::LATENCY_BUCKETS; ++b) {
+            latencies += rb.stats().latency_histogram(b);
+        }
+        assert(latencies == DATA_SIZE / 16);  // 每16次push打一个时间戳，都被消费者记录
+        assert(rb.stats().high_water() <= 63);
+    }
+
+    std::cout << "Ring stats test passed.\n" << std::endl;
+}
+
+// 测试工作窃取队列
+void test_work_stealing_deque() {
+    std::cout << "Testing work-stealing deque..." << std::endl;
+    WorkStealingDeque<int> dq(4);
+    int val;
+    assert(!dq.pop(val));
+    assert(!dq.steal(val));
+    // 超过初始容量时自动扩容
+    for (int i = 0; i < 10; ++i) dq.push(i);
+    assert(dq.capacity() >= 10);
+    assert(dq.size() == 10);
+    // 拥有者从底部取最新的，窃取者从顶部取最老的
+    assert(dq.pop(val) && val == 9);
+    assert(dq.steal(val) && val == 0);
+    assert(dq.steal(val) && val == 1);
+    assert(dq.pop(val) && val == 8);
+    for (int expected = 7; expected >= 2; --expected) {
+        assert(dq.pop(val) && val == expected);
+    }
+    assert(!dq.pop(val));
+    assert(dq.empty());
+
+    // 拥有者一边push/pop一边被多个窃取者窃取，每个元素恰好被取走一次
+    const int DATA_SIZE = 200000;
+    const int THIEVES = 3;
+    WorkStealingDeque<int> shared(16);
+    std::vector<std::atomic<int>> seen(DATA_SIZE);
+    for (auto& s : seen) s.store(0);
+    std::atomic<int> taken(0);
+    std::vector<std::thread> thieves;
+    for (int i = 0; i < THIEVES; ++i) {
+        thieves.emplace_back([&]() {
+            int v;
+            while (taken.load(std::memory_order_relaxed) < DATA_SIZE) {
+                if (shared.steal(v)) {
+                    seen[v].fetch_add(1);
+                    taken.fetch_add(1);
+                }
+                else {
+                    std::this_thread::yield();
+                }
+            }
+            });
+    }
+    for (int i = 0; i < DATA_SIZE; ++i) {
+        shared.push(i);
+        if (i % 3 == 0 && shared.pop(val)) {
+            seen[val].fetch_add(1);
+            taken.fetch_add(1);
+        }
+    }
+    while (shared.pop(val)) {
+        seen[val].fetch_add(1);
+        taken.fetch_add(1);
+    }
+    for (auto& t : thieves) t.join();
+    assert(taken.load() == DATA_SIZE);
+    for (int i = 0; i < DATA_SIZE; ++i) assert(seen[i].load() == 1);
+
+    std::cout << "Work-stealing deque test passed.\n" << std::endl;
+}
+
+// 递归fork-join求和，子任务在工作线程内部提交
+static void parallel_sum(ThreadPool& pool, const std::vector<int>& data, std::size_t begin, std::size_t end, std::atomic<long>& result) {
+    if (end - begin <= 1000) {
+        long sum = 0;
+        for (std::size_t i = begin; i < end; ++i) sum += data[i];
+        result.fetch_add(sum);
+        return;
+    }
+    std::size_t mid = begin + (end - begin) / 2;
+    std::atomic<int> pending(1);
+    pool.submit([&pool, &data, mid, end, &result, &pending]() {
+        parallel_sum(pool, data, mid, end, result);
+        pending.fetch_sub(1);
+        });
+    parallel_sum(pool, data, begin, mid, result);
+    pool.wait_until([&pending]() { return pending.load() == 0; });
+}
+
+// 测试工作窃取线程池
+void test_thread_pool() {
+    std::cout << "Testing thread pool..." << std::endl;
+    std::atomic<int> counter(0);
+    {
+        ThreadPool pool(4);
+        assert(pool.size() == 4);
+        for (int i = 0; i < 10000; ++i) {
+            pool.submit([&counter]() { counter.fetch_add(1); });
+        }
+        pool.wait_until([&counter]() { return counter.load() == 10000; });
+
+        // 空闲一段时间后工作线程挂起，新的任务依旧能唤醒它们
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        std::vector<int> data(1000000);
+        long expected = 0;
+        for (std::size_t i = 0; i < data.size(); ++i) {
+            data[i] = static_cast<int>(i % 100);
+            expected += data[i];
+        }
+        std::atomic<long> result(0);
+        std::atomic<bool> done(false);
+        pool.submit([&]() {
+            parallel_sum(pool, data, 0, data.size(), result);
+            done.store(true);
+            });
+        pool.wait_until([&done]() { return done.load(); });
+        assert(result.load() == expected);
+
+        // 析构前提交的任务都会被执行
+        for (int i = 0; i < 1000; ++i) {
+            pool.submit([&counter]() { counter.fetch_add(1); });
+        }
+    }
+    assert(counter.load() == 11000);
+
+    std::cout << "Thread pool test passed.\n" << std::endl;
+}
+
+// 测试MPMC队列的基本功能
+void test_mpmc_basic() {
+    std::cout << "Testing MPMC queue basic..." << std::endl;
+    MPMCQueue<std::string, 4> q;
+
+    // MPMC队列不需要空出一个槽位，可以放满Capacity个元素
+    assert(q.push(std::string("a")) == true);
+    assert(q.push("b") == true);
+    assert(q.push("c") == true);
+    assert(q.push("d") == true);
+    assert(q.push("e") == false);  // 已满
+    assert(q.size() == 4);
+
+    std::string val;
+    assert(q.pop(val) == true);
+    assert(val == "a");
+    assert(q.push("e") == true);   // 绕回到第二圈
+    for (const char* expected : { "b", "c", "d", "e" }) {
+        assert(q.pop(val) == true);
+        assert(val == expected);
+    }
+    assert(q.pop(val) == false);  // 已空
+    assert(q.size() == 0);
+
+    std::cout << "MPMC queue basic test passed.\n" << std::endl;
+}
+
+// 多生产者多消费者压力测试：每个值恰好被消费一次
+void test_mpmc_stress() {
+    std::cout << "Testing MPMC stress scenario..." << std::endl;
+    const int PRODUCERS = 4;
+    const int CONSUMERS = 4;
+    const int PER_PRODUCER = 50000;
+    const int TOTAL = PRODUCERS * PER_PRODUCER;
+    MPMCQueue<int, 256> q;
+    std::vector<std::atomic<int>> seen(TOTAL);
+    for (auto& s : seen) s.store(0, std::memory_order_relaxed);
+    std::atomic<int> consumed(0);
+
+    std::vector<std::thread> threads;
+    for (int p = 0; p < PRODUCERS; ++p) {
+        threads.emplace_back([&q, p]() {
+            for (int i = 0; i < PER_PRODUCER; ++i) {
+                while (!q.push(p * PER_PRODUCER + i)) {
+                    std::this_thread::yield();
+                }
+            }
+            });
+    }
+    for (int c = 0; c < CONSUMERS; ++c) {
+        threads.emplace_back([&]() {
+            // 同一个生产者的数据在单个消费者看来必须保持递增
+            std::vector<int> last(PRODUCERS, -1);
+            int val;
+            while (consumed.load(std::memory_order_relaxed) < TOTAL) {
+                if (!q.pop(val)) {
+                    std::this_thread::yield();
+                    continue;
+                }
+                assert(val / PER_PRODUCER < PRODUCERS);
+                assert(val > last[val / PER_PRODUCER]);
+                last[val / PER_PRODUCER] = val;
+                seen[val].fetch_add(1, std::memory_order_relaxed);
+                consumed.fetch_add(1, std::memory_order_relaxed);
+            }
+            });
+    }
+    for (auto& t : threads) t.join();
+
+    for (int i = 0; i < TOTAL; ++i) {
+        assert(seen[i].load() == 1);
+    }
+    assert(q.size() == 0);
+
+    std::cout << "MPMC stress test passed.\n" << std::endl;
+}
+
 int main() {
     test_pod_type();
     test_non_pod_type();
     test_edge_cases();
     test_spsc_multithread();
+    test_index_cache_switch();
+    test_batch();
+    test_batch_multithread();
+    test_in_place();
+    test_stats();
+    test_wait_strategies();
+    test_notifying_ringbuffer();
+    test_record_ring();
+    test_shm_ringbuffer();
+    test_broadcast_ring();
+    test_dynamic_ringbuffer();
+    test_work_stealing_deque();
+    test_thread_pool();
+    test_mpmc_basic();
+    test_mpmc_stress();
 
     std::cout << "All tests passed successfully!" << std::endl;
     return 0;
@@ -0,0 +1,222 @@
+#ifndef __SHM_RINGBUFFER_HPP__
+#define __SHM_RINGBUFFER_HPP__
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/*
+ * 跨进程共享内存的SPSC RingBuffer
+ * 头部（读写下标各占一个cacheline，与RingBuffer相同）和槽位数组都放在memfd或shm_open的映射里，
+ * 一个进程create，另一个进程attach（通过名字，或者继承/传递过来的memfd），之后push/pop与RingBuffer一致
+ * 缓存的对方下标是每个进程自己的成员，不放在共享内存里
+ * 元素会按字节出现在另一个进程的地址空间里，所以只支持trivially copyable的类型
+ */
+template <typename T, std::size_t Capacity>
+class ShmRingBuffer
+{
+public:
+	static_assert(Capacity && !(Capacity & (Capacity - 1)), "Capacity must be power of 2");
+	static_assert(std::is_trivially_copyable<T>::value, "T must be trivially copyable to cross process boundary");
+	static_assert(ATOMIC_LONG_LOCK_FREE == 2, "shared atomics must be lock free");
+
+	static constexpr uint64_t MAGIC = 0x53484d52494e4731ULL; /*"SHMRING1"*/
+	static constexpr uint32_t VERSION = 1;
+
+	ShmRingBuffer() : fd_(-1), shared_(nullptr), read_cache_(0), write_cache_(0) {}
+
+	~ShmRingBuffer() {
+		detach();
+	}
+
+	ShmRingBuffer(const ShmRingBuffer&) = delete;
+	ShmRingBuffer& operator=(const ShmRingBuffer&) = delete;
+
+	/*创建匿名的memfd，fd可以被fork出的子进程继承，或者通过SCM_RIGHTS传给其他进程*/
+	bool create_memfd(const char* debug_name = "shm_ringbuffer") {
+		int fd = memfd_create(debug_name, MFD_CLOEXEC);
+		if (fd < 0) {
+			return false;
+		}
+		return init(fd);
+	}
+
+	/*通过shm_open创建有名字的共享内存，name形如"/ingest_queue"，已存在时失败*/
+	bool create(const char* name) {
+		int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+		if (fd < 0) {
+			return false;
+		}
+		if (!init(fd)) {
+			shm_unlink(name);
+			return false;
+		}
+		return true;
+	}
+
+	/*通过名字连接到另一个进程创建的队列*/
+	bool attach(const char* name) {
+		int fd = shm_open(name, O_RDWR, 0600);
+		if (fd < 0) {
+			return false;
+		}
+		return map_existing(fd);
+	}
+
+	/*连接到一个已有的fd（比如通过SCM_RIGHTS收到的），内部dup一份自己用，fd仍归调用者所有、由调用者关闭*/
+	bool attach_fd(int fd) {
+		int dup_fd = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+		if (dup_fd < 0) {
+			return false;
+		}
+		return map_existing(dup_fd);
+	}
+
+	static bool unlink(const char* name) {
+		return shm_unlink(name) == 0;
+	}
+
+	void detach() {
+		if (shared_) {
+			munmap(shared_, sizeof(Shared));
+			shared_ = nullptr;
+		}
+		if (fd_ >= 0) {
+			close(fd_);
+			fd_ = -1;
+		}
+		read_cache_ = write_cache_ = 0;
+	}
+
+	bool valid() const {
+		return shared_ != nullptr;
+	}
+
+	int fd() const {
+		return fd_;
+	}
+
+	template<typename U>
+	bool push(U&& value) {
+		const std::size_t w = shared_->write.load(std::memory_order_relaxed);
+		const std::size_t next_w = (w + 1) & (Capacity - 1);
+		if (next_w == read_cache_) {
+			read_cache_ = shared_->read.load(std::memory_order_acquire);
+			if (next_w == read_cache_) {
+				return false;
+			}
+		}
+		new (&shared_->slots[w]) T(std::forward<U>(value));
+		shared_->write.store(next_w, std::memory_order_release);
+		return true;
+	}
+
+	bool pop(T& value) {
+		const std::size_t r = shared_->read.load(std::memory_order_relaxed);
+		if (r == write_cache_) {
+			write_cache_ = shared_->write.load(std::memory_order_acquire);
+			if (r == write_cache_) {
+				return false;
+			}
+		}
+		value = *reinterpret_cast<T*>(&shared_->slots[r]);
+		shared_->read.store((r + 1) & (Capacity - 1), std::memory_order_release);
+		return true;
+	}
+
+	std::size_t size() const {
+		const std::size_t r = shared_->read.load(std::memory_order_acquire);
+		const std::size_t w = shared_->write.load(std::memory_order_acquire);
+		return (w - r) & (Capacity - 1);
+	}
+
+	/*共享映射的总大小*/
+	static constexpr std::size_t mapping_size() {
+		return sizeof(Shared);
+	}
+
+private:
+	struct Shared
+	{
+		std::atomic<uint64_t> magic; /*最后写入，attach看到正确的magic才说明初始化完成*/
+		uint32_t version;
+		uint32_t elem_size;
+		uint64_t elem_align;
+		uint64_t capacity;
+		alignas(64) std::atomic<std::size_t> read;
+		alignas(64) std::atomic<std::size_t> write;
+		alignas(64) std::aligned_storage_t<sizeof(T), alignof(T)> slots[Capacity];
+	};
+
+	bool init(int fd) {
+		if (ftruncate(fd, sizeof(Shared)) != 0) {
+			close(fd);
+			return false;
+		}
+		void* addr = mmap(nullptr, sizeof(Shared), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		if (addr == MAP_FAILED) {
+			close(fd);
+			return false;
+		}
+		detach();
+		fd_ = fd;
+		shared_ = static_cast<Shared*>(addr);
+		shared_->version = VERSION;
+		shared_->elem_size = sizeof(T);
+		shared_->elem_align = alignof(T);
+		shared_->capacity = Capacity;
+		new (&shared_->read) std::atomic<std::size_t>(0);
+		new (&shared_->write) std::atomic<std::size_t>(0);
+		new (&shared_->magic) std::atomic<uint64_t>(0);
+		shared_->magic.store(MAGIC, std::memory_order_release);
+		return true;
+	}
+
+	/*检查文件大小、魔数、版本以及元素类型和容量是否与本进程的模板参数一致*/
+	bool map_existing(int fd) {
+		struct stat st;
+		if (fstat(fd, &st) != 0 || static_cast<std::size_t>(st.st_size) != sizeof(Shared)) {
+			close(fd);
+			errno = EINVAL;
+			return false;
+		}
+		void* addr = mmap(nullptr, sizeof(Shared), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		if (addr == MAP_FAILED) {
+			close(fd);
+			return false;
+		}
+		Shared* shared = static_cast<Shared*>(addr);
+		if (shared->magic.load(std::memory_order_acquire) != MAGIC
+			|| shared->version != VERSION
+			|| shared->elem_size != sizeof(T)
+			|| shared->elem_align != alignof(T)
+			|| shared->capacity != Capacity) {
+			munmap(addr, sizeof(Shared));
+			close(fd);
+			errno = EINVAL;
+			return false;
+		}
+		detach();
+		fd_ = fd;
+		shared_ = shared;
+		read_cache_ = shared_->read.load(std::memory_order_acquire);
+		write_cache_ = shared_->write.load(std::memory_order_acquire);
+		return true;
+	}
+
+	int fd_;
+	Shared* shared_;
+	/*生产者进程只用read_cache_，消费者进程只用write_cache_，分开放避免同进程内两端的伪共享*/
+	alignas(64) std::size_t read_cache_;
+	alignas(64) std::size_t write_cache_;
+};
+
+#endif
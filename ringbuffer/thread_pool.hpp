@@ -0,0 +1,177 @@
+#ifndef __THREAD_POOL_HPP__
+#define __THREAD_POOL_HPP__
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "mpmc_queue.hpp"
+#include "wait_strategy.hpp"
+#include "work_stealing_deque.hpp"
+
+/*
+ * 固定线程数的工作窃取线程池
+ * 每个工作线程有自己的WorkStealingDeque，工作线程内部submit的任务压进自己的队列底部，
+ * 外部线程submit的任务进入共享的MPMCQueue注入队列
+ * 工作线程找任务的顺序: 自己的队列底部 -> 注入队列 -> 从随机的受害者顶部窃取
+ * 找不到任务时在FutexWait上挂起，submit只在有线程挂起时才付出唤醒的系统调用
+ */
+class ThreadPool
+{
+public:
+	explicit ThreadPool(std::size_t threads = std::thread::hardware_concurrency()) : stop_(false) {
+		if (threads == 0) threads = 1;
+		for (std::size_t i = 0; i < threads; ++i) {
+			workers_.emplace_back(new Worker(0x9e3779b97f4a7c15ULL * (i + 1)));
+		}
+		for (std::size_t i = 0; i < threads; ++i) {
+			workers_[i]->thread = std::thread(&ThreadPool::worker_loop, this, i);
+		}
+	}
+
+	/*等待所有已提交的任务执行完再退出*/
+	~ThreadPool() {
+		stop_.store(true, std::memory_order_seq_cst);
+		idle_.notify();
+		for (auto& w : workers_) {
+			w->thread.join();
+		}
+	}
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	template<typename F>
+	void submit(F&& f) {
+		Task* task = new Task(std::forward<F>(f));
+		Context& ctx = context();
+		if (ctx.pool == this) {
+			workers_[ctx.index]->deque.push(task);
+		}
+		else {
+			while (!injection_.push(task)) {
+				std::this_thread::yield();
+			}
+		}
+		idle_.notify();
+	}
+
+	/*在当前线程执行一个待处理的任务，没有任务返回false；用于等待子任务时帮忙干活，避免fork-join死锁*/
+	bool run_one() {
+		Task* task = nullptr;
+		Context& ctx = context();
+		const bool found = (ctx.pool == this) ? find_task(ctx.index, task) : find_external(task);
+		if (!found) {
+			return false;
+		}
+		run(task);
+		return true;
+	}
+
+	/*一边执行任务一边等待done()成立*/
+	template<typename Pred>
+	void wait_until(Pred&& done) {
+		while (!done()) {
+			if (!run_one()) {
+				std::this_thread::yield();
+			}
+		}
+	}
+
+	std::size_t size() const {
+		return workers_.size();
+	}
+
+private:
+	using Task = std::function<void()>;
+
+	struct Worker
+	{
+		explicit Worker(uint64_t seed) : rng(seed) {}
+		WorkStealingDeque<Task*> deque;
+		std::thread thread;
+		uint64_t rng; /*选择受害者的xorshift状态，只有本线程使用*/
+	};
+
+	/*当前线程属于哪个线程池的第几个工作线程*/
+	struct Context
+	{
+		ThreadPool* pool;
+		std::size_t index;
+	};
+
+	static Context& context() {
+		static thread_local Context ctx = { nullptr, 0 };
+		return ctx;
+	}
+
+	static void run(Task* task) {
+		(*task)();
+		delete task;
+	}
+
+	void worker_loop(std::size_t index) {
+		context() = Context{ this, index };
+		Task* task = nullptr;
+		for (;;) {
+			if (find_task(index, task)) {
+				run(task);
+				continue;
+			}
+			if (stop_.load(std::memory_order_acquire)) {
+				/*退出前再确认一次没有遗漏的任务*/
+				if (!has_work()) break;
+				continue;
+			}
+			idle_.wait([this]() { return stop_.load(std::memory_order_relaxed) || has_work(); });
+		}
+		context() = Context{ nullptr, 0 };
+	}
+
+	bool find_task(std::size_t index, Task*& task) {
+		if (workers_[index]->deque.pop(task)) return true;
+		if (injection_.pop(task)) return true;
+		return steal(workers_[index]->rng, index, task);
+	}
+
+	bool find_external(Task*& task) {
+		if (injection_.pop(task)) return true;
+		uint64_t seed = reinterpret_cast<uintptr_t>(&task);
+		return steal(seed, workers_.size(), task);
+	}
+
+	/*从一个随机位置开始把其他工作线程轮一遍*/
+	bool steal(uint64_t& rng, std::size_t self, Task*& task) {
+		rng ^= rng << 13;
+		rng ^= rng >> 7;
+		rng ^= rng << 17;
+		const std::size_t n = workers_.size();
+		const std::size_t start = static_cast<std::size_t>(rng % n);
+		for (std::size_t i = 0; i < n; ++i) {
+			const std::size_t victim = (start + i) % n;
+			if (victim != self && workers_[victim]->deque.steal(task)) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	bool has_work() const {
+		if (injection_.size() != 0) return true;
+		for (auto& w : workers_) {
+			if (!w->deque.empty()) return true;
+		}
+		return false;
+	}
+
+	std::vector<std::unique_ptr<Worker>> workers_;
+	MPMCQueue<Task*, 4096> injection_;
+	FutexWait<64> idle_;
+	std::atomic<bool> stop_;
+};
+
+#endif
@@ -0,0 +1,205 @@
+#ifndef __WAIT_STRATEGY_HPP__
+#define __WAIT_STRATEGY_HPP__
+
+#include <atomic>
+#include <cstdint>
+#include <climits>
+#include <thread>
+#include <unistd.h>
+#include <poll.h>
+#include <errno.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <sys/eventfd.h>
+
+/*
+ * RingBuffer消费者的等待策略
+ * 每个策略提供两个接口:
+ *   wait(ready)  消费者调用，直到ready()返回true才返回
+ *   notify()     生产者发布新元素（release store之后）调用
+ * 阻塞类策略只有消费者真正挂起时，生产者才会付出唤醒的系统调用
+ */
+
+inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_ia32_pause(); /*pause指令降低自旋时的功耗，也避免退出循环时的内存序冲突*/
+#elif defined(__aarch64__)
+	asm volatile("yield" ::: "memory");
+#endif
+}
+
+/*纯自旋: 唤醒延迟最低，但消费者独占一个核*/
+class BusySpinWait
+{
+public:
+	template<typename Ready>
+	void wait(Ready&& ready) {
+		while (!ready()) {
+			cpu_relax();
+		}
+	}
+
+	void notify() {}
+};
+
+/*先自旋SpinCount次，之后每次检查前让出CPU*/
+template <unsigned SpinCount = 1024>
+class SpinYieldWait
+{
+public:
+	template<typename Ready>
+	void wait(Ready&& ready) {
+		for (unsigned i = 0; i < SpinCount; ++i) {
+			if (ready()) return;
+			cpu_relax();
+		}
+		while (!ready()) {
+			std::this_thread::yield();
+		}
+	}
+
+	void notify() {}
+};
+
+/*
+ * 短暂自旋之后在futex上睡眠
+ * 消费者先登记waiters_再检查队列，生产者先发布再检查waiters_，两边各有一个seq_cst屏障，
+ * 所以要么消费者看到新元素，要么生产者看到有人在等，不会丢失唤醒
+ */
+template <unsigned SpinCount = 128>
+class FutexWait
+{
+public:
+	FutexWait() : seq_(0), waiters_(0) {}
+
+	template<typename Ready>
+	void wait(Ready&& ready) {
+		for (unsigned i = 0; i < SpinCount; ++i) {
+			if (ready()) return;
+			cpu_relax();
+		}
+		while (!ready()) {
+			const uint32_t seq = seq_.load(std::memory_order_acquire);
+			waiters_.fetch_add(1, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			if (!ready()) {
+				/*seq_在这期间被生产者修改过的话futex会立刻返回EAGAIN*/
+				syscall(SYS_futex, reinterpret_cast<uint32_t*>(&seq_), FUTEX_WAIT_PRIVATE, seq, nullptr, nullptr, 0);
+			}
+			waiters_.fetch_sub(1, std::memory_order_relaxed);
+		}
+	}
+
+	void notify() {
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (waiters_.load(std::memory_order_relaxed) == 0) {
+			return;
+		}
+		seq_.fetch_add(1, std::memory_order_release);
+		syscall(SYS_futex, reinterpret_cast<uint32_t*>(&seq_), FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+	}
+
+private:
+	static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "futex word must be 32 bits");
+	std::atomic<uint32_t> seq_;
+	std::atomic<uint32_t> waiters_;
+};
+
+/*
+ * 短暂自旋之后在eventfd上睡眠，fd可以交给epoll，与其他事件一起等待
+ * armed_表示消费者已经准备睡眠，生产者只在armed_为true时才写eventfd，协议和FutexWait相同
+ * eventfd创建失败（比如fd用完）时valid()为false，wait退化为自旋加yield，不会在无效的fd上永远睡下去
+ */
+template <unsigned SpinCount = 128>
+class EventfdWait
+{
+public:
+	EventfdWait() : armed_(false) {
+		efd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	}
+
+	~EventfdWait() {
+		if (efd_ >= 0) {
+			close(efd_);
+		}
+	}
+
+	EventfdWait(const EventfdWait&) = delete;
+	EventfdWait& operator=(const EventfdWait&) = delete;
+
+	template<typename Ready>
+	void wait(Ready&& ready) {
+		for (unsigned i = 0; i < SpinCount; ++i) {
+			if (ready()) return;
+			cpu_relax();
+		}
+		if (efd_ < 0) {
+			while (!ready()) std::this_thread::yield();
+			return;
+		}
+		while (!arm(ready)) {
+			struct pollfd pfd;
+			pfd.fd = efd_;
+			pfd.events = POLLIN;
+			pfd.revents = 0;
+			poll(&pfd, 1, -1);
+			clear();
+		}
+	}
+
+	void notify() {
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (!armed_.load(std::memory_order_relaxed) || !armed_.exchange(false, std::memory_order_relaxed)) {
+			return;
+		}
+		signal();
+	}
+
+	/*无条件让fd变为可读*/
+	void signal() {
+		uint64_t one = 1;
+		ssize_t ret;
+		do {
+			ret = ::write(efd_, &one, sizeof(one));
+		} while (ret < 0 && errno == EINTR);
+	}
+
+	/*
+	 * 准备睡眠: 置位armed_之后再检查一次队列
+	 * 返回true表示已经有数据，调用者不应该睡眠
+	 */
+	template<typename Ready>
+	bool arm(Ready&& ready) {
+		armed_.store(true, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (ready()) {
+			armed_.store(false, std::memory_order_relaxed);
+			return true;
+		}
+		return false;
+	}
+
+	/*读走eventfd的计数，使fd重新变为不可读*/
+	void clear() {
+		uint64_t value;
+		ssize_t ret;
+		do {
+			ret = ::read(efd_, &value, sizeof(value));
+		} while (ret < 0 && errno == EINTR);
+	}
+
+	int fd() const {
+		return efd_;
+	}
+
+	/*eventfd创建成功*/
+	bool valid() const {
+		return efd_ >= 0;
+	}
+
+private:
+	int efd_;
+	std::atomic<bool> armed_;
+};
+
+#endif
@@ -0,0 +1,136 @@
+#ifndef __WORK_STEALING_DEQUE_HPP__
+#define __WORK_STEALING_DEQUE_HPP__
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+/*
+ * Chase-Lev工作窃取双端队列（按Lê等人给出的C11内存序实现）
+ * 拥有者线程在底部push/pop（后进先出，缓存友好），其他线程从顶部steal（先进先出），用CAS和拥有者争抢最后一个元素
+ * 底层是可以扩容的环形数组，push永远不会失败；扩容后的旧数组可能还有窃取者在读，保留到析构时才释放
+ * 元素按值原子地读写，所以只支持trivially copyable的类型（通常是任务指针）
+ */
+template <typename T>
+class WorkStealingDeque
+{
+public:
+	static_assert(std::is_trivially_copyable<T>::value, "T must be trivially copyable");
+
+	explicit WorkStealingDeque(std::size_t capacity = 256) : top_(0), bottom_(0) {
+		std::size_t cap = 2;
+		while (cap < capacity) cap <<= 1;
+		arrays_.emplace_back(new Array(cap));
+		array_.store(arrays_.back().get(), std::memory_order_relaxed);
+	}
+
+	WorkStealingDeque(const WorkStealingDeque&) = delete;
+	WorkStealingDeque& operator=(const WorkStealingDeque&) = delete;
+
+	/*只能由拥有者线程调用*/
+	void push(T value) {
+		const int64_t b = bottom_.load(std::memory_order_relaxed);
+		const int64_t t = top_.load(std::memory_order_acquire);
+		Array* a = array_.load(std::memory_order_relaxed);
+		if (b - t > static_cast<int64_t>(a->capacity) - 1) {
+			a = grow(a, t, b);
+		}
+		a->put(b, value);
+		bottom_.store(b + 1, std::memory_order_release); /*窃取者acquire读取bottom_之后能看到元素的内容*/
+	}
+
+	/*只能由拥有者线程调用，从底部取出最新的元素*/
+	bool pop(T& value) {
+		const int64_t b = bottom_.load(std::memory_order_relaxed) - 1;
+		Array* a = array_.load(std::memory_order_relaxed);
+		bottom_.store(b, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		int64_t t = top_.load(std::memory_order_relaxed);
+		if (t > b) {
+			/*队列为空，恢复bottom_*/
+			bottom_.store(b + 1, std::memory_order_relaxed);
+			return false;
+		}
+		value = a->get(b);
+		if (t == b) {
+			/*最后一个元素，和窃取者竞争*/
+			const bool won = top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+			bottom_.store(b + 1, std::memory_order_relaxed);
+			return won;
+		}
+		return true;
+	}
+
+	/*任意线程调用，从顶部窃取最老的元素；队列为空或者竞争失败返回false*/
+	bool steal(T& value) {
+		int64_t t = top_.load(std::memory_order_acquire);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		const int64_t b = bottom_.load(std::memory_order_acquire);
+		if (t >= b) {
+			return false;
+		}
+		Array* a = array_.load(std::memory_order_acquire);
+		T v = a->get(t);
+		if (!top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+			return false;
+		}
+		value = v;
+		return true;
+	}
+
+	/*近似值，只用于判断是否值得去窃取*/
+	std::size_t size() const {
+		const int64_t b = bottom_.load(std::memory_order_relaxed);
+		const int64_t t = top_.load(std::memory_order_relaxed);
+		return b > t ? static_cast<std::size_t>(b - t) : 0;
+	}
+
+	bool empty() const {
+		return size() == 0;
+	}
+
+	std::size_t capacity() const {
+		return array_.load(std::memory_order_relaxed)->capacity;
+	}
+
+private:
+	struct Array
+	{
+		explicit Array(std::size_t cap) : capacity(cap), mask(cap - 1), slots(new std::atomic<T>[cap]) {}
+
+		T get(int64_t i) const {
+			return slots[static_cast<std::size_t>(i) & mask].load(std::memory_order_relaxed);
+		}
+
+		void put(int64_t i, T value) {
+			slots[static_cast<std::size_t>(i) & mask].store(value, std::memory_order_relaxed);
+		}
+
+		std::size_t capacity;
+		std::size_t mask;
+		std::unique_ptr<std::atomic<T>[]> slots;
+	};
+
+	/*容量翻倍，把[t, b)拷贝到新数组的相同逻辑位置*/
+	Array* grow(Array* old, int64_t t, int64_t b) {
+		arrays_.emplace_back(new Array(old->capacity * 2));
+		Array* a = arrays_.back().get();
+		for (int64_t i = t; i < b; ++i) {
+			a->put(i, old->get(i));
+		}
+		array_.store(a, std::memory_order_release);
+		return a;
+	}
+
+	/*队列通常作为工作线程的成员放在堆上，C++17之前new不保证alignas(64)，用填充把top_和bottom_隔开*/
+	std::atomic<int64_t> top_;    /*窃取者竞争的位置*/
+	char pad_[64];
+	std::atomic<int64_t> bottom_; /*只有拥有者写*/
+	std::atomic<Array*> array_;
+	std::vector<std::unique_ptr<Array>> arrays_; /*所有用过的数组，只有拥有者修改*/
+};
+
+#endif
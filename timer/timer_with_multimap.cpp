@@ -1,7 +1,10 @@
+#include <atomic>
 #include <iostream>
 #include <sys/epoll.h>
+#include <thread>
 
 #include "timer_with_multimap.hpp"
+#include "../ringbuffer/notifying_ringbuffer.hpp"
 
 int main()
 {
@@ -13,7 +16,7 @@ int main()
 	struct epoll_event evs[512];
 	Timer timer;
 
-	int i, j, k = 0;
+	int i = 0, j = 0, k = 0;
 	timer.add_timeout(1000, [&]() {
 		std::cout << "Timeout 1 seconds: " << i++ << std::endl;
 		});
@@ -28,6 +31,32 @@ int main()
 
 	timer.del_timeout(timer_ptr);
 
+	/*worker线程投递到reactor线程的任务，通过eventfd和定时器在同一个epoll循环里处理；队列是SPSC，只有worker一个生产者*/
+	NotifyingRingBuffer<std::function<void()>, 1024> tasks;
+	if (!tasks.valid()) {
+		std::cerr << "eventfd error: " << errno << std::endl;
+		return -1;
+	}
+	struct epoll_event ev;
+	ev.events = EPOLLIN;
+	ev.data.fd = tasks.fd();
+	if (-1 == epoll_ctl(epfd, EPOLL_CTL_ADD, tasks.fd(), &ev)) {
+		std::cerr << "epoll_ctl error: " << errno << std::endl;
+		return -1;
+	}
+	/*worker引用栈上的tasks，退出循环之后先停下并join，再让tasks析构*/
+	std::atomic<bool> stop(false);
+	std::thread worker([&tasks, &stop]() {
+		for (int n = 0; !stop.load(std::memory_order_relaxed); ++n) {
+			for (int slept = 0; slept < 1500 && !stop.load(std::memory_order_relaxed); slept += 100) {
+				std::this_thread::sleep_for(std::chrono::milliseconds(100));
+			}
+			tasks.push([n]() {
+				std::cout << "Task from worker thread: " << n << std::endl;
+				});
+		}
+		});
+
 	while (true) {
 		int n = epoll_wait(epfd, evs, 512, timer.wait_time()); /*-1 一直阻塞*/
 		if (-1 == n) {
@@ -37,8 +66,16 @@ int main()
 			std::cerr << "epoll_wait error: " << errno << std::endl;
 			break;
 		}
+		for (int m = 0; m < n; ++m) {
+			if (evs[m].data.fd == tasks.fd()) {
+				tasks.drain([](std::function<void()>& task) { task(); });
+			}
+		}
 		timer.handle_timeout();
 
 	}
+	stop.store(true, std::memory_order_relaxed);
+	worker.join();
+	close(epfd);
 	return 0;
 }
\ No newline at end of file
@@ -63,8 +63,9 @@ public:
 		if (iter == timer_map_.end()) {
 			return -1;
 		}
-		uint64_t diff = iter->first - get_current_time();
-		return diff > 0 ? diff : 0;
+		/*epoll可能被其他fd提前唤醒，这时最早的定时器可能已经过期，不能直接相减*/
+		uint64_t now = get_current_time();
+		return iter->first > now ? static_cast<int>(iter->first - now) : 0;
 	}
 
 	void handle_timeout() {